@@ -21,11 +21,19 @@ extern "C" {
 #include <string>
 #include <functional>
 #include <algorithm>
+#include <map>
+#include <queue>
 #include <stdexcept>  // Add this line to support std::runtime_error
 #include "H264Encoder.h"
 #include "H264Decoder.h"
 #include "FFmpegUtils.h"
 #include "H264NALUParser.h"
+#include "H264ParameterSets.h"
+#include "H264RBSP.h"
+#include "H264AccessUnitAssembler.h"
+#include "H264FrameMetadata.h"
+#include "H264SliceHeader.h"
+#include "MappedFile.h"
 #include <asio.hpp>
 #include <iostream>
 #include <thread>
@@ -84,6 +92,10 @@ int _getch() {
 #include "CameraDataReceiver.h"
 #include "CameraDataSender.h"
 #include "NetworkVideoSource.h"
+#include "H264RtpPacketizer.h"
+#include "RtpDataReceiver.h"
+#include "RtpFec.h"
+#include "RtpDataSender.h"
 #include <fstream>
 #include <sstream>
 #include <iomanip>
@@ -392,17 +404,12 @@ int runH264TCPTransferTest(int argc, char* argv[], const std::string & ip, int p
             avdevice_register_all();
 
             // Create encoder instance
-            H264Encoder h264_encoder(resolution_width, resolution_height, [&sender](const uint8_t* data, size_t size) {
-                OutputDebugStringA((std::string("encode done send size: ") + std::to_string(size)).c_str());
-                // Implement 4-byte big-endian length header, matching Java's ByteBuffer.putInt(length)
-                std::vector<uint8_t> packet(4 + size);
-                packet[0] = (size >> 24) & 0xFF;
-                packet[1] = (size >> 16) & 0xFF;
-                packet[2] = (size >> 8) & 0xFF;
-                packet[3] = (size) & 0xFF;
-                std::copy(data, data + size, packet.begin() + 4);
-                sender.sendData(reinterpret_cast<const char*>(packet.data()), static_cast<uint32_t>(packet.size()));
-                }, frameRate);
+            H264Encoder h264_encoder(resolution_width, resolution_height, nullptr, frameRate);
+            h264_encoder.setPacketCallback([&sender](const AVPacket* packet) {
+                OutputDebugStringA((std::string("encode done send size: ") + std::to_string(packet->size)).c_str());
+                // Queued by reference with a 4-byte big-endian length header, matching Java's ByteBuffer.putInt(length)
+                sender.sendFrame(packet);
+                });
 
             // ZED Camera setup
             sl::Camera zed;
@@ -474,6 +481,11 @@ int runH264TCPTransferTest(int argc, char* argv[], const std::string & ip, int p
                     std::vector<uint8_t> y_plane, u_plane, v_plane;
                     convertRBGAToYUV(zed_image, y_plane, u_plane, v_plane);
 
+                    // The sender had to drop a reference frame, the receiver needs an IDR to recover
+                    if (sender.needsKeyframe()) {
+                        h264_encoder.requestKeyframe();
+                    }
+
                     // Pass YUV planes to the encoder
                     h264_encoder.encodeFrame(y_plane.data(), u_plane.data(), v_plane.data(),
                         y_plane.size(), u_plane.size(), v_plane.size());
@@ -489,10 +501,16 @@ int runH264TCPTransferTest(int argc, char* argv[], const std::string & ip, int p
             sender.disconnect();
         };
 
-        // Create client instance and start connection
+        // Create client instance and connect, frames are then sent on the sender's io thread
         CameraDataSender sender(ip.c_str(), port);
-        sender.startConnect(run); // Pass lambda function as callback
-        sender.runIOContext(); // Run io_context to handle async operations
+        try {
+            sender.connect();
+        }
+        catch (const SendDataException& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        run(sender);
 
     }
     else {
@@ -503,6 +521,545 @@ int runH264TCPTransferTest(int argc, char* argv[], const std::string & ip, int p
     return 0;
 }
 
+int runH264FileDecodeTest(const std::string& input_filename) {
+    std::ifstream input_file(input_filename, std::ios::binary);
+    if (!input_file) {
+        std::cerr << "Failed to open input file: " << input_filename << std::endl;
+        return 1;
+    }
+
+    std::ofstream output_file("decoded_frames.yuv", std::ios::binary);
+    int decoded_frames = 0;
+
+    H264Decoder h264_decoder([&](const uint8_t* data, size_t size, int width, int height) {
+        printf("Decoded frame %d size: %zu bytes, resolution: %dx%d\n", decoded_frames++, size, width, height);
+        output_file.write(reinterpret_cast<const char*>(data), size);
+    });
+
+    // Feed the raw Annex-B stream in fixed-size chunks, frame boundaries are found by the parser
+    std::vector<char> chunk(64 * 1024);
+    while (input_file) {
+        input_file.read(chunk.data(), chunk.size());
+        std::streamsize bytes_read = input_file.gcount();
+        if (bytes_read <= 0) {
+            break;
+        }
+        h264_decoder.decodeStream(reinterpret_cast<const uint8_t*>(chunk.data()), static_cast<size_t>(bytes_read));
+    }
+    h264_decoder.flushStream();
+
+    printf("Decoded %d frames, written to decoded_frames.yuv\n", decoded_frames);
+    H264Decoder::Stats stats = h264_decoder.getStats();
+    printf("Frames output on the same decode call: %" PRIu64 "/%" PRIu64 "\n", stats.framesSameCall, stats.framesDecoded);
+    printf("Decode latency: avg %.1f us, max %" PRIu64 " us\n", stats.avgDecodeLatencyUs, stats.maxDecodeLatencyUs);
+    return 0;
+}
+
+// Walk every start code of the buffer with the given scanner, returns the number found
+size_t countStartCodes(const uint8_t* data, size_t size,
+                       const uint8_t* (*scan)(const uint8_t*, const uint8_t*)) {
+    const uint8_t* end = data + size;
+    size_t count = 0;
+    const uint8_t* p = scan(data, end);
+    while (p < end) {
+        count++;
+        p = scan(p + 3, end);
+    }
+    return count;
+}
+
+int runStartCodeBenchmark(const std::string& input_filename) {
+    std::vector<uint8_t> stream;
+    if (!input_filename.empty()) {
+        std::ifstream input_file(input_filename, std::ios::binary);
+        if (!input_file) {
+            std::cerr << "Failed to open input file: " << input_filename << std::endl;
+            return 1;
+        }
+        stream.assign(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+    }
+    else {
+        // Synthetic 16 MB stream: NALUs of 1 KB to 64 KB with random payload. Zero bytes are
+        // frequent, like in real slice data, but never form a start code inside a payload.
+        srand(1234);
+        while (stream.size() < 16 * 1024 * 1024) {
+            if (rand() % 2) {
+                stream.push_back(0);
+            }
+            stream.insert(stream.end(), {0, 0, 1, static_cast<uint8_t>(rand() % 2 ? 0x65 : 0x41)});
+            size_t nalu_size = 1024 + rand() % (63 * 1024);
+            for (size_t i = 0; i < nalu_size; i++) {
+                uint8_t value = rand() % 16 == 0 ? 0 : static_cast<uint8_t>(rand());
+                size_t n = stream.size();
+                if (n >= 2 && stream[n - 1] == 0 && stream[n - 2] == 0 && value <= 3) {
+                    stream.push_back(3); // Emulation prevention byte
+                }
+                stream.push_back(value);
+            }
+        }
+    }
+    if (stream.empty()) {
+        std::cerr << "Input stream is empty" << std::endl;
+        return 1;
+    }
+
+    const uint8_t* data = stream.data();
+    const uint8_t* end = data + stream.size();
+
+    // Both scanners must agree from every start code and from arbitrary offsets
+    size_t mismatches = 0;
+    size_t checks = 0;
+    const uint8_t* p = data;
+    while (p < end) {
+        const uint8_t* expected = H264NALUParser::findStartCodeScalar(p, end);
+        if (H264NALUParser::findStartCode(p, end) != expected) {
+            mismatches++;
+        }
+        checks++;
+        p = expected < end ? expected + 1 : end;
+    }
+    srand(5678);
+    for (int i = 0; i < 100000; i++) {
+        size_t offset = (static_cast<size_t>(rand()) * RAND_MAX + rand()) % stream.size();
+        size_t length = rand() % 256;
+        const uint8_t* limit = data + std::min(stream.size(), offset + length);
+        if (H264NALUParser::findStartCode(data + offset, limit) != H264NALUParser::findStartCodeScalar(data + offset, limit)) {
+            mismatches++;
+        }
+        checks++;
+    }
+    printf("Verified %zu scans, %zu mismatches\n", checks, mismatches);
+
+    // Time a full walk over the stream with each scanner
+    const int iterations = std::max(1, static_cast<int>((256 * 1024 * 1024) / stream.size()));
+    struct Scanner {
+        const char* name;
+        const uint8_t* (*scan)(const uint8_t*, const uint8_t*);
+    } scanners[] = {
+        {"scalar", H264NALUParser::findStartCodeScalar},
+        {"vectorized", H264NALUParser::findStartCode},
+    };
+    for (const Scanner& scanner : scanners) {
+        size_t found = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            found = countStartCodes(data, stream.size(), scanner.scan);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        printf("%-10s: %zu start codes, %.1f MB/s\n", scanner.name, found,
+               static_cast<double>(stream.size()) * iterations / seconds / (1024 * 1024));
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Random payload with many short zero runs, so emulation prevention is exercised often
+std::vector<uint8_t> makeRandomPayload(size_t size, int zeroPercent) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        int r = rand() % 100;
+        payload[i] = r < zeroPercent ? 0 : (r < zeroPercent + 5 ? static_cast<uint8_t>(rand() % 4) : static_cast<uint8_t>(rand()));
+    }
+    return payload;
+}
+
+int runRBSPBenchmark() {
+    size_t failures = 0;
+    srand(4321);
+
+    // Round trips on random sizes, checked against the byte-at-a-time implementations
+    const int rounds = 20000;
+    std::vector<uint8_t> ebsp, ebsp_scalar, rbsp, rbsp_scalar;
+    for (int round = 0; round < rounds; round++) {
+        std::vector<uint8_t> payload = makeRandomPayload(rand() % 300, rand() % 60);
+        if (!payload.empty() && round % 2 == 0) {
+            payload.back() = 0x80; // rbsp_trailing_bits, as in a real NAL unit
+        }
+
+        H264RBSP::rbspToEbsp(payload.data(), payload.size(), ebsp);
+        ebsp_scalar.resize(H264RBSP::maxEbspSize(payload.size()));
+        ebsp_scalar.resize(H264RBSP::rbspToEbspScalar(payload.data(), payload.size(), ebsp_scalar.data()));
+        H264RBSP::ebspToRbsp(ebsp.data(), ebsp.size(), rbsp);
+
+        // No start code prefix may survive in the escaped data
+        bool emulated = false;
+        for (size_t i = 2; i < ebsp.size(); i++) {
+            if (ebsp[i - 2] == 0 && ebsp[i - 1] == 0 && ebsp[i] <= 2) {
+                emulated = true;
+            }
+        }
+        if (ebsp != ebsp_scalar || emulated || rbsp != payload) {
+            failures++;
+        }
+
+        // Removal on arbitrary data must match the reference as well
+        rbsp_scalar.resize(payload.size());
+        rbsp_scalar.resize(H264RBSP::ebspToRbspScalar(payload.data(), payload.size(), rbsp_scalar.data()));
+        H264RBSP::ebspToRbsp(payload.data(), payload.size(), rbsp);
+        if (rbsp != rbsp_scalar) {
+            failures++;
+        }
+    }
+
+    // Bit writer and reader round trip
+    for (int round = 0; round < 2000; round++) {
+        H264BitWriter writer;
+        std::vector<uint32_t> values;
+        std::vector<int> kinds;
+        int count = 1 + rand() % 64;
+        for (int i = 0; i < count; i++) {
+            int kind = rand() % 3;
+            uint32_t value = static_cast<uint32_t>(rand()) % (kind == 0 ? 65536 : 5000);
+            if (kind == 0) {
+                writer.writeBits(value, 16);
+            }
+            else if (kind == 1) {
+                writer.writeUE(value);
+            }
+            else {
+                writer.writeSE(static_cast<int32_t>(value) - 2500);
+            }
+            kinds.push_back(kind);
+            values.push_back(value);
+        }
+        writer.writeTrailingBits();
+
+        H264RBSP::rbspToEbsp(writer.data().data(), writer.data().size(), ebsp);
+        H264RBSP::ebspToRbsp(ebsp.data(), ebsp.size(), rbsp);
+        H264BitReader reader(rbsp.data(), rbsp.size());
+        bool ok = true;
+        for (int i = 0; i < count; i++) {
+            uint32_t value = kinds[i] == 0 ? reader.readBits(16)
+                           : kinds[i] == 1 ? reader.readUE()
+                           : static_cast<uint32_t>(reader.readSE() + 2500);
+            ok = ok && value == values[i];
+        }
+        if (!ok || reader.moreRbspData() || reader.overrun()) {
+            failures++;
+        }
+    }
+    printf("Round-trip checks: %d payloads, 2000 bit streams, %zu failures\n", rounds, failures);
+
+    // Throughput on 16 MB of slice-like data
+    std::vector<uint8_t> payload = makeRandomPayload(16 * 1024 * 1024, 4);
+    std::vector<uint8_t> escaped(H264RBSP::maxEbspSize(payload.size()));
+    std::vector<uint8_t> unescaped(escaped.size());
+    size_t escaped_size = H264RBSP::rbspToEbsp(payload.data(), payload.size(), escaped.data());
+
+    struct Case {
+        const char* name;
+        std::function<size_t()> run;
+        size_t bytes;
+    } cases[] = {
+        {"insert scalar", [&]() { return H264RBSP::rbspToEbspScalar(payload.data(), payload.size(), escaped.data()); }, payload.size()},
+        {"insert vector", [&]() { return H264RBSP::rbspToEbsp(payload.data(), payload.size(), escaped.data()); }, payload.size()},
+        {"remove scalar", [&]() { return H264RBSP::ebspToRbspScalar(escaped.data(), escaped_size, unescaped.data()); }, escaped_size},
+        {"remove vector", [&]() { return H264RBSP::ebspToRbsp(escaped.data(), escaped_size, unescaped.data()); }, escaped_size},
+    };
+    for (const Case& c : cases) {
+        const int iterations = 16;
+        auto start_time = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            c.run();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        printf("%-14s: %.1f MB/s\n", c.name, static_cast<double>(c.bytes) * iterations / seconds / (1024 * 1024));
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// Frame categories reported by the stream analyzer
+enum StreamFrameType {
+    STREAM_FRAME_IDR,
+    STREAM_FRAME_I,
+    STREAM_FRAME_P,
+    STREAM_FRAME_B,
+    STREAM_FRAME_TYPES
+};
+
+const char* streamFrameTypeName(int type) {
+    static const char* names[STREAM_FRAME_TYPES] = {"IDR", "I", "P", "B"};
+    return type >= 0 && type < STREAM_FRAME_TYPES ? names[type] : "?";
+}
+
+struct AnalyzedFrame {
+    uint64_t index;
+    size_t offset;
+    size_t size;
+    int type;
+};
+
+// Statistics of a raw Annex-B H.264 recording. The file is memory-mapped and walked once
+// with the NALU iterator, so memory use does not depend on the file size.
+int runStreamAnalysis(const std::string& input_filename, int frameRate) {
+    MappedFile file;
+    if (!file.open(input_filename)) {
+        std::cerr << "Failed to open input file: " << input_filename << std::endl;
+        return 1;
+    }
+    if (file.size() == 0) {
+        std::cerr << "Input stream is empty" << std::endl;
+        return 1;
+    }
+    file.adviseSequential();
+    const uint8_t* data = file.data();
+    const size_t file_size = file.size();
+    const double frame_duration = 1.0 / (frameRate > 0 ? frameRate : 30);
+
+    // Size histogram buckets: < 1 KB, then one bucket per power of two up to >= 8 MB
+    const int kSizeBuckets = 15;
+    const size_t kTopFrames = 10;
+    struct TypeStats {
+        uint64_t count = 0;
+        uint64_t totalBytes = 0;
+        size_t minSize = SIZE_MAX;
+        size_t maxSize = 0;
+        uint64_t histogram[kSizeBuckets] = {};
+    } type_stats[STREAM_FRAME_TYPES];
+
+    uint64_t nalu_counts[32] = {};
+    uint64_t frame_count = 0;
+    uint64_t non_reference_frames = 0;
+    std::vector<uint64_t> second_bytes;
+    std::vector<uint32_t> second_frames;
+    bool use_metadata_time = false;
+    int64_t first_capture_time_us = 0;
+
+    // GOP = frames from one IDR/I frame up to the next
+    std::map<uint64_t, uint64_t> gop_lengths;
+    uint64_t gop_count = 0;
+    uint64_t gop_frames = 0;
+    uint64_t gop_bytes = 0;
+    uint64_t gop_total_bytes = 0;
+    std::string first_gop_pattern;
+
+    auto larger = [](const AnalyzedFrame& a, const AnalyzedFrame& b) { return a.size > b.size; };
+    std::priority_queue<AnalyzedFrame, std::vector<AnalyzedFrame>, decltype(larger)> largest(larger);
+
+    // Access unit in progress
+    size_t au_start = 0;
+    bool au_open = false;
+    bool au_has_vcl = false;
+    bool au_reference = false;
+    int au_type = STREAM_FRAME_P;
+    bool au_has_metadata = false;
+    FrameMetadata au_metadata;
+
+    auto finish_gop = [&]() {
+        if (gop_frames > 0) {
+            gop_lengths[gop_frames]++;
+            gop_count++;
+            gop_total_bytes += gop_bytes;
+        }
+        gop_frames = 0;
+        gop_bytes = 0;
+    };
+
+    auto finish_frame = [&](size_t end) {
+        const size_t size = end - au_start;
+        const AnalyzedFrame frame = {frame_count, au_start, size, au_type};
+
+        TypeStats& stats = type_stats[au_type];
+        stats.count++;
+        stats.totalBytes += size;
+        stats.minSize = std::min(stats.minSize, size);
+        stats.maxSize = std::max(stats.maxSize, size);
+        int bucket = 0;
+        while (bucket < kSizeBuckets - 1 && (static_cast<size_t>(1024) << bucket) <= size) {
+            bucket++;
+        }
+        stats.histogram[bucket]++;
+        if (!au_reference) {
+            non_reference_frames++;
+        }
+
+        // Capture timestamps from the frame metadata SEI are used when the stream starts with one
+        if (frame_count == 0 && au_has_metadata) {
+            use_metadata_time = true;
+            first_capture_time_us = au_metadata.captureTimeUs;
+        }
+        double seconds = frame_count * frame_duration;
+        if (use_metadata_time && au_has_metadata) {
+            seconds = (au_metadata.captureTimeUs - first_capture_time_us) / 1e6;
+        }
+        const size_t second = seconds > 0 ? static_cast<size_t>(seconds) : 0;
+        if (second < 1000000) {
+            if (second >= second_bytes.size()) {
+                second_bytes.resize(second + 1, 0);
+                second_frames.resize(second + 1, 0);
+            }
+            second_bytes[second] += size;
+            second_frames[second]++;
+        }
+
+        if (au_type == STREAM_FRAME_IDR || au_type == STREAM_FRAME_I) {
+            finish_gop();
+        }
+        gop_frames++;
+        gop_bytes += size;
+        if (gop_count == 0 && first_gop_pattern.size() < 64) {
+            first_gop_pattern += au_type == STREAM_FRAME_IDR ? 'I' : streamFrameTypeName(au_type)[0];
+            if (!au_reference) {
+                first_gop_pattern.back() = static_cast<char>(tolower(first_gop_pattern.back()));
+            }
+        }
+
+        if (largest.size() < kTopFrames) {
+            largest.push(frame);
+        }
+        else if (size > largest.top().size) {
+            largest.pop();
+            largest.push(frame);
+        }
+        frame_count++;
+    };
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (const H264NALUParser::NALUnit& nalu : H264NALUParser::enumerateNALUs(data, file_size)) {
+        nalu_counts[nalu.type]++;
+        const size_t nal_start = nalu.offset - nalu.startCodeLength;
+        if (au_has_vcl && H264AccessUnitAssembler::startsAccessUnit(nalu.data, nalu.size)) {
+            finish_frame(nal_start);
+            au_open = false;
+        }
+        if (!au_open) {
+            au_start = nal_start;
+            au_open = true;
+            au_has_vcl = false;
+            au_reference = false;
+            au_type = STREAM_FRAME_P;
+            au_has_metadata = false;
+        }
+
+        if (nalu.type == H264NALUParser::NAL_SEI && !au_has_metadata) {
+            au_has_metadata = H264FrameMetadataSEI::findInNAL(nalu.data, nalu.size, au_metadata);
+        }
+        else if (H264AccessUnitAssembler::isVCL(nalu.type)) {
+            if (!au_has_vcl) {
+                // The first slice decides the frame type
+                if (nalu.type == H264NALUParser::NAL_IDR_SLICE) {
+                    au_type = STREAM_FRAME_IDR;
+                }
+                else {
+                    switch (H264SliceParser::peekSliceType(nalu.data, nalu.size)) {
+                    case 1:
+                        au_type = STREAM_FRAME_B;
+                        break;
+                    case 2:
+                    case 4:
+                        au_type = STREAM_FRAME_I;
+                        break;
+                    default:
+                        au_type = STREAM_FRAME_P;
+                        break;
+                    }
+                }
+            }
+            au_has_vcl = true;
+            au_reference = au_reference || nalu.refIdc != 0;
+        }
+    }
+    if (au_open && au_has_vcl) {
+        finish_frame(file_size);
+    }
+    finish_gop();
+    double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    uint64_t nalu_total = 0;
+    for (uint64_t count : nalu_counts) {
+        nalu_total += count;
+    }
+    const double duration = use_metadata_time ? static_cast<double>(second_bytes.size()) : frame_count * frame_duration;
+    printf("File: %s, %zu bytes, scanned in %.2f s (%.1f MB/s)\n", input_filename.c_str(), file_size, scan_seconds,
+           file_size / scan_seconds / (1024 * 1024));
+    printf("%" PRIu64 " NAL units, %" PRIu64 " frames (%" PRIu64 " non-reference), %.1f s, average %.1f kbit/s\n",
+           nalu_total, frame_count, non_reference_frames, duration,
+           duration > 0 ? file_size * 8 / duration / 1000 : 0.0);
+    printf("Time base: %s\n", use_metadata_time ? "capture timestamps from frame metadata SEI" : "--fps");
+
+    printf("\nNAL unit types:\n");
+    for (int type = 0; type < 32; type++) {
+        if (nalu_counts[type] > 0) {
+            printf("  %-24s %" PRIu64 "\n", H264NALUParser::getNALUTypeStr(type), nalu_counts[type]);
+        }
+    }
+
+    printf("\nGOP structure: %" PRIu64 " GOPs", gop_count);
+    if (gop_count > 0) {
+        printf(", %.1f frames and %.1f KB on average\n", static_cast<double>(frame_count) / gop_count,
+               gop_total_bytes / 1024.0 / gop_count);
+        printf("  First GOP: %s%s\n", first_gop_pattern.c_str(), first_gop_pattern.size() >= 64 ? "..." : "");
+        printf("  Length  Count\n");
+        int rows = 0;
+        for (const auto& entry : gop_lengths) {
+            if (++rows > 20) {
+                printf("  ... %zu more lengths\n", gop_lengths.size() - 20);
+                break;
+            }
+            printf("  %6" PRIu64 "  %" PRIu64 "\n", entry.first, entry.second);
+        }
+    }
+    else {
+        printf("\n");
+    }
+
+    printf("\nFrame sizes by type:\n");
+    for (int type = 0; type < STREAM_FRAME_TYPES; type++) {
+        const TypeStats& stats = type_stats[type];
+        if (stats.count == 0) {
+            continue;
+        }
+        printf("  %-3s %" PRIu64 " frames, min %zu, avg %.0f, max %zu bytes\n", streamFrameTypeName(type), stats.count,
+               stats.minSize, static_cast<double>(stats.totalBytes) / stats.count, stats.maxSize);
+        for (int bucket = 0; bucket < kSizeBuckets; bucket++) {
+            if (stats.histogram[bucket] == 0) {
+                continue;
+            }
+            char label[32];
+            if (bucket == 0) {
+                snprintf(label, sizeof(label), "< 1 KB");
+            }
+            else if (bucket == kSizeBuckets - 1) {
+                snprintf(label, sizeof(label), ">= %d KB", 1 << (bucket - 1));
+            }
+            else {
+                snprintf(label, sizeof(label), "%d-%d KB", 1 << (bucket - 1), 1 << bucket);
+            }
+            const int bar = static_cast<int>(50 * stats.histogram[bucket] / stats.count);
+            printf("      %-14s %10" PRIu64 " %s\n", label, stats.histogram[bucket], std::string(bar, '#').c_str());
+        }
+    }
+
+    std::vector<AnalyzedFrame> top;
+    while (!largest.empty()) {
+        top.push_back(largest.top());
+        largest.pop();
+    }
+    printf("\nLargest frames:\n");
+    printf("  %10s %14s %10s  %s\n", "Frame", "Offset", "Bytes", "Type");
+    for (auto it = top.rbegin(); it != top.rend(); ++it) {
+        printf("  %10" PRIu64 " %14zu %10zu  %s\n", it->index, it->offset, it->size, streamFrameTypeName(it->type));
+    }
+
+    // The full per-second table goes to a CSV file, short recordings are also printed
+    std::ofstream csv("stream_bitrate.csv");
+    csv << "second,kbps,frames\n";
+    for (size_t second = 0; second < second_bytes.size(); second++) {
+        csv << second << "," << second_bytes[second] * 8 / 1000 << "," << second_frames[second] << "\n";
+    }
+    if (!second_bytes.empty()) {
+        auto minmax = std::minmax_element(second_bytes.begin(), second_bytes.end());
+        printf("\nBitrate per second: min %" PRIu64 ", max %" PRIu64 " kbit/s (written to stream_bitrate.csv)\n",
+               *minmax.first * 8 / 1000, *minmax.second * 8 / 1000);
+        if (second_bytes.size() <= 60) {
+            printf("  %6s %10s %7s\n", "Second", "kbit/s", "Frames");
+            for (size_t second = 0; second < second_bytes.size(); second++) {
+                printf("  %6zu %10" PRIu64 " %7u\n", second, second_bytes[second] * 8 / 1000, second_frames[second]);
+            }
+        }
+    }
+    return 0;
+}
+
 // Global flag to signal application exit
 bool app_should_quit = false;
 
@@ -513,44 +1070,79 @@ void printErrorAndQuit(const std::string& errorMessage) {
     std::exit(EXIT_FAILURE); // Force exit
 }
 
-int runH264TCPCameraCaptureTest(int argc, char* argv[], const std::string& server_ip, int port, int resolution_width, int resolution_height, int frameRate, const std::string& camera_name, int64_t bitrate) {
+// RTP over UDP instead of TCP for the sending tests
+struct UdpOptions {
+    bool enabled = false;
+    size_t mtu = 1200;
+    double simulatedLoss = 0.0;     // Fraction of datagrams dropped before sending
+    double simulatedReorder = 0.0;  // Fraction of datagrams swapped with the next one
+    RtpFecConfig fec;
+};
+
+void printSenderStats(const std::vector<CameraDataSender::Stats>& destinations) {
+    for (const CameraDataSender::Stats& stats : destinations) {
+        const std::string state = stats.connected ? "" : " (" + stats.error + ")";
+        printf("Sender -> %s%s: %" PRIu64 "/%" PRIu64 " frames sent, %" PRIu64 " bytes, queue %zu (max %zu), "
+               "dropped %" PRIu64 " non-ref / %" PRIu64 " ref / %" PRIu64 " awaiting IDR, "
+               "queue latency avg %.0f max %" PRIu64 " us, write avg %.0f us\n",
+               stats.destination.c_str(), state.c_str(),
+               stats.framesSent, stats.framesQueued, stats.bytesSent, stats.queueDepth, stats.maxQueueDepth,
+               stats.nonReferenceDropped, stats.referenceDropped, stats.awaitingIDRDropped,
+               stats.avgQueueLatencyUs, stats.maxQueueLatencyUs, stats.avgWriteTimeUs);
+    }
+}
+
+void printSenderStats(const RtpDataSender::Stats& stats) {
+    printf("RTP sender: %" PRIu64 " frames, %" PRIu64 " packets (%" PRIu64 " single, %" PRIu64 " STAP-A, %" PRIu64 " FU-A), "
+           "%" PRIu64 " bytes, %" PRIu64 " dropped, simulated %" PRIu64 " lost / %" PRIu64 " reordered\n",
+           stats.framesSent, stats.packetsSent, stats.singleNALPackets, stats.stapAPackets, stats.fuAPackets,
+           stats.bytesSent, stats.packetsDropped, stats.packetsSimulatedLost, stats.packetsSimulatedReordered);
+    if (stats.fecPackets > 0 || stats.reportsReceived > 0) {
+        printf("RTP FEC: %" PRIu64 " parity packets, %.1f%% overhead, %" PRIu64 " receiver reports, reported loss %.1f%%, "
+               "%" PRIu64 " keyframe requests\n",
+               stats.fecPackets, stats.fecOverhead * 100, stats.reportsReceived, stats.reportedLoss * 100, stats.keyframeRequests);
+    }
+}
+
+// Connect the additional receivers given with --also, each gets the stream from the next IDR frame
+void addExtraDestinations(CameraDataSender& sender, const std::vector<std::pair<std::string, int>>& destinations) {
+    for (const auto& destination : destinations) {
+        sender.addDestination(destination.first, destination.second);
+    }
+}
+
+int runH264TCPCameraCaptureTest(int argc, char* argv[], const std::string& server_ip, int port, int resolution_width, int resolution_height, int frameRate, const std::string& camera_name, int64_t bitrate, H264StreamFormat streamFormat,
+                                const std::vector<std::pair<std::string, int>>& extraDestinations, const UdpOptions& udp,
+                                const SocketOptions& socketOptions) {
 
-    CameraDataSender sender(server_ip.c_str(), port);
-    auto run = [&](CameraDataSender& sender) {
+    // Runs with either sender type
+    auto run = [&](auto& sender) {
         avdevice_register_all();
 
-        auto encoder_callback = [&sender](const uint8_t* data, size_t size) {
-            if (size == 0 || data == nullptr) {
+        auto encoder_callback = [&sender](const AVPacket* packet) {
+            if (packet->size <= 0 || packet->data == nullptr) {
                 OutputDebugStringA("Encoder callback received empty data.\n");
                 return;
             }
 
-            std::vector<uint8_t> packet(4 + size);
-
-            // Write length in big-endian format
-            packet[0] = (size >> 24) & 0xFF;
-            packet[1] = (size >> 16) & 0xFF;
-            packet[2] = (size >> 8) & 0xFF;
-            packet[3] = (size) & 0xFF;
-
-            // Copy NALU data
-            std::copy(data, data + size, packet.begin() + 4);
-
             // --- Catch SendDataException here ---
             try {
-                // Send the length-prefixed packet
-                sender.sendData(reinterpret_cast<const char*>(packet.data()), static_cast<uint32_t>(packet.size()));
+                // Queue a reference to the encoder's packet behind a big-endian length header for
+                // every destination, the sender's io thread writes it out. Destinations that start
+                // at an IDR lacking the parameter sets get them from the sender.
+                sender.sendFrame(packet);
             }
             catch (const SendDataException& e) {
                 printErrorAndQuit(e.what()); // Call the function to print error and quit
             }
             catch (const std::exception& e) { // Catch any other standard exceptions
-                printErrorAndQuit("An unexpected error occurred during sendData: " + std::string(e.what()));
+                printErrorAndQuit("An unexpected error occurred during sendFrame: " + std::string(e.what()));
             }
         };
 
         // In SIDE_BY_SIDE mode, the real width is 2 * resolution_width
-        H264Encoder h264_encoder(resolution_width * 2, resolution_height, encoder_callback, frameRate, bitrate);
+        H264Encoder h264_encoder(resolution_width * 2, resolution_height, nullptr, frameRate, bitrate, streamFormat);
+        h264_encoder.setPacketCallback(encoder_callback);
 
         // ZED Camera setup
         sl::Camera zed;
@@ -626,21 +1218,35 @@ int runH264TCPCameraCaptureTest(int argc, char* argv[], const std::string& serve
             });
 
         sl::Mat zed_image; // ZED SDK's image format
+        FrameMetadata metadata; // Sent in-band with each frame
+        auto next_stats = std::chrono::steady_clock::now() + std::chrono::seconds(5);
 
         // Main capture loop. It will also check the global app_should_quit flag.
         while (continue_capture && !app_should_quit) {
             if (zed.grab() == sl::ERROR_CODE::SUCCESS) {
                 // Retrieve image in RGBA format (compatible with OpenCV)
                 zed.retrieveImage(zed_image, sl::VIEW::SIDE_BY_SIDE, sl::MEM::CPU);
+                metadata.captureTimeUs = static_cast<int64_t>(zed.getTimestamp(sl::TIME_REFERENCE::IMAGE).getMicroseconds());
 
                 // Convert sl::Mat (RGBA) to YUV (I420/YUV420p)
                 std::vector<uint8_t> y_plane, u_plane, v_plane;
                 convertRBGAToYUV(zed_image, y_plane, u_plane, v_plane);
 
+                // The sender had to drop a reference frame, the receiver needs an IDR to recover
+                if (sender.needsKeyframe()) {
+                    h264_encoder.requestKeyframe();
+                }
+
                 // Pass YUV planes to the encoder
-                // If an exception occurs in encoder_callback (due to sendData), app_should_quit will be set.
+                // If an exception occurs in encoder_callback (due to sendFrame), app_should_quit will be set.
                 h264_encoder.encodeFrame(y_plane.data(), u_plane.data(), v_plane.data(),
-                    y_plane.size(), u_plane.size(), v_plane.size());
+                    y_plane.size(), u_plane.size(), v_plane.size(), &metadata);
+                metadata.frameId++;
+
+                if (std::chrono::steady_clock::now() >= next_stats) {
+                    printSenderStats(sender.getStats());
+                    next_stats += std::chrono::seconds(5);
+                }
             }
             else {
                 std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Avoid busy-waiting
@@ -650,22 +1256,998 @@ int runH264TCPCameraCaptureTest(int argc, char* argv[], const std::string& serve
         zed.close(); // Close the ZED camera
         input_thread.join();
         sender.disconnect();
+        printSenderStats(sender.getStats());
     };
 
-    // The startConnect callback now also uses printErrorAndQuit
-    sender.startConnect([&](CameraDataSender& s) {
-        try {
-            run(s);
+    // Capture and encode run on this thread. The TCP sender writes to its sockets on its own io
+    // thread, the RTP sender sends the datagrams of each frame right away.
+    try {
+        if (udp.enabled) {
+            RtpDataSender sender(server_ip, port, "", udp.mtu, streamFormat, udp.fec);
+            sender.setNetworkSimulation(udp.simulatedLoss, udp.simulatedReorder);
+            sender.connect();
+            run(sender);
         }
-        catch (const std::exception& e) {
-            // This catches any remaining unhandled exceptions from the 'run' lambda
-            printErrorAndQuit("Unhandled exception in run lambda: " + std::string(e.what()));
+        else {
+            CameraDataSender sender(server_ip, port, "", 8, streamFormat);
+            sender.setSocketOptions(socketOptions);
+            sender.connect();
+            addExtraDestinations(sender, extraDestinations);
+            run(sender);
         }
+    }
+    catch (const std::exception& e) {
+        // This catches any remaining unhandled exceptions from connect or the 'run' lambda
+        printErrorAndQuit("Unhandled exception in run lambda: " + std::string(e.what()));
+    }
+    return 0;
+}
+
+// Send the access units of a raw Annex-B H.264 file to the VideoPlayer at the given frame rate
+int runH264FileReplayTest(const std::string& input_filename, const std::string& server_ip, int port, int frameRate,
+                          const std::vector<std::pair<std::string, int>>& extraDestinations, const UdpOptions& udp,
+                          const SocketOptions& socketOptions) {
+    std::ifstream input_file(input_filename, std::ios::binary);
+    if (!input_file) {
+        std::cerr << "Failed to open input file: " << input_filename << std::endl;
+        return 1;
+    }
+
+    auto run = [&](auto& sender) {
+        const auto frame_interval = std::chrono::microseconds(1000000 / (frameRate > 0 ? frameRate : 30));
+        auto next_send = std::chrono::steady_clock::now();
+        uint64_t frames_sent = 0;
+
+        // The file has no framing of its own, the assembler finds the frame boundaries
+        H264AccessUnitAssembler assembler([&](const uint8_t* data, size_t size) {
+            if (app_should_quit) {
+                return;
+            }
+            std::this_thread::sleep_until(next_send);
+            next_send += frame_interval;
+            try {
+                sender.sendFrame(data, size);
+            }
+            catch (const std::exception& e) {
+                printErrorAndQuit("Failed to send frame: " + std::string(e.what()));
+            }
+            frames_sent++;
         });
-    sender.runIOContext();
+
+        std::vector<char> chunk(64 * 1024);
+        while (input_file && !app_should_quit) {
+            input_file.read(chunk.data(), chunk.size());
+            std::streamsize bytes_read = input_file.gcount();
+            if (bytes_read <= 0) {
+                break;
+            }
+            assembler.push(reinterpret_cast<const uint8_t*>(chunk.data()), static_cast<size_t>(bytes_read));
+        }
+        assembler.flush();
+
+        H264AccessUnitAssembler::Stats stats = assembler.getStats();
+        printf("Sent %" PRIu64 " frames, %" PRIu64 " bytes skipped\n", frames_sent, stats.bytesDiscarded);
+        sender.disconnect();
+        printSenderStats(sender.getStats());
+    };
+
+    try {
+        if (udp.enabled) {
+            RtpDataSender sender(server_ip, port, "", udp.mtu, H264StreamFormat::AnnexB, udp.fec);
+            sender.setNetworkSimulation(udp.simulatedLoss, udp.simulatedReorder);
+            sender.connect();
+            run(sender);
+        }
+        else {
+            CameraDataSender sender(server_ip, port);
+            sender.setSocketOptions(socketOptions);
+            sender.connect();
+            addExtraDestinations(sender, extraDestinations);
+            run(sender);
+        }
+    }
+    catch (const std::exception& e) {
+        printErrorAndQuit("Unhandled exception in run lambda: " + std::string(e.what()));
+    }
     return 0;
 }
 
+// Synthetic access units with 4-byte start codes: SPS and PPS ahead of an IDR every 30 frames,
+// then reference and non-reference frames, some of them split into two slices
+std::vector<std::vector<uint8_t>> makeSyntheticAccessUnits(int count) {
+    std::vector<std::vector<uint8_t>> accessUnits;
+    std::vector<uint8_t> ebsp;
+    auto appendNAL = [&](std::vector<uint8_t>& au, uint8_t header, size_t size) {
+        std::vector<uint8_t> payload = makeRandomPayload(size, 10);
+        payload.push_back(0x80); // rbsp_trailing_bits
+        H264RBSP::rbspToEbsp(payload.data(), payload.size(), ebsp);
+        au.insert(au.end(), {0, 0, 0, 1, header});
+        au.insert(au.end(), ebsp.begin(), ebsp.end());
+    };
+    for (int i = 0; i < count; i++) {
+        std::vector<uint8_t> au;
+        if (i % 30 == 0) {
+            appendNAL(au, 0x67, 12);
+            appendNAL(au, 0x68, 4);
+            appendNAL(au, 0x65, 20000 + rand() % 40000);
+        }
+        else {
+            const uint8_t header = (i % 2 == 0) ? 0x41 : 0x01;
+            const int slices = (i % 7 == 0) ? 2 : 1;
+            for (int slice = 0; slice < slices; slice++) {
+                // Some frames are small enough to share a packet
+                appendNAL(au, header, (i % 5 == 0) ? 50 + rand() % 300 : 2000 + rand() % 15000);
+            }
+        }
+        accessUnits.push_back(au);
+    }
+    return accessUnits;
+}
+
+// Count received access units that are not an exact copy of the next sent ones, in order
+size_t countMismatchedAccessUnits(const std::vector<std::vector<uint8_t>>& sent, const std::vector<std::vector<uint8_t>>& received) {
+    size_t mismatches = 0;
+    size_t next = 0;
+    for (const std::vector<uint8_t>& au : received) {
+        size_t match = next;
+        while (match < sent.size() && sent[match] != au) {
+            match++;
+        }
+        if (match == sent.size()) {
+            mismatches++;
+        }
+        else {
+            next = match + 1;
+        }
+    }
+    return mismatches;
+}
+
+// Access units of a raw Annex-B file with 4-byte start codes, the form reassembled access
+// units have, or synthetic ones when no file is given
+bool loadAccessUnits(const std::string& input_filename, int syntheticCount, std::vector<std::vector<uint8_t>>& accessUnits) {
+    if (!input_filename.empty()) {
+        std::ifstream input_file(input_filename, std::ios::binary);
+        if (!input_file) {
+            std::cerr << "Failed to open input file: " << input_filename << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> stream((std::istreambuf_iterator<char>(input_file)), std::istreambuf_iterator<char>());
+        H264AccessUnitAssembler assembler([&](const uint8_t* data, size_t size) {
+            std::vector<uint8_t> au;
+            for (const H264NALUParser::NALUnit& nalu : H264NALUParser::enumerateNALUs(data, size)) {
+                au.insert(au.end(), {0, 0, 0, 1});
+                au.insert(au.end(), nalu.data, nalu.data + nalu.size);
+            }
+            accessUnits.push_back(au);
+        });
+        assembler.push(stream.data(), stream.size());
+        assembler.flush();
+    }
+    else {
+        srand(2468);
+        accessUnits = makeSyntheticAccessUnits(syntheticCount);
+    }
+    if (accessUnits.empty()) {
+        std::cerr << "No access units to send" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Verify RTP packetization and reassembly under loss, reordering and duplication, first
+// in-process and then over UDP on localhost
+int runRtpLossTest(const std::string& input_filename, int port, const UdpOptions& udp) {
+    std::vector<std::vector<uint8_t>> accessUnits;
+    if (!loadAccessUnits(input_filename, 300, accessUnits)) {
+        return 1;
+    }
+
+    const double lossRates[] = {0.0, udp.simulatedLoss};
+    bool ok = true;
+    for (double lossRate : lossRates) {
+        // Packetize everything, then lose, swap and duplicate packets on the way
+        std::vector<std::vector<uint8_t>> packets;
+        H264RtpPacketizer packetizer([&](const uint8_t* packet, size_t size) {
+            packets.emplace_back(packet, packet + size);
+        }, udp.mtu);
+        for (size_t i = 0; i < accessUnits.size(); i++) {
+            packetizer.packetize(accessUnits[i].data(), accessUnits[i].size(), static_cast<uint32_t>(i * 3000));
+        }
+
+        std::vector<std::vector<uint8_t>> received;
+        H264RtpDepacketizer depacketizer([&](const uint8_t* data, size_t size) {
+            received.emplace_back(data, data + size);
+        });
+        std::mt19937 random(1357);
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (i + 1 < packets.size() && chance(random) < udp.simulatedReorder) {
+                std::swap(packets[i], packets[i + 1]);
+            }
+            now += std::chrono::microseconds(100);
+            if (chance(random) < lossRate) {
+                continue;
+            }
+            depacketizer.push(packets[i].data(), packets[i].size(), now);
+            if (chance(random) < 0.01) {
+                depacketizer.push(packets[i].data(), packets[i].size(), now);
+            }
+        }
+        depacketizer.flush();
+
+        const H264RtpDepacketizer::Stats stats = depacketizer.getStats();
+        const H264RtpPacketizer::Stats packetizerStats = packetizer.getStats();
+        const size_t mismatches = countMismatchedAccessUnits(accessUnits, received);
+        printf("In-process, %.1f%% loss: %" PRIu64 " packets (%" PRIu64 " single, %" PRIu64 " STAP-A, %" PRIu64 " FU-A), "
+               "%" PRIu64 " lost, %" PRIu64 " reordered, %" PRIu64 " duplicate; %zu/%zu access units intact, %" PRIu64 " dropped, %zu mismatched\n",
+               lossRate * 100, packetizerStats.packets, packetizerStats.singleNALPackets, packetizerStats.stapAPackets, packetizerStats.fuAPackets,
+               stats.packetsLost, stats.packetsReordered, stats.packetsDuplicate,
+               received.size(), accessUnits.size(), stats.accessUnitsDropped, mismatches);
+        ok = ok && mismatches == 0 && (lossRate > 0.0 || received.size() == accessUnits.size());
+    }
+
+    // The same over the loopback interface, with the loss simulated by the sender
+    std::mutex receivedMutex;
+    std::vector<std::vector<uint8_t>> received;
+    RtpDataReceiver receiver("127.0.0.1", port);
+    std::thread receiverThread([&]() {
+        receiver.run([&](const char* data, size_t size) {
+            std::lock_guard<std::mutex> lock(receivedMutex);
+            received.emplace_back(reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data) + size);
+        });
+    });
+
+    RtpDataSender sender("127.0.0.1", port, "", udp.mtu, H264StreamFormat::AnnexB, udp.fec);
+    sender.setNetworkSimulation(udp.simulatedLoss, udp.simulatedReorder);
+    std::vector<RtpDataReceiver::StreamStats> streamStats;
+    try {
+        sender.connect();
+        for (const std::vector<uint8_t>& au : accessUnits) {
+            sender.sendFrame(au.data(), au.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        streamStats = receiver.getStreamStats();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "RTP send failed: " << e.what() << std::endl;
+        ok = false;
+    }
+    receiver.stop();
+    receiverThread.join();
+    printSenderStats(sender.getStats());
+
+    for (const RtpDataReceiver::StreamStats& stream : streamStats) {
+        printf("UDP stream %d: %" PRIu64 " packets, %" PRIu64 " lost, %" PRIu64 " reordered, %" PRIu64 " late, "
+               "%" PRIu64 " FEC packets, %" PRIu64 " recovered, %" PRIu64 " keyframe requests\n",
+               stream.id, stream.rtp.packetsReceived, stream.rtp.packetsLost, stream.rtp.packetsReordered, stream.rtp.packetsLate,
+               stream.fec.fecPacketsReceived, stream.fec.packetsRecovered, stream.keyframeRequests);
+    }
+    const size_t mismatches = countMismatchedAccessUnits(accessUnits, received);
+    printf("Over UDP, %.1f%% loss: %zu/%zu access units intact, %zu mismatched\n",
+           udp.simulatedLoss * 100, received.size(), accessUnits.size(), mismatches);
+    ok = ok && mismatches == 0 && !received.empty();
+    return ok ? 0 : 1;
+}
+
+struct FecLinkResult {
+    uint64_t mediaPackets;
+    uint64_t mediaLost;
+    uint64_t recovered;
+    size_t accessUnitsIntact;
+    size_t mismatched;
+    double overhead;            // FEC bytes per media byte
+    double addedLatencyMean;    // ms
+    double addedLatencyP99;
+    double addedLatencyMax;
+    double encodeMicroseconds;  // Per frame
+    double decodeMicroseconds;
+    double lossEstimate;
+};
+
+// Send the access units through packetizer, FEC encoder, a lossy link and the receiving side
+// on a virtual clock: 60 fps, a 50 Mbit/s link with 2 ms delay and receiver reports every
+// 100 ms. Added latency is how much later an access unit is delivered than its bytes would
+// arrive over the idle link, so it covers both the parity on the wire and waiting for repair.
+FecLinkResult simulateFecLink(const std::vector<std::vector<uint8_t>>& accessUnits, const RtpFecConfig& config,
+                              size_t mtu, double lossRate, unsigned seed) {
+    const double frameInterval = 1e6 / 60;  // us
+    const double bytesPerMicrosecond = 50e6 / 8 / 1e6;
+    const double linkDelay = 2000;
+    const double reportInterval = 100000;
+    const auto epoch = H264RtpDepacketizer::Clock::time_point();
+    auto toTime = [&](double microseconds) { return epoch + std::chrono::microseconds(static_cast<int64_t>(microseconds)); };
+
+    FecLinkResult result = {};
+    std::vector<std::vector<uint8_t>> packets;
+    size_t packetCount = 0;
+    H264RtpPacketizer packetizer([&](const uint8_t* packet, size_t size) {
+        if (packetCount == packets.size()) {
+            packets.emplace_back();
+        }
+        packets[packetCount++].assign(packet, packet + size);
+    }, config.scheme == RtpFecScheme::None ? mtu : mtu - RtpFecEncoder::kPacketOverhead);
+    RtpFecEncoder encoder(config, packetizer.getSSRC());
+
+    double now = 0;
+    std::vector<std::pair<double, std::vector<uint8_t>>> delivered;
+    H264RtpDepacketizer depacketizer([&](const uint8_t* data, size_t size) {
+        delivered.emplace_back(now, std::vector<uint8_t>(data, data + size));
+    });
+    RtpFecDecoder decoder([&](const uint8_t* packet, size_t size) {
+        depacketizer.push(packet, size, toTime(now));
+    });
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    double linkFree = 0;
+    double nextReport = reportInterval;
+    uint64_t reportedExpected = 0, reportedReceived = 0;
+    double encodeSeconds = 0, decodeSeconds = 0;
+    std::vector<double> idleArrival(accessUnits.size());
+
+    for (size_t i = 0; i < accessUnits.size(); i++) {
+        const double frameStart = i * frameInterval;
+        idleArrival[i] = frameStart + accessUnits[i].size() / bytesPerMicrosecond + linkDelay;
+        packetCount = 0;
+        packetizer.packetize(accessUnits[i].data(), accessUnits[i].size(), static_cast<uint32_t>(i * 1500));
+
+        // Without reordering the datagrams arrive in the order they were sent
+        std::vector<std::pair<double, std::vector<uint8_t>>> arrivals;
+        auto encodeStart = std::chrono::steady_clock::now();
+        encoder.encode(packets.data(), packetCount, [&](const uint8_t* packet, size_t size) {
+            const double departure = std::max(linkFree, frameStart);
+            linkFree = departure + size / bytesPerMicrosecond;
+            const bool fec = (packet[1] & 0x7F) == config.payloadType;
+            if (!fec) {
+                result.mediaPackets++;
+            }
+            if (chance(random) < lossRate) {
+                result.mediaLost += fec ? 0 : 1;
+                return;
+            }
+            arrivals.emplace_back(linkFree + linkDelay, std::vector<uint8_t>(packet, packet + size));
+        });
+        encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+
+        for (const auto& arrival : arrivals) {
+            now = arrival.first;
+            depacketizer.expire(toTime(now));
+            const std::vector<uint8_t>& packet = arrival.second;
+            const bool fec = (packet[1] & 0x7F) == config.payloadType;
+            if (!fec) {
+                depacketizer.push(packet.data(), packet.size(), toTime(now));
+            }
+            auto decodeStart = std::chrono::steady_clock::now();
+            if (fec) {
+                decoder.pushFec(packet.data(), packet.size());
+            }
+            else {
+                decoder.pushMedia(packet.data(), packet.size());
+            }
+            decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - decodeStart).count();
+
+            if (now >= nextReport) {
+                nextReport += reportInterval;
+                const RtpFecDecoder::Stats stats = decoder.getStats();
+                const uint64_t expected = stats.mediaPacketsExpected - reportedExpected;
+                const uint64_t received = stats.mediaPacketsReceived - reportedReceived;
+                if (expected > 0) {
+                    reportedExpected = stats.mediaPacketsExpected;
+                    reportedReceived = stats.mediaPacketsReceived;
+                    RtpReceiverReport report = {};
+                    report.sourceSSRC = packetizer.getSSRC();
+                    report.fractionLost = static_cast<uint8_t>(std::min<uint64_t>((expected > received ? expected - received : 0) * 256 / expected, 255));
+                    uint8_t buffer[RtpReceiverReport::kSize];
+                    report.write(buffer);
+                    if (RtpReceiverReport::parse(buffer, sizeof(buffer), report)) {
+                        encoder.reportLoss(report.fractionLost / 256.0);
+                    }
+                }
+            }
+        }
+    }
+    now += 20000;
+    depacketizer.expire(toTime(now));
+    depacketizer.flush();
+
+    // Match the delivered access units to the sent ones in order
+    std::vector<double> added;
+    size_t next = 0;
+    for (const auto& au : delivered) {
+        size_t match = next;
+        while (match < accessUnits.size() && accessUnits[match] != au.second) {
+            match++;
+        }
+        if (match == accessUnits.size()) {
+            result.mismatched++;
+            continue;
+        }
+        added.push_back((au.first - idleArrival[match]) / 1000.0);
+        next = match + 1;
+    }
+    result.accessUnitsIntact = added.size();
+    if (!added.empty()) {
+        std::sort(added.begin(), added.end());
+        double sum = 0;
+        for (double value : added) {
+            sum += value;
+        }
+        result.addedLatencyMean = sum / added.size();
+        result.addedLatencyP99 = added[std::min(added.size() - 1, added.size() * 99 / 100)];
+        result.addedLatencyMax = added.back();
+    }
+    const RtpFecEncoder::Stats encoderStats = encoder.getStats();
+    result.recovered = decoder.getStats().packetsRecovered;
+    result.overhead = encoderStats.mediaBytes > 0 ? static_cast<double>(encoderStats.fecBytes) / encoderStats.mediaBytes : 0.0;
+    result.encodeMicroseconds = encodeSeconds * 1e6 / accessUnits.size();
+    result.decodeMicroseconds = decodeSeconds * 1e6 / accessUnits.size();
+    result.lossEstimate = encoderStats.lossEstimate;
+    return result;
+}
+
+// Verify and benchmark the GF(2^8) math, then sweep the loss rate for each FEC scheme
+int runFecBenchmark(const std::string& input_filename, const UdpOptions& udp) {
+    std::mt19937 random(97);
+    for (int i = 0; i < 10000; i++) {
+        const size_t size = random() % 300;
+        const uint8_t c = static_cast<uint8_t>(random());
+        std::vector<uint8_t> src(size), dst(size);
+        for (size_t j = 0; j < size; j++) {
+            src[j] = static_cast<uint8_t>(random());
+            dst[j] = static_cast<uint8_t>(random());
+        }
+        std::vector<uint8_t> expected = dst;
+        GF256::mulAddScalar(expected.data(), src.data(), c, size);
+        GF256::mulAdd(dst.data(), src.data(), c, size);
+        if (dst != expected) {
+            std::cerr << "GF256::mulAdd differs from the reference for size " << size << ", c " << int(c) << std::endl;
+            return 1;
+        }
+    }
+    {
+        std::vector<uint8_t> src = makeRandomPayload(1024 * 1024, 4);
+        std::vector<uint8_t> dst(src.size());
+        auto measure = [&](void (*mulAdd)(uint8_t*, const uint8_t*, uint8_t, size_t)) {
+            const int rounds = 64;
+            auto start = std::chrono::steady_clock::now();
+            for (int round = 0; round < rounds; round++) {
+                mulAdd(dst.data(), src.data(), static_cast<uint8_t>(round + 2), src.size());
+            }
+            return rounds * src.size() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+        };
+        const double scalar = measure(GF256::mulAddScalar);
+        const double simd = measure(GF256::mulAdd);
+        printf("GF(2^8) multiply-add: %.0f MB/s, reference %.0f MB/s (%.1fx)\n", simd, scalar, simd / scalar);
+    }
+
+    std::vector<std::vector<uint8_t>> accessUnits;
+    if (!loadAccessUnits(input_filename, 1200, accessUnits)) {
+        return 1;
+    }
+    printf("%zu access units, %s FEC overhead\n", accessUnits.size(),
+           udp.fec.adaptive ? "adaptive" : "fixed");
+    printf("%-6s %6s %9s %7s %10s %11s %26s %16s %9s\n", "FEC", "Loss", "Overhead", "Lost", "Recovered", "Intact AUs",
+           "Added latency mean/p99/max", "Enc/dec us/frame", "Loss est");
+
+    const RtpFecScheme schemes[] = {RtpFecScheme::None, RtpFecScheme::XOR, RtpFecScheme::ReedSolomon};
+    const char* names[] = {"none", "xor", "rs"};
+    const double lossRates[] = {0.0, 0.01, 0.02, 0.05, 0.10, 0.20};
+    bool ok = true;
+    for (int s = 0; s < 3; s++) {
+        RtpFecConfig config = udp.fec;
+        config.scheme = schemes[s];
+        for (double lossRate : lossRates) {
+            const FecLinkResult result = simulateFecLink(accessUnits, config, udp.mtu, lossRate, 4321);
+            printf("%-6s %5.1f%% %8.1f%% %7" PRIu64 " %9.1f%% %10.1f%% %10.2f/%6.2f/%6.2f ms %7.1f/%7.1f %8.1f%%\n",
+                   names[s], lossRate * 100, result.overhead * 100, result.mediaLost,
+                   result.mediaLost > 0 ? 100.0 * result.recovered / result.mediaLost : 100.0,
+                   100.0 * result.accessUnitsIntact / accessUnits.size(),
+                   result.addedLatencyMean, result.addedLatencyP99, result.addedLatencyMax,
+                   result.encodeMicroseconds, result.decodeMicroseconds, result.lossEstimate * 100);
+            if (result.mismatched > 0) {
+                std::cerr << result.mismatched << " delivered access units do not match the sent ones" << std::endl;
+                ok = false;
+            }
+            if (lossRate == 0.0 && result.accessUnitsIntact != accessUnits.size()) {
+                std::cerr << "Access units went missing without loss" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+// One load phase of the socket benchmark
+struct SocketBenchmarkPhase {
+    const char* name;
+    double load;        // Stream bitrate relative to the emulated link
+    double seconds;
+};
+
+struct SocketBenchmarkResult {
+    uint64_t framesSent[3];
+    uint64_t framesDelivered[3];
+    double latencyP50[3];
+    double latencyP99[3];
+    double latencyMax[3];
+};
+
+// Stream synthetic frames over localhost to a receiver that reads no faster than the
+// emulated link, and measure the time from sendFrame until the frame has crossed the link
+SocketBenchmarkResult runSocketBenchmarkCase(int port, const SocketOptions& options, const SocketBenchmarkPhase* phases,
+                                             double linkBytesPerSecond, int frameRate) {
+    SocketBenchmarkResult result = {};
+    const auto start = std::chrono::steady_clock::now();
+    std::mutex latencyMutex;
+    std::vector<double> latencies[3];
+    std::atomic<bool> disconnected(false);
+
+    CameraDataReceiver receiver("127.0.0.1", port, 1, options);
+    std::thread receiverThread([&]() {
+        receiver.run([&](CameraDataReceiver::StreamId, const std::string&) -> CameraDataReceiver::DataCallback {
+            return [&](const char* data, size_t size) {
+                // Hold the io thread for as long as the link would take to carry the frame
+                std::this_thread::sleep_for(std::chrono::duration<double>(size / linkBytesPerSecond));
+                uint64_t sentMicroseconds = 0;
+                for (int i = 0; i < 8; i++) {
+                    sentMicroseconds |= static_cast<uint64_t>(data[5 + i] & 0x7F) << (7 * i);
+                }
+                const int phase = data[13] & 0x7F;
+                const double now = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(latencyMutex);
+                latencies[phase].push_back((now - sentMicroseconds) / 1000.0);
+            };
+        }, [&](CameraDataReceiver::StreamId) {
+            disconnected = true;
+        });
+    });
+
+    CameraDataSender sender;
+    sender.setSocketOptions(options);
+    try {
+        sender.addDestination("127.0.0.1", port);
+
+        // IDR every second, four times the size of the other frames, which alternate
+        // between reference and non-reference
+        const auto frameInterval = std::chrono::microseconds(1000000 / frameRate);
+        auto nextFrame = std::chrono::steady_clock::now();
+        std::vector<uint8_t> frame;
+        int frameNumber = 0;
+        for (int phase = 0; phase < 3; phase++) {
+            const double averageSize = phases[phase].load * linkBytesPerSecond / frameRate;
+            const int frames = static_cast<int>(phases[phase].seconds * frameRate);
+            for (int i = 0; i < frames; i++, frameNumber++) {
+                const int position = frameNumber % frameRate;
+                const bool idr = position == 0;
+                const double scale = static_cast<double>(frameRate) / (frameRate + 3);
+                frame.assign(static_cast<size_t>(averageSize * scale * (idr ? 4 : 1)), 0xAA);
+                frame[0] = 0;
+                frame[1] = 0;
+                frame[2] = 0;
+                frame[3] = 1;
+                frame[4] = idr ? 0x65 : position % 2 ? 0x01 : 0x41;
+
+                std::this_thread::sleep_until(nextFrame);
+                nextFrame += frameInterval;
+                const uint64_t sentMicroseconds = static_cast<uint64_t>(
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                // Seven bits per byte with the top bit set, so the payload never looks like a start code
+                for (int j = 0; j < 8; j++) {
+                    frame[5 + j] = static_cast<uint8_t>(0x80 | ((sentMicroseconds >> (7 * j)) & 0x7F));
+                }
+                frame[13] = static_cast<uint8_t>(0x80 | phase);
+                sender.sendFrame(frame.data(), frame.size());
+                result.framesSent[phase]++;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Socket benchmark send failed: " << e.what() << std::endl;
+    }
+    // Give the frames still queued time to cross the link before the connection closes
+    sender.disconnect(std::chrono::milliseconds(10000));
+    for (int i = 0; i < 1000 && !disconnected; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    receiver.stop();
+    receiverThread.join();
+
+    for (int phase = 0; phase < 3; phase++) {
+        std::vector<double>& values = latencies[phase];
+        result.framesDelivered[phase] = values.size();
+        if (!values.empty()) {
+            std::sort(values.begin(), values.end());
+            result.latencyP50[phase] = values[values.size() / 2];
+            result.latencyP99[phase] = values[std::min(values.size() - 1, values.size() * 99 / 100)];
+            result.latencyMax[phase] = values.back();
+        }
+    }
+    return result;
+}
+
+// Frame latency over localhost for each socket option on its own, under a load that
+// briefly exceeds the emulated link. Options that only matter on a real network
+// interface (priority, DSCP, busy polling) are listed for completeness.
+int runSocketBenchmark(int port, const SocketOptions& commandLineOptions) {
+    const double linkBytesPerSecond = 20e6 / 8;
+    const int frameRate = 60;
+    const SocketBenchmarkPhase phases[3] = {
+        {"steady", 0.6, 2.0},
+        {"overload", 1.5, 2.0},
+        {"recovery", 0.6, 2.0},
+    };
+
+    std::vector<std::pair<std::string, SocketOptions>> configs;
+    const SocketOptions system = SocketOptions::systemDefaults();
+    configs.emplace_back("system defaults", system);
+    SocketOptions options = system;
+    options.noDelay = true;
+    configs.emplace_back("TCP_NODELAY", options);
+    options = system;
+    options.sendBufferSize = 64 * 1024;
+    configs.emplace_back("SO_SNDBUF 64K", options);
+    options = system;
+    options.receiveBufferSize = 128 * 1024;
+    configs.emplace_back("SO_RCVBUF 128K", options);
+    options = system;
+    options.notSentLowat = 16 * 1024;
+    configs.emplace_back("TCP_NOTSENT_LOWAT 16K", options);
+    options = system;
+    options.priority = 6;
+    options.dscp = 46;
+    configs.emplace_back("SO_PRIORITY 6, DSCP 46", options);
+    options = system;
+    options.busyPollMicroseconds = 50;
+    configs.emplace_back("SO_BUSY_POLL 50us", options);
+    configs.emplace_back("defaults", SocketOptions());
+    options = SocketOptions();
+    options.receiveBufferSize = 128 * 1024;
+    options.notSentLowat = 16 * 1024;
+    configs.emplace_back("+ RCVBUF 128K, LOWAT 16K", options);
+    if (commandLineOptions.toString() != SocketOptions().toString()) {
+        configs.emplace_back("command line", commandLineOptions);
+    }
+
+    printf("Link %.0f Mbit/s, %d fps; %s %.0f%% for %.0f s, %s %.0f%%, %s %.0f%%\n",
+           linkBytesPerSecond * 8 / 1e6, frameRate, phases[0].name, phases[0].load * 100, phases[0].seconds,
+           phases[1].name, phases[1].load * 100, phases[2].name, phases[2].load * 100);
+    printf("%-24s", "Options");
+    for (const SocketBenchmarkPhase& phase : phases) {
+        printf(" %27s", (std::string(phase.name) + " p50/p99/max ms, lost").c_str());
+    }
+    printf("\n");
+
+    bool ok = true;
+    for (const auto& config : configs) {
+        std::cout << "Options: " << config.second.toString() << std::endl;
+        const SocketBenchmarkResult result = runSocketBenchmarkCase(port, config.second, phases, linkBytesPerSecond, frameRate);
+        printf("%-24s", config.first.c_str());
+        for (int phase = 0; phase < 3; phase++) {
+            printf(" %6.1f/%6.1f/%6.1f %6" PRIu64, result.latencyP50[phase], result.latencyP99[phase], result.latencyMax[phase],
+                   result.framesSent[phase] - result.framesDelivered[phase]);
+        }
+        printf("\n");
+        if (result.framesDelivered[0] == 0) {
+            std::cerr << "No frames reached the receiver" << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+// Decode streamCount streams on one DecodeScheduler and check that the packets of every
+// stream are decoded one at a time and in order: first with synthetic work, whose extra
+// notifications also produce turns that find nothing to decode, then end to end with
+// encoded streams sent over TCP on localhost to a NetworkVideoSource
+int runDecodeSchedulerTest(int streamCount, int port) {
+    if (streamCount < 1) {
+        streamCount = 1;
+    }
+    bool ok = true;
+
+    struct SyntheticStream {
+        DecodeScheduler::StreamId id = -1;
+        std::mutex mutex;
+        std::deque<int> queue;
+        int expected = 0;               // Used by the stream's work only
+        std::atomic<int> running{0};
+        std::atomic<uint64_t> errors{0};
+    };
+    const int packetsPerStream = 500;
+    {
+        DecodeScheduler scheduler(2);
+        std::vector<std::unique_ptr<SyntheticStream>> streams;
+        for (int s = 0; s < streamCount; s++) {
+            streams.push_back(std::make_unique<SyntheticStream>());
+            SyntheticStream* stream = streams.back().get();
+            stream->id = scheduler.addStream([stream]() {
+                if (stream->running++ != 0) {
+                    stream->errors++;
+                }
+                int packet = -1;
+                bool more = false;
+                {
+                    std::lock_guard<std::mutex> lock(stream->mutex);
+                    if (!stream->queue.empty()) {
+                        packet = stream->queue.front();
+                        stream->queue.pop_front();
+                        more = !stream->queue.empty();
+                    }
+                }
+                DecodeScheduler::WorkResult result = DecodeScheduler::WorkResult::Idle;
+                if (packet >= 0) {
+                    if (packet != stream->expected) {
+                        stream->errors++;
+                    }
+                    stream->expected = packet + 1;
+                    std::this_thread::sleep_for(std::chrono::microseconds(50 + (packet % 7) * 20));
+                    result = more ? DecodeScheduler::WorkResult::MorePending : DecodeScheduler::WorkResult::Decoded;
+                }
+                stream->running--;
+                return result;
+            });
+        }
+
+        std::vector<std::thread> producers;
+        for (int s = 0; s < streamCount; s++) {
+            producers.emplace_back([&scheduler, stream = streams[s].get()]() {
+                for (int i = 0; i < packetsPerStream; i++) {
+                    {
+                        std::lock_guard<std::mutex> lock(stream->mutex);
+                        stream->queue.push_back(i);
+                    }
+                    scheduler.notify(stream->id);
+                    if (i % 4 == 0) {
+                        // Usually finds the queue drained
+                        std::this_thread::sleep_for(std::chrono::microseconds(300));
+                        scheduler.notify(stream->id);
+                    }
+                }
+            });
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+
+        for (int wait = 0; wait < 500; wait++) {
+            bool drained = true;
+            for (const auto& stream : streams) {
+                drained = drained && scheduler.getStreamStats(stream->id).packetsDecoded >= packetsPerStream;
+            }
+            if (drained) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        // Notifications that find an empty queue must not count as decoded packets
+        for (int s = 0; s < streamCount; s++) {
+            scheduler.notify(streams[s]->id);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        for (int s = 0; s < streamCount; s++) {
+            SyntheticStream& stream = *streams[s];
+            const DecodeScheduler::StreamStats stats = scheduler.getStreamStats(stream.id);
+            scheduler.removeStream(stream.id);
+            printf("Synthetic stream %d: %" PRIu64 "/%d packets decoded, avg %.1f us, max %" PRIu64 " us, "
+                   "%" PRIu64 " out of order or concurrent\n",
+                   s, stats.packetsDecoded, packetsPerStream, stats.avgDecodeTimeUs, stats.maxDecodeTimeUs, stream.errors.load());
+            ok = ok && stats.packetsDecoded == static_cast<uint64_t>(packetsPerStream) && stream.errors == 0 &&
+                 stream.expected == packetsPerStream;
+        }
+    }
+
+    // Every sender encodes its index into the frame IDs of the metadata SEI
+    const int width = 320;
+    const int height = 240;
+    const int framesPerStream = 90;
+    const uint64_t frameIdStride = 1000000;
+    std::vector<std::vector<std::vector<uint8_t>>> encoded(streamCount);
+    for (int s = 0; s < streamCount; s++) {
+        std::vector<uint8_t> y(width * height);
+        std::vector<uint8_t> u(width * height / 4, 128);
+        std::vector<uint8_t> v(width * height / 4, 128);
+        H264Encoder encoder(width, height, [&encoded, s](const uint8_t* data, size_t size) {
+            encoded[s].emplace_back(data, data + size);
+        }, 30, 500000);
+        for (int i = 0; i < framesPerStream; i++) {
+            for (int row = 0; row < height; row++) {
+                for (int column = 0; column < width; column++) {
+                    y[row * width + column] = static_cast<uint8_t>(column + row + i * 4 + s * 40);
+                }
+            }
+            FrameMetadata metadata;
+            metadata.frameId = s * frameIdStride + i;
+            metadata.captureTimeUs = i * 1000000LL / 30;
+            encoder.encodeFrame(y.data(), u.data(), v.data(), y.size(), u.size(), v.size(), &metadata);
+        }
+    }
+
+    struct ReceivedStream {
+        std::mutex mutex;
+        std::vector<uint64_t> frameIds;
+        uint64_t framesWithoutMetadata = 0;
+    };
+    std::vector<ReceivedStream> received(streamCount);
+    std::atomic<bool> sendFailed(false);
+    {
+        DecodeScheduler scheduler(2);
+        NetworkVideoSource source(8, H264DecoderOptions(), &scheduler);
+        // The receiver numbers the connections from 1 in the order they are accepted
+        for (int s = 0; s < streamCount; s++) {
+            ReceivedStream* stream = &received[s];
+            source.subscribe(s + 1, [stream](std::shared_ptr<const DecodedFrame> frame) {
+                std::lock_guard<std::mutex> lock(stream->mutex);
+                if (frame->hasMetadata) {
+                    stream->frameIds.push_back(frame->metadata.frameId);
+                }
+                else {
+                    stream->framesWithoutMetadata++;
+                }
+            });
+        }
+        source.start("127.0.0.1", port);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        std::vector<std::thread> senders;
+        for (int s = 0; s < streamCount; s++) {
+            senders.emplace_back([&encoded, &sendFailed, s, port]() {
+                CameraDataSender sender;
+                try {
+                    sender.addDestination("127.0.0.1", port);
+                    for (const std::vector<uint8_t>& packet : encoded[s]) {
+                        sender.sendFrame(packet.data(), packet.size());
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Sender " << s << " failed: " << e.what() << std::endl;
+                    sendFailed = true;
+                }
+                sender.disconnect(std::chrono::milliseconds(2000));
+            });
+        }
+        for (std::thread& sender : senders) {
+            sender.join();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        source.stop();
+    }
+
+    std::vector<bool> senderSeen(streamCount, false);
+    for (int s = 0; s < streamCount; s++) {
+        ReceivedStream& stream = received[s];
+        uint64_t outOfOrder = 0;
+        for (size_t i = 1; i < stream.frameIds.size(); i++) {
+            if (stream.frameIds[i] <= stream.frameIds[i - 1] ||
+                stream.frameIds[i] / frameIdStride != stream.frameIds[0] / frameIdStride) {
+                outOfOrder++;
+            }
+        }
+        const int sender = stream.frameIds.empty() ? -1 : static_cast<int>(stream.frameIds[0] / frameIdStride);
+        if (sender >= 0 && sender < streamCount) {
+            senderSeen[sender] = true;
+        }
+        printf("Stream %d (sender %d): %zu/%d frames delivered, %" PRIu64 " out of order, %" PRIu64 " without metadata\n",
+               s + 1, sender, stream.frameIds.size(), framesPerStream, outOfOrder, stream.framesWithoutMetadata);
+        ok = ok && !stream.frameIds.empty() && outOfOrder == 0 && stream.framesWithoutMetadata == 0;
+    }
+    ok = ok && !sendFailed && std::find(senderSeen.begin(), senderSeen.end(), false) == senderSeen.end();
+    printf("Decode scheduler test %s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// Check that a decoder which starts after the IDR frame that carried the parameter sets still
+// decodes the stream. The sender writes SPS/PPS only once. The receiver's only decode worker
+// is kept busy until its packet queue has overflowed and dropped that first IDR frame, so the
+// decoder resyncs on a later IDR frame without parameter sets of its own.
+int runLateJoinTest(int port) {
+    const int width = 320;
+    const int height = 240;
+    const int frameRate = 30;
+    const int frameCount = 150; // IDR frames at 0, 60 and 120
+    std::vector<std::vector<uint8_t>> packets;
+    {
+        std::vector<uint8_t> y(width * height);
+        std::vector<uint8_t> u(width * height / 4, 128);
+        std::vector<uint8_t> v(width * height / 4, 128);
+        H264Encoder encoder(width, height, [&packets](const uint8_t* data, size_t size) {
+            std::vector<uint8_t> packet;
+            for (const H264NALUParser::NALUnit& nalu : H264NALUParser::enumerateNALUs(data, size)) {
+                if (!packets.empty() && (nalu.type == H264NALUParser::NAL_SPS || nalu.type == H264NALUParser::NAL_PPS)) {
+                    continue;
+                }
+                packet.insert(packet.end(), {0, 0, 0, 1});
+                packet.insert(packet.end(), nalu.data, nalu.data + nalu.size);
+            }
+            packets.push_back(std::move(packet));
+        }, frameRate, 500000);
+        for (int i = 0; i < frameCount; i++) {
+            for (int row = 0; row < height; row++) {
+                for (int column = 0; column < width; column++) {
+                    y[row * width + column] = static_cast<uint8_t>(column + row + i * 4);
+                }
+            }
+            FrameMetadata metadata;
+            metadata.frameId = i;
+            metadata.captureTimeUs = i * 1000000LL / frameRate;
+            encoder.encodeFrame(y.data(), u.data(), v.data(), y.size(), u.size(), v.size(), &metadata);
+        }
+    }
+
+    std::mutex frameMutex;
+    std::vector<uint64_t> frameIds;
+    std::atomic<bool> released(false);
+    DecodeScheduler scheduler(1);
+    // Holds the only worker until released
+    const DecodeScheduler::StreamId blocker = scheduler.addStream([&released]() {
+        while (!released) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return DecodeScheduler::WorkResult::Decoded;
+    });
+    scheduler.notify(blocker);
+
+    bool ok = true;
+    NetworkVideoSource::Stats stats = NetworkVideoSource::Stats();
+    {
+        NetworkVideoSource source(8, H264DecoderOptions(), &scheduler);
+        source.subscribe(1, [&frameMutex, &frameIds](std::shared_ptr<const DecodedFrame> frame) {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            frameIds.push_back(frame->hasMetadata ? frame->metadata.frameId : UINT64_MAX);
+        });
+        source.start("127.0.0.1", port);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        CameraDataSender sender;
+        try {
+            sender.addDestination("127.0.0.1", port);
+            const uint64_t heldPackets = 20;
+            for (size_t i = 0; i < packets.size(); i++) {
+                if (i == heldPackets) {
+                    for (int wait = 0; wait < 200 && source.getStats(1).packetsReceived < heldPackets; wait++) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    released = true;
+                }
+                sender.sendFrame(packets[i].data(), packets[i].size());
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            stats = source.getStats(1);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Send failed: " << e.what() << std::endl;
+            ok = false;
+        }
+        released = true;
+        sender.disconnect(std::chrono::milliseconds(2000));
+        source.stop();
+    }
+    scheduler.removeStream(blocker);
+
+    uint64_t outOfOrder = 0;
+    for (size_t i = 1; i < frameIds.size(); i++) {
+        if (frameIds[i] <= frameIds[i - 1]) {
+            outOfOrder++;
+        }
+    }
+    printf("%zu packets sent, parameter sets in the first only; %" PRIu64 " received, %" PRIu64 " dropped by the receiver, "
+           "%" PRIu64 " frames decoded\n", packets.size(), stats.packetsReceived, stats.packetsDropped, stats.framesDecoded);
+    printf("%zu frames delivered, first frame ID %s, %" PRIu64 " out of order\n", frameIds.size(),
+           frameIds.empty() ? "none" : std::to_string(frameIds[0]).c_str(), outOfOrder);
+    if (stats.packetsDropped == 0) {
+        std::cerr << "The receiver dropped no packet, the first IDR frame reached the decoder" << std::endl;
+    }
+    ok = ok && stats.packetsDropped > 0 && !frameIds.empty() && frameIds[0] >= 60 && frameIds[0] != UINT64_MAX &&
+         outOfOrder == 0;
+    printf("Late join test %s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
+
 
 int analyzeDelay(int argc, char* argv[]) {
     // Specify the input log file (modify if needed)
@@ -813,8 +2395,44 @@ void printUsage(const char* programName) {
     std::cout << "  --tcp-camera c       Run complete camera capture, H.264 encoding, TCP transfer test" << std::endl;
     std::cout << "                       c: Client side" << std::endl;
     std::cout << "                       Parameters (for client): --ip <ip_address> --port <port> --camera <camera_name> --width <width> --height <height> --fps <fps> --bitrate <bitrate>" << std::endl;
+    std::cout << "                       --stream-format <annexb|avcc> (default annexb)" << std::endl;
+    std::cout << "                       --also <ip:port> Also send the stream to this receiver, may be repeated" << std::endl;
+    std::cout << "                       --udp Send RTP over UDP instead, see below" << std::endl;
     std::cout << "                       Note: The server is located in the VideoPlayer." << std::endl;
     std::cout << "  --analyze-delay      Analyze delays in video processing stages" << std::endl;
+    std::cout << "  --replay-file <file> Send a raw Annex-B H.264 file frame by frame over TCP" << std::endl;
+    std::cout << "                       Parameters: --ip <ip_address> --port <port> --fps <fps> --also <ip:port>" << std::endl;
+    std::cout << "  --decode-file <file> Decode a raw Annex-B H.264 file (save YUV file)" << std::endl;
+    std::cout << "  --analyze-stream <file> Report bitrate per second, GOP structure, frame size histograms and the" << std::endl;
+    std::cout << "                       largest frames of a raw Annex-B H.264 recording. Parameters: --fps <fps>" << std::endl;
+    std::cout << "  --bench-startcode [file] Verify and benchmark the Annex-B start code scanners" << std::endl;
+    std::cout << "                       Uses a synthetic stream when no file is given" << std::endl;
+    std::cout << "  --bench-rbsp         Verify and benchmark emulation prevention removal/insertion" << std::endl;
+    std::cout << "  --test-rtp [file]    Verify RTP packetization and reassembly under simulated loss, in-process and" << std::endl;
+    std::cout << "                       over UDP to --port on localhost. Uses a synthetic stream when no file is given" << std::endl;
+    std::cout << "  --bench-fec [file]   Verify and benchmark the GF(2^8) math, then sweep the packet loss rate for" << std::endl;
+    std::cout << "                       each FEC scheme and report recovery rate and added latency" << std::endl;
+    std::cout << "RTP options (--tcp-camera, --replay-file, --test-rtp, --bench-fec):" << std::endl;
+    std::cout << "  --udp                Send RTP over UDP, play with VideoPlayer --udp" << std::endl;
+    std::cout << "  --mtu <bytes>        Largest RTP packet (default 1200)" << std::endl;
+    std::cout << "  --sim-loss <percent> Drop this share of the datagrams before sending (default 0, 5 for --test-rtp)" << std::endl;
+    std::cout << "  --sim-reorder <percent> Swap this share of the datagrams with the next one (default 0)" << std::endl;
+    std::cout << "  --fec <none|xor|rs>  Forward error correction, XOR parity or Reed-Solomon (default none)" << std::endl;
+    std::cout << "  --fec-overhead <percent> Fixed parity overhead instead of following the receiver's loss reports" << std::endl;
+    std::cout << "  --bench-socket       Stream over localhost through an emulated 20 Mbit/s link that is briefly" << std::endl;
+    std::cout << "                       overloaded, and report frame latency for each TCP socket option" << std::endl;
+    std::cout << "  --test-scheduler     Decode --streams streams (default 4) on one shared DecodeScheduler, with" << std::endl;
+    std::cout << "                       synthetic work and then over TCP to --port on localhost, and check the order per stream" << std::endl;
+    std::cout << "  --test-join          Check over TCP to --port on localhost that a stream whose parameter sets came only" << std::endl;
+    std::cout << "                       with an IDR frame the receiver dropped still decodes from a later IDR frame" << std::endl;
+    std::cout << "TCP socket options (--tcp-camera, --replay-file, --bench-socket):" << std::endl;
+    std::cout << "  --no-nodelay         Leave Nagle's algorithm on" << std::endl;
+    std::cout << "  --sndbuf <bytes>     SO_SNDBUF, 0 for the system default (default 0)" << std::endl;
+    std::cout << "  --rcvbuf <bytes>     SO_RCVBUF, 0 for the system default (default 0)" << std::endl;
+    std::cout << "  --notsent-lowat <bytes> TCP_NOTSENT_LOWAT, 0 for no limit (default 0)" << std::endl;
+    std::cout << "  --priority <0-6>     SO_PRIORITY, Linux only (default: unset)" << std::endl;
+    std::cout << "  --dscp <0-63>        DSCP written to IP_TOS, e.g. 46 for EF (default: unset)" << std::endl;
+    std::cout << "  --busy-poll <us>     SO_BUSY_POLL, Linux only (default: off)" << std::endl;
     std::cout << "Default camera: video=Integrated Webcam" << std::endl;
     std::cout << "Default IP: 127.0.0.1" << std::endl;
     std::cout << "Default Port: 12345" << std::endl;
@@ -840,6 +2458,12 @@ int main(int argc, char* argv[]) {
     std::string ip = "127.0.0.1";
     int port = 12345;
     int64_t bitrate = 4000000; // Default bitrate 4 Mbps
+    H264StreamFormat streamFormat = H264StreamFormat::AnnexB;
+    std::vector<std::pair<std::string, int>> extraDestinations; // Receivers added with --also
+    UdpOptions udp;
+    bool simulatedLossSet = false;
+    SocketOptions socketOptions;
+    int streamCount = 4;
 
     // Parse command-line arguments for common parameters
     for (int i = 2; i < argc; ++i) {
@@ -865,6 +2489,64 @@ int main(int argc, char* argv[]) {
         else if (arg == "--bitrate" && i + 1 < argc) {
             bitrate = std::stoll(argv[++i]);
         }
+        else if (arg == "--stream-format" && i + 1 < argc) {
+            // avcc: length-prefixed NAL units, the receiver splits them without scanning for start codes
+            streamFormat = std::string(argv[++i]) == "avcc" ? H264StreamFormat::AVCC : H264StreamFormat::AnnexB;
+        }
+        else if (arg == "--udp") {
+            udp.enabled = true;
+        }
+        else if (arg == "--mtu" && i + 1 < argc) {
+            udp.mtu = static_cast<size_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--sim-loss" && i + 1 < argc) {
+            udp.simulatedLoss = std::stod(argv[++i]) / 100.0;
+            simulatedLossSet = true;
+        }
+        else if (arg == "--sim-reorder" && i + 1 < argc) {
+            udp.simulatedReorder = std::stod(argv[++i]) / 100.0;
+        }
+        else if (arg == "--fec" && i + 1 < argc) {
+            const std::string scheme = argv[++i];
+            udp.fec.scheme = scheme == "rs" ? RtpFecScheme::ReedSolomon : scheme == "xor" ? RtpFecScheme::XOR : RtpFecScheme::None;
+        }
+        else if (arg == "--fec-overhead" && i + 1 < argc) {
+            udp.fec.overhead = std::stod(argv[++i]) / 100.0;
+            udp.fec.adaptive = false;
+        }
+        else if (arg == "--no-nodelay") {
+            socketOptions.noDelay = false;
+        }
+        else if (arg == "--sndbuf" && i + 1 < argc) {
+            socketOptions.sendBufferSize = std::stoi(argv[++i]);
+        }
+        else if (arg == "--rcvbuf" && i + 1 < argc) {
+            socketOptions.receiveBufferSize = std::stoi(argv[++i]);
+        }
+        else if (arg == "--notsent-lowat" && i + 1 < argc) {
+            socketOptions.notSentLowat = std::stoi(argv[++i]);
+        }
+        else if (arg == "--priority" && i + 1 < argc) {
+            socketOptions.priority = std::stoi(argv[++i]);
+        }
+        else if (arg == "--dscp" && i + 1 < argc) {
+            socketOptions.dscp = std::stoi(argv[++i]);
+        }
+        else if (arg == "--busy-poll" && i + 1 < argc) {
+            socketOptions.busyPollMicroseconds = std::stoi(argv[++i]);
+        }
+        else if (arg == "--streams" && i + 1 < argc) {
+            streamCount = std::stoi(argv[++i]);
+        }
+        else if (arg == "--also" && i + 1 < argc) {
+            std::string destination = argv[++i];
+            size_t colon = destination.rfind(':');
+            if (colon == std::string::npos) {
+                std::cout << "Error: --also expects <ip:port>" << std::endl;
+                return 1;
+            }
+            extraDestinations.emplace_back(destination.substr(0, colon), std::stoi(destination.substr(colon + 1)));
+        }
     }
 
     if (option == "--camera-test") {
@@ -891,11 +2573,59 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         // Pass the mode argument (argv[2]) to runH264TCPCameraCaptureTest
-        return runH264TCPCameraCaptureTest(2, argv + 1, ip, port, resolution_width, resolution_height, frameRate, camera_name, bitrate);
+        return runH264TCPCameraCaptureTest(2, argv + 1, ip, port, resolution_width, resolution_height, frameRate, camera_name, bitrate, streamFormat, extraDestinations, udp, socketOptions);
     }
     else if (option == "--analyze-delay") {
         return analyzeDelay(argc - 1, argv + 1);
     }
+    else if (option == "--replay-file") {
+        if (argc < 3) {
+            std::cout << "Error: --replay-file requires <file> parameter" << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runH264FileReplayTest(argv[2], ip, port, frameRate, extraDestinations, udp, socketOptions);
+    }
+    else if (option == "--decode-file") {
+        if (argc < 3) {
+            std::cout << "Error: --decode-file requires <file> parameter" << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runH264FileDecodeTest(argv[2]);
+    }
+    else if (option == "--analyze-stream") {
+        if (argc < 3) {
+            std::cout << "Error: --analyze-stream requires <file> parameter" << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runStreamAnalysis(argv[2], frameRate);
+    }
+    else if (option == "--bench-startcode") {
+        return runStartCodeBenchmark(argc >= 3 ? argv[2] : "");
+    }
+    else if (option == "--bench-rbsp") {
+        return runRBSPBenchmark();
+    }
+    else if (option == "--bench-fec") {
+        return runFecBenchmark(argc >= 3 && argv[2][0] != '-' ? argv[2] : "", udp);
+    }
+    else if (option == "--bench-socket") {
+        return runSocketBenchmark(port, socketOptions);
+    }
+    else if (option == "--test-scheduler") {
+        return runDecodeSchedulerTest(streamCount, port);
+    }
+    else if (option == "--test-join") {
+        return runLateJoinTest(port);
+    }
+    else if (option == "--test-rtp") {
+        if (!simulatedLossSet) {
+            udp.simulatedLoss = 0.05;
+        }
+        return runRtpLossTest(argc >= 3 && argv[2][0] != '-' ? argv[2] : "", port, udp);
+    }
     else {
         std::cout << "Error: Unknown option " << option << std::endl;
         printUsage(argv[0]);
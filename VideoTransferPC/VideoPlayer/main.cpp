@@ -12,6 +12,16 @@ int main(int argc, char* argv[])
     // Default values
     QString ip = "127.0.0.1";
     int port = 12345;
+    unsigned networkThreads = 1;
+    // -1 gives every stream its own decode thread
+    int sharedDecoders = -1;
+    NetworkVideoSource::Transport transport = NetworkVideoSource::Transport::TCP;
+    // 0 follows the oldest connected sender
+    int streamId = NetworkVideoSource::kPrimaryStream;
+    SocketOptions socketOptions;
+    H264DecoderOptions decoderOptions;
+    // NV12 is uploaded by the video sink without a CPU conversion on most platforms
+    decoderOptions.outputFormat = DecodedPixelFormat::NV12;
 
     // Parse command line arguments for IP and Port
     for (int i = 1; i < argc; ++i) {
@@ -22,6 +32,56 @@ int main(int argc, char* argv[])
         else if (arg == "--port" && i + 1 < argc) {
             port = QString(argv[++i]).toInt();
         }
+        else if (arg == "--udp") {
+            // RTP over UDP: a lost packet costs frames until the next IDR instead of stalling the stream
+            transport = NetworkVideoSource::Transport::UDP;
+        }
+        else if (arg == "--network-threads" && i + 1 < argc) {
+            networkThreads = QString(argv[++i]).toUInt();
+        }
+        else if (arg == "--rcvbuf" && i + 1 < argc) {
+            socketOptions.receiveBufferSize = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--busy-poll" && i + 1 < argc) {
+            // Microseconds the io threads poll the device queue for before sleeping (Linux)
+            socketOptions.busyPollMicroseconds = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--dscp" && i + 1 < argc) {
+            socketOptions.dscp = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--stream" && i + 1 < argc) {
+            // Show the N-th sender to connect instead of the oldest connected one
+            streamId = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--shared-decoders" && i + 1 < argc) {
+            // Decode all streams on one pool of N threads, 0 for one per hardware thread
+            sharedDecoders = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--decode-threads" && i + 1 < argc) {
+            decoderOptions.threadCount = QString(argv[++i]).toInt();
+        }
+        else if (arg == "--preview" && i + 1 < argc) {
+            // Thumbnail monitoring, e.g. --preview 320x180
+            QStringList size = QString(argv[++i]).split('x');
+            decoderOptions.preview = true;
+            decoderOptions.previewSkipNonRef = true;
+            if (size.size() == 2) {
+                decoderOptions.previewWidth = size[0].toInt();
+                decoderOptions.previewHeight = size[1].toInt();
+            }
+        }
+        else if (arg == "--pixel-format" && i + 1 < argc) {
+            QString format = QString(argv[++i]).toLower();
+            if (format == "bgra") {
+                decoderOptions.outputFormat = DecodedPixelFormat::BGRA;
+            }
+            else if (format == "yuv420p") {
+                decoderOptions.outputFormat = DecodedPixelFormat::YUV420P;
+            }
+            else {
+                decoderOptions.outputFormat = DecodedPixelFormat::NV12;
+            }
+        }
     }
 
     QQmlApplicationEngine engine;
@@ -30,14 +90,18 @@ int main(int argc, char* argv[])
     VideoFrameProvider* provider = new VideoFrameProvider(&engine);
     engine.rootContext()->setContextProperty("videoFrameProvider", provider);
 
+    // Declared before the video source, which must be destroyed first
+    std::unique_ptr<DecodeScheduler> decodeScheduler;
+    if (sharedDecoders >= 0) {
+        decodeScheduler = std::make_unique<DecodeScheduler>(static_cast<unsigned>(sharedDecoders));
+    }
+
     // Create and start network video source
-    auto videoSource = std::make_unique<NetworkVideoSource>();
-    videoSource->start(ip.toStdString().c_str(), port, [provider](const char* data, int size, int width, int height) {
-        provider->presentFrame(QByteArray(data, size),
-            width,
-            height,
-            QVideoFrameFormat::Format_YUV420P);
+    auto videoSource = std::make_unique<NetworkVideoSource>(8, decoderOptions, decodeScheduler.get(), networkThreads, transport, socketOptions);
+    videoSource->subscribe(streamId, [provider](std::shared_ptr<const DecodedFrame> frame) {
+        provider->presentFrame(*frame);
         });
+    videoSource->start(ip.toStdString().c_str(), port);
 
     const QUrl url(u"qrc:/VideoPlayer/Main.qml"_qs);
     QObject::connect(
@@ -49,8 +113,9 @@ int main(int argc, char* argv[])
     engine.load(url);
 
     // No need to manually delete after using smart pointers
-    QObject::connect(&app, &QGuiApplication::aboutToQuit, [&videoSource]() {
+    QObject::connect(&app, &QGuiApplication::aboutToQuit, [&videoSource, &decodeScheduler]() {
         videoSource.reset();
+        decodeScheduler.reset();
         });
 
     return app.exec();
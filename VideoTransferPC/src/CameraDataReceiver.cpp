@@ -1,19 +1,168 @@
 //Network data receiver implementation for camera streaming using ASIO
 #include "CameraDataReceiver.h"
+#include <algorithm>
+#include <thread>
 
-CameraDataReceiver::CameraDataReceiver(const std::string& ip, int port)
-    : m_ip(ip), m_port(port), m_acceptor(m_io_context, asio::ip::tcp::endpoint(asio::ip::make_address(m_ip), m_port)), m_should_exit(false) {
+// One connected sender. Reads alternate between the 4-byte big-endian length header and
+// the payload; each step is an async_read, and the payload buffer only grows, so steady
+// state receiving allocates nothing. The socket's executor is a strand, so handlers of one
+// session never run concurrently. Pending handlers hold the session alive.
+class CameraDataReceiver::Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(CameraDataReceiver& receiver, asio::ip::tcp::socket socket, StreamId id, const std::string& peer)
+        : m_receiver(receiver), m_socket(std::move(socket)), m_id(id), m_peer(peer),
+          m_connectedTime(std::chrono::steady_clock::now()), m_packetsReceived(0), m_bytesReceived(0) {}
+
+    void start(DataCallback dataCallback) {
+        m_dataCallback = std::move(dataCallback);
+        readHeader();
+    }
+
+    // Closing the socket completes the pending read with operation_aborted. Safe to call
+    // from any thread, the socket is only touched on the session's strand.
+    void close() {
+        auto self = shared_from_this();
+        asio::post(m_socket.get_executor(), [this, self]() {
+            closeSocket();
+        });
+    }
+
+    ConnectionStats getStats() const {
+        ConnectionStats stats;
+        stats.id = m_id;
+        stats.peer = m_peer;
+        stats.packetsReceived = m_packetsReceived;
+        stats.bytesReceived = m_bytesReceived;
+        stats.connectedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_connectedTime).count();
+        return stats;
+    }
+
+private:
+    void readHeader() {
+        auto self = shared_from_this();
+        asio::async_read(m_socket, asio::buffer(m_header), [this, self](const asio::error_code& error, size_t) {
+            if (error) {
+                finish(error, "length header");
+                return;
+            }
+
+            // Reconstruct dataLength from big-endian bytes
+            uint32_t dataLength = (static_cast<uint32_t>(m_header[0]) << 24) |
+                (static_cast<uint32_t>(m_header[1]) << 16) |
+                (static_cast<uint32_t>(m_header[2]) << 8) |
+                static_cast<uint32_t>(m_header[3]);
+
+            if (dataLength == 0) {
+                // Handle empty data or keep-alive if applicable
+                std::cout << "Received 0-length packet. Continuing..." << std::endl;
+                readHeader();
+                return;
+            }
+            if (dataLength > kMaxPacketSize) {
+                std::cerr << "Packet length " << dataLength << " exceeds the limit, closing connection" << std::endl;
+                finish(asio::error_code(), nullptr);
+                return;
+            }
+            readPayload(dataLength);
+        });
+    }
+
+    void readPayload(uint32_t dataLength) {
+        // resize keeps the capacity of earlier packets
+        m_buffer.resize(dataLength);
+        auto self = shared_from_this();
+        asio::async_read(m_socket, asio::buffer(m_buffer), [this, self](const asio::error_code& error, size_t bytes_read) {
+            if (error) {
+                finish(error, "data payload");
+                return;
+            }
+            m_packetsReceived++;
+            m_bytesReceived += bytes_read;
+
+            // Callback with the received data and its actual size
+            // Note: m_dataCallback expects the actual data, not including the length prefix.
+            try {
+                if (m_dataCallback) {
+                    m_dataCallback(m_buffer.data(), bytes_read);
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Exception in data callback: " << e.what() << std::endl;
+                finish(asio::error_code(), nullptr);
+                return;
+            }
+            readHeader();
+        });
+    }
+
+    void closeSocket() {
+        asio::error_code ec;
+        m_socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+    }
+
+    void finish(const asio::error_code& error, const char* stage) {
+        if (error == asio::error::eof || error == asio::error::connection_reset) {
+            std::cout << "Client " << m_id << " (" << m_peer << ") disconnected." << std::endl;
+        }
+        else if (error && error != asio::error::operation_aborted && !m_receiver.m_should_exit) {
+            std::cerr << "Error reading " << stage << " from client " << m_id << ": " << error.message() << std::endl;
+        }
+        closeSocket();
+        m_receiver.removeSession(shared_from_this());
+        if (m_receiver.m_onDisconnected) {
+            m_receiver.m_onDisconnected(m_id);
+        }
+        std::cout << "Client handler " << m_id << " stopped." << std::endl;
+    }
+
+    CameraDataReceiver& m_receiver;
+    asio::ip::tcp::socket m_socket;
+    const StreamId m_id;
+    const std::string m_peer;
+    const std::chrono::steady_clock::time_point m_connectedTime;
+    DataCallback m_dataCallback;
+    std::array<uint8_t, 4> m_header;
+    std::vector<char> m_buffer;
+    std::atomic<uint64_t> m_packetsReceived;
+    std::atomic<uint64_t> m_bytesReceived;
+};
+
+CameraDataReceiver::CameraDataReceiver(const std::string& ip, int port, unsigned ioThreadCount,
+                                       const SocketOptions& socketOptions)
+    : m_ip(ip), m_port(port), m_ioThreadCount(ioThreadCount > 0 ? ioThreadCount : 1),
+      m_socketOptions(socketOptions), m_acceptor(asio::make_strand(m_io_context)),
+      m_should_exit(false), m_nextStreamId(1) {
+    // The steps of the acceptor's endpoint constructor, with the options set before listen()
+    const asio::ip::tcp::endpoint endpoint(asio::ip::make_address(m_ip), m_port);
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.set_option(asio::socket_base::reuse_address(true));
+    m_socketOptions.apply(m_acceptor);
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
 }
 
 void CameraDataReceiver::run(DataCallback callback) {
-    m_dataCallback = callback;
-    std::cout << "CameraDataReceiver::run() started" << std::endl;
+    run([callback](StreamId, const std::string&) { return callback; }, nullptr);
+}
+
+void CameraDataReceiver::run(ConnectHandler onConnected, DisconnectHandler onDisconnected) {
+    m_onConnected = onConnected;
+    m_onDisconnected = onDisconnected;
+    std::cout << "CameraDataReceiver::run() started with " << m_ioThreadCount << " io thread(s)" << std::endl;
 
     // Start accepting connections
     acceptConnections();
 
-    // Start IO context event loop
+    // Start IO context event loop. It returns once the acceptor and all connections are closed.
+    std::vector<std::thread> ioThreads;
+    for (unsigned i = 1; i < m_ioThreadCount; i++) {
+        ioThreads.emplace_back([this]() { m_io_context.run(); });
+    }
     m_io_context.run();
+    for (std::thread& thread : ioThreads) {
+        thread.join();
+    }
     std::cout << "CameraDataReceiver: io_context run completed" << std::endl;
 }
 
@@ -21,25 +170,39 @@ void CameraDataReceiver::stop() {
     std::cout << "CameraDataReceiver::stop() called, setting exit flag" << std::endl;
     m_should_exit = true;
 
-    try {
-        if (m_acceptor.is_open()) {
-            asio::error_code ec;
-            // First cancel all pending async operations
-            m_acceptor.cancel(ec);
-            m_acceptor.close(ec);
-            if (ec) {
-                std::cerr << "Error closing acceptor: " << ec.message() << std::endl;
-            }
-            std::cout << "CameraDataReceiver: acceptor closed" << std::endl;
+    // The acceptor and sockets are only used on their strands, close them there. The io
+    // threads leave run() when the aborted handlers have completed. If run() is not running
+    // yet, this happens as soon as it starts.
+    asio::post(m_acceptor.get_executor(), [this]() {
+        asio::error_code ec;
+        m_acceptor.cancel(ec);
+        m_acceptor.close(ec);
+        if (ec) {
+            std::cerr << "Error closing acceptor: " << ec.message() << std::endl;
         }
+        std::cout << "CameraDataReceiver: acceptor closed" << std::endl;
 
-        // Stop io_context, this will cause all unfinished async operations to be cancelled
-        m_io_context.stop();
-        std::cout << "CameraDataReceiver: io_context stopped" << std::endl;
-    }
-    catch (const std::exception& e) {
-        std::cerr << "Exception during stop: " << e.what() << std::endl;
+        std::set<std::shared_ptr<Session>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(m_sessionsMutex);
+            sessions = m_sessions;
+        }
+        for (const std::shared_ptr<Session>& session : sessions) {
+            session->close();
+        }
+    });
+}
+
+std::vector<CameraDataReceiver::ConnectionStats> CameraDataReceiver::getConnectionStats() const {
+    std::vector<ConnectionStats> stats;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionsMutex);
+        for (const std::shared_ptr<Session>& session : m_sessions) {
+            stats.push_back(session->getStats());
+        }
     }
+    std::sort(stats.begin(), stats.end(), [](const ConnectionStats& a, const ConnectionStats& b) { return a.id < b.id; });
+    return stats;
 }
 
 void CameraDataReceiver::acceptConnections() {
@@ -48,13 +211,42 @@ void CameraDataReceiver::acceptConnections() {
         return;
     }
 
-    auto socket = std::make_shared<asio::ip::tcp::socket>(m_io_context);
+    // Each accepted socket gets a strand of its own
+    m_acceptor.async_accept(asio::make_strand(m_io_context), [this](const asio::error_code& error, asio::ip::tcp::socket socket) {
+        if (!error && !m_should_exit) {
+            asio::error_code ec;
+            const asio::ip::tcp::endpoint remote = socket.remote_endpoint(ec);
+            const std::string peer = ec ? std::string("unknown") : remote.address().to_string() + ":" + std::to_string(remote.port());
+            const StreamId id = m_nextStreamId++;
+            std::cout << "Client " << id << " connected from " << peer << std::endl;
 
-    m_acceptor.async_accept(*socket, [this, socket](const asio::error_code& error) {
-        if (!error) {
-            std::cout << "Client connected" << std::endl;
-            handleClient(socket);
-        } else {
+            m_socketOptions.apply(socket);
+            DataCallback dataCallback;
+            bool accepted = true;
+            if (m_onConnected) {
+                // An exception here would leave run() and end every other connection
+                try {
+                    dataCallback = m_onConnected(id, peer);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Exception in connect handler for client " << id << ": " << e.what() << std::endl;
+                }
+                accepted = static_cast<bool>(dataCallback);
+            }
+            if (accepted) {
+                auto session = std::make_shared<Session>(*this, std::move(socket), id, peer);
+                {
+                    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                    m_sessions.insert(session);
+                }
+                session->start(std::move(dataCallback));
+            }
+            else {
+                std::cout << "Client " << id << " rejected, closing connection" << std::endl;
+                socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+                socket.close(ec);
+            }
+        } else if (error) {
                 std::cout << "Accept error: " << error.message() << std::endl;
         }
 
@@ -66,68 +258,7 @@ void CameraDataReceiver::acceptConnections() {
     });
 }
 
-void CameraDataReceiver::handleClient(std::shared_ptr<asio::ip::tcp::socket> socket) {
-    while (socket->is_open() && !m_should_exit) {
-        try {
-            // First, receive the 4-byte big-endian length header
-            std::array<uint8_t, 4> length_bytes;
-            asio::error_code error;
-
-            size_t header_bytes_read = asio::read(*socket, asio::buffer(length_bytes), error);
-
-            if (error) {
-                if (error == asio::error::eof || error == asio::error::connection_reset) {
-                    std::cout << "Client disconnected." << std::endl;
-                }
-                else {
-                    std::cerr << "Error reading length header: " << error.message() << std::endl;
-                }
-                break;
-            }
-
-            if (header_bytes_read != sizeof(length_bytes)) {
-                std::cerr << "Incomplete length header received. Expected " << sizeof(length_bytes) << " bytes, got " << header_bytes_read << std::endl;
-                break;
-            }
-
-            // Reconstruct dataLength from big-endian bytes
-            uint32_t dataLength = (static_cast<uint32_t>(length_bytes[0]) << 24) |
-                (static_cast<uint32_t>(length_bytes[1]) << 16) |
-                (static_cast<uint32_t>(length_bytes[2]) << 8) |
-                static_cast<uint32_t>(length_bytes[3]);
-
-            if (dataLength == 0) {
-                // Handle empty data or keep-alive if applicable
-                std::cout << "Received 0-length packet. Continuing..." << std::endl;
-                continue;
-            }
-
-            // Create buffer based on received length
-            std::vector<char> buffer(dataLength);
-
-            // Read the data payload of specified length
-            size_t bytes_read = asio::read(*socket, asio::buffer(buffer), error);
-
-            if (error) {
-                std::cerr << "Error reading data payload: " << error.message() << std::endl;
-                break;
-            }
-
-            if (bytes_read != dataLength) {
-                std::cerr << "Incomplete data payload received. Expected " << dataLength << " bytes, got " << bytes_read << std::endl;
-                // Depending on your protocol, you might need to handle this as a fatal error or try to recover
-                break;
-            }
-
-            // Callback with the received data and its actual size
-            // Note: m_dataCallback expects the actual data, not including the length prefix.
-            m_dataCallback(buffer.data(), bytes_read);
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Exception in handleClient: " << e.what() << std::endl;
-            break; // Exit the loop on exception
-        }
-    }
-    std::cout << "Client handler stopped." << std::endl;
-    // Socket will be automatically closed when shared_ptr is destructed
-}
\ No newline at end of file
+void CameraDataReceiver::removeSession(const std::shared_ptr<Session>& session) {
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    m_sessions.erase(session);
+}
@@ -2,32 +2,79 @@
 #ifndef CAMERATCPRECEIVER_H
 #define CAMERATCPRECEIVER_H
 
+#include "SocketOptions.h"
 #include <asio.hpp>
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <functional>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
 
+// Accepts senders and reads their length-prefixed packets with asynchronous reads, so the
+// io_context is never blocked by a connection and stop() takes effect immediately.
+// Any number of senders can be connected at once; each connection is a stream with its own
+// ID and callback. The io_context can be run on several threads, the reads of one
+// connection are serialized on a strand so its packets stay in order.
 class CameraDataReceiver {
 public:
     // Define callback function type, receive data buffer and data length
     using DataCallback = std::function<void(const char*, size_t)>;
 
-    CameraDataReceiver(const std::string& ip, int port);
+    // Connections are numbered from 1 in the order they were accepted
+    using StreamId = int;
+    // Called when a sender connects, returns the callback for the packets of that connection.
+    // An empty callback rejects the connection, which is closed without a disconnect call.
+    using ConnectHandler = std::function<DataCallback(StreamId id, const std::string& peer)>;
+    // Called once the connection is closed, after its last packet callback
+    using DisconnectHandler = std::function<void(StreamId id)>;
+
+    struct ConnectionStats {
+        StreamId id;
+        std::string peer;          // Remote address:port
+        uint64_t packetsReceived;
+        uint64_t bytesReceived;    // Payload bytes, without the length headers
+        double connectedSeconds;
+    };
+
+    // Larger length headers are treated as a corrupt stream and close the connection
+    static const uint32_t kMaxPacketSize = 64 * 1024 * 1024;
+
+    // ioThreadCount threads run the io_context, run() uses the calling thread as one of them.
+    // socketOptions are set on the listening socket and on every accepted connection.
+    CameraDataReceiver(const std::string& ip, int port, unsigned ioThreadCount = 1,
+                       const SocketOptions& socketOptions = SocketOptions());
+    // Packets of all connections go to the same callback
     void run(DataCallback callback);
+    void run(ConnectHandler onConnected, DisconnectHandler onDisconnected);
+    // Close the acceptor and all connections and make run() return. Safe to call from any thread.
     void stop();
 
+    // Open connections, oldest first
+    std::vector<ConnectionStats> getConnectionStats() const;
+
 private:
+    class Session;
+
     void acceptConnections();
-    void handleClient(std::shared_ptr<asio::ip::tcp::socket> socket);
+    void removeSession(const std::shared_ptr<Session>& session);
 
     std::string m_ip;
     int m_port;
+    unsigned m_ioThreadCount;
+    const SocketOptions m_socketOptions;
     asio::io_context m_io_context;
-    asio::ip::tcp::acceptor m_acceptor;
+    asio::ip::tcp::acceptor m_acceptor;   // Runs on its own strand
     std::atomic_bool m_should_exit;
-    DataCallback m_dataCallback;
+    ConnectHandler m_onConnected;
+    DisconnectHandler m_onDisconnected;
+    StreamId m_nextStreamId;              // Used on the acceptor strand only
+
+    mutable std::mutex m_sessionsMutex;
+    std::set<std::shared_ptr<Session>> m_sessions;
 };
 
 #endif // CAMERATCPRECEIVER_H
@@ -1,82 +1,558 @@
 //Network data sender implementation for camera streaming using ASIO
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
 #include "CameraDataSender.h"
+#include "H264NALUParser.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+namespace {
+
+uint64_t elapsedUs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+// True if the buffer holds both an SPS and a PPS
+bool hasParameterSets(const uint8_t* data, size_t size, H264StreamFormat format) {
+    bool hasSPS = false;
+    bool hasPPS = false;
+    auto check = [&](const H264NALUParser::NALUnit& nalu) {
+        hasSPS = hasSPS || nalu.type == H264NALUParser::NAL_SPS;
+        hasPPS = hasPPS || nalu.type == H264NALUParser::NAL_PPS;
+    };
+    if (format == H264StreamFormat::AVCC) {
+        for (const H264NALUParser::NALUnit& nalu : H264NALUParser::enumerateAVCCNALUs(data, size)) {
+            check(nalu);
+        }
+    }
+    else {
+        for (const H264NALUParser::NALUnit& nalu : H264NALUParser::enumerateNALUs(data, size)) {
+            check(nalu);
+        }
+    }
+    return hasSPS && hasPPS;
+}
 
-CameraDataSender::CameraDataSender(const std::string& host, int port, const std::string& bindIP)
-    : m_host(host), m_port(port), m_bindIP(bindIP), m_socket(m_ioContext) {
+} // namespace
+
+EncodedFrame::~EncodedFrame() {
+    av_buffer_unref(&payloadRef);
+}
+
+std::array<asio::const_buffer, 3> EncodedFrame::buffers() const {
+    return {asio::buffer(header), asio::buffer(prefix), asio::const_buffer(payload, payloadSize)};
 }
 
-void CameraDataSender::startConnect(std::function<void(CameraDataSender&)> runCallback) {
-    std::cout << "Starting connect to " << m_host << ":" << m_port << std::endl;
+// One receiver: its socket, send queue and drop policy state. Writes run on the sender's
+// io thread; pending handlers hold the destination alive.
+class CameraDataSender::Destination : public std::enable_shared_from_this<Destination> {
+public:
+    Destination(CameraDataSender& sender, DestinationId id, const std::string& name, asio::ip::tcp::socket socket)
+        : m_sender(sender), m_id(id), m_name(name), m_socket(std::move(socket)), m_writing(false),
+          m_awaitingIDR(true), m_failed(false), m_maxQueueDepth(0), m_framesQueued(0), m_framesSent(0),
+          m_bytesSent(0), m_nonReferenceDropped(0), m_referenceDropped(0), m_awaitingIDRDropped(0),
+          m_lastQueueLatencyUs(0), m_maxQueueLatencyUs(0), m_totalQueueLatencyUs(0), m_totalWriteTimeUs(0) {}
 
-    // Check and open socket if not already opened
-    if (!m_socket.is_open()) {
-        std::cout << "Socket is not open, opening socket with TCP v4" << std::endl;
-        try {
-            m_socket.open(asio::ip::tcp::v4());
+    // Queue the frame unless the drop policy discards it. parameterSets, if given, is queued
+    // ahead of an IDR when the destination may not have the parameter sets the IDR refers to.
+    // Returns false once the destination has failed.
+    bool enqueue(const std::shared_ptr<EncodedFrame>& frame, const std::shared_ptr<EncodedFrame>& parameterSets) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed) {
+            return false;
         }
-        catch (const std::exception& e) {
-            std::cerr << "Failed to open socket: " << e.what() << std::endl;
-            throw;
+
+        m_framesQueued++;
+        bool withParameterSets = false;
+        if (frame->kind == H264FrameKind::IDR) {
+            withParameterSets = m_awaitingIDR && parameterSets;
+            m_awaitingIDR = false;
         }
+        else if (m_awaitingIDR) {
+            m_awaitingIDRDropped++;
+            return true;
+        }
+
+        // The frame at the front is being written and cannot be dropped
+        const size_t firstDroppable = m_writing ? 1 : 0;
+        if (m_queue.size() >= m_sender.m_maxQueuedFrames) {
+            if (frame->kind == H264FrameKind::IDR) {
+                // Nothing queued is needed to decode the IDR or what follows it, except
+                // parameter sets, which are queued again from the cache
+                for (auto it = m_queue.begin() + firstDroppable; it != m_queue.end(); ++it) {
+                    if ((*it)->kind == H264FrameKind::Unknown) {
+                        withParameterSets = parameterSets != nullptr;
+                    }
+                    else if ((*it)->kind == H264FrameKind::NonReference) {
+                        m_nonReferenceDropped++;
+                    }
+                    else {
+                        m_referenceDropped++;
+                    }
+                    m_sender.recycle(*it);
+                }
+                m_queue.erase(m_queue.begin() + firstDroppable, m_queue.end());
+            }
+            else {
+                // Frames without slices (parameter sets) are never chosen here
+                auto victim = m_queue.end();
+                for (auto it = m_queue.begin() + firstDroppable; it != m_queue.end(); ++it) {
+                    if ((*it)->kind == H264FrameKind::NonReference) {
+                        victim = it;
+                        break;
+                    }
+                }
+                if (victim != m_queue.end()) {
+                    m_nonReferenceDropped++;
+                    m_sender.recycle(*victim);
+                    m_queue.erase(victim);
+                }
+                else if (frame->kind == H264FrameKind::NonReference) {
+                    m_nonReferenceDropped++;
+                    return true;
+                }
+                else {
+                    // Dropping the newest reference frame keeps the queued frames decodable,
+                    // but nothing after it is until the next IDR
+                    m_referenceDropped++;
+                    m_awaitingIDR = true;
+                    return true;
+                }
+            }
+        }
+
+        if (withParameterSets) {
+            m_queue.push_back(parameterSets);
+        }
+        m_queue.push_back(frame);
+        if (m_queue.size() > m_maxQueueDepth) {
+            m_maxQueueDepth = m_queue.size();
+        }
+        if (!m_writing) {
+            m_writing = true;
+            auto self = shared_from_this();
+            asio::post(m_socket.get_executor(), [this, self]() { startWrite(); });
+        }
+        return true;
+    }
+
+    bool awaitingIDR() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_awaitingIDR && !m_failed;
+    }
+
+    // Wait up to flushTimeout for the queue to drain, then close the socket on the io thread,
+    // which aborts a write that is still pending
+    void close(std::chrono::milliseconds flushTimeout) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_drainCond.wait_for(lock, flushTimeout, [this]() { return m_queue.empty() || m_failed; });
+            if (!m_failed) {
+                m_failed = true;
+                m_error = "Destination removed";
+            }
+        }
+        auto self = shared_from_this();
+        asio::post(m_socket.get_executor(), [this, self]() {
+            asio::error_code error;
+            m_socket.shutdown(asio::ip::tcp::socket::shutdown_both, error);
+            m_socket.close(error);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            clearQueue();
+        });
+    }
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats stats;
+        stats.id = m_id;
+        stats.destination = m_name;
+        stats.connected = !m_failed;
+        stats.error = m_error;
+        stats.queueDepth = m_queue.size();
+        stats.maxQueueDepth = m_maxQueueDepth;
+        stats.framesQueued = m_framesQueued;
+        stats.framesSent = m_framesSent;
+        stats.bytesSent = m_bytesSent;
+        stats.nonReferenceDropped = m_nonReferenceDropped;
+        stats.referenceDropped = m_referenceDropped;
+        stats.awaitingIDRDropped = m_awaitingIDRDropped;
+        stats.lastQueueLatencyUs = m_lastQueueLatencyUs;
+        stats.maxQueueLatencyUs = m_maxQueueLatencyUs;
+        // Every sent frame, plus the one being written, has had its queue latency recorded
+        const uint64_t started = m_framesSent + (m_writing && !m_queue.empty() ? 1 : 0);
+        stats.avgQueueLatencyUs = started > 0 ? static_cast<double>(m_totalQueueLatencyUs) / started : 0.0;
+        stats.avgWriteTimeUs = m_framesSent > 0 ? static_cast<double>(m_totalWriteTimeUs) / m_framesSent : 0.0;
+        return stats;
+    }
+
+private:
+    void startWrite() {
+        std::shared_ptr<EncodedFrame> frame;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.empty() || m_failed) {
+                m_writing = false;
+                m_drainCond.notify_all();
+                return;
+            }
+            frame = m_queue.front();
+            m_writeStart = std::chrono::steady_clock::now();
+            const uint64_t latencyUs = elapsedUs(frame->queuedTime, m_writeStart);
+            m_lastQueueLatencyUs = latencyUs;
+            m_totalQueueLatencyUs += latencyUs;
+            if (latencyUs > m_maxQueueLatencyUs) {
+                m_maxQueueLatencyUs = latencyUs;
+            }
+        }
+
+        // The queue keeps the frame alive until onWriteComplete pops it. async_write gathers the
+        // header, prefix and payload and continues until the socket has accepted all of them.
+        auto self = shared_from_this();
+        // The handler holds the frame as well, the buffers must outlive the write even if the
+        // queue is cleared first
+        asio::async_write(m_socket, frame->buffers(), [this, self, frame](const asio::error_code& error, size_t bytes) {
+            onWriteComplete(error, bytes);
+        });
+    }
+
+    void onWriteComplete(const asio::error_code& error, size_t bytes) {
+        bool more = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error) {
+                if (!m_failed) {
+                    m_failed = true;
+                    m_error = "Send error: " + error.message();
+                    std::cerr << "Destination " << m_name << ": " << m_error << std::endl;
+                }
+                m_writing = false;
+                clearQueue();
+                m_drainCond.notify_all();
+                return;
+            }
+
+            m_framesSent++;
+            m_bytesSent += bytes;
+            m_totalWriteTimeUs += elapsedUs(m_writeStart, std::chrono::steady_clock::now());
+
+            // close() leaves the frame being written at the front, drop it with the rest once
+            // the destination has failed
+            if (m_failed || m_queue.empty()) {
+                m_writing = false;
+                clearQueue();
+                m_drainCond.notify_all();
+                return;
+            }
+            m_sender.recycle(m_queue.front());
+            m_queue.pop_front();
+
+            more = !m_queue.empty() && !m_failed;
+            if (!more) {
+                m_writing = false;
+                m_drainCond.notify_all();
+            }
+        }
+        if (more) {
+            startWrite();
+        }
+    }
+
+    // Called with m_mutex held. The frame at the front stays while it is being written, its
+    // write handler removes it.
+    void clearQueue() {
+        const size_t firstDroppable = m_writing && !m_queue.empty() ? 1 : 0;
+        for (auto it = m_queue.begin() + firstDroppable; it != m_queue.end(); ++it) {
+            m_sender.recycle(*it);
+        }
+        m_queue.erase(m_queue.begin() + firstDroppable, m_queue.end());
+    }
+
+    CameraDataSender& m_sender;
+    const DestinationId m_id;
+    const std::string m_name;
+    asio::ip::tcp::socket m_socket;
+
+    // Everything below is guarded by m_mutex. The front of m_queue is the frame being
+    // written while m_writing is set.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_drainCond;
+    std::deque<std::shared_ptr<EncodedFrame>> m_queue;
+    bool m_writing;
+    bool m_awaitingIDR;
+    bool m_failed;
+    std::string m_error;
+    std::chrono::steady_clock::time_point m_writeStart;
+
+    size_t m_maxQueueDepth;
+    uint64_t m_framesQueued;
+    uint64_t m_framesSent;
+    uint64_t m_bytesSent;
+    uint64_t m_nonReferenceDropped;
+    uint64_t m_referenceDropped;
+    uint64_t m_awaitingIDRDropped;
+    uint64_t m_lastQueueLatencyUs;
+    uint64_t m_maxQueueLatencyUs;
+    uint64_t m_totalQueueLatencyUs;
+    uint64_t m_totalWriteTimeUs;
+};
+
+CameraDataSender::CameraDataSender(size_t maxQueuedFrames, H264StreamFormat format)
+    : m_port(0), m_maxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : 1), m_format(format),
+      m_nextDestinationId(1) {
+}
+
+CameraDataSender::CameraDataSender(const std::string& host, int port, const std::string& bindIP,
+                                   size_t maxQueuedFrames, H264StreamFormat format)
+    : m_host(host), m_port(port), m_bindIP(bindIP),
+      m_maxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : 1), m_format(format),
+      m_nextDestinationId(1) {
+}
+
+CameraDataSender::~CameraDataSender() {
+    disconnect(std::chrono::milliseconds(0));
+}
+
+void CameraDataSender::connect() {
+    addDestination(m_host, m_port, m_bindIP);
+}
+
+void CameraDataSender::setSocketOptions(const SocketOptions& options) {
+    m_socketOptions = options;
+}
+
+CameraDataSender::DestinationId CameraDataSender::addDestination(const std::string& host, int port, const std::string& bindIP) {
+    std::cout << "Connecting to " << host << ":" << port << std::endl;
+
+    asio::ip::tcp::socket socket(m_ioContext);
+    asio::error_code error;
+    socket.open(asio::ip::tcp::v4(), error);
+    if (error) {
+        throw SendDataException("Failed to open socket: " + error.message());
     }
 
     // If binding IP is specified, perform binding operation, otherwise use default network interface
-    if (!m_bindIP.empty()) {
-        try {
-            auto local_endpoint = asio::ip::tcp::endpoint(asio::ip::address::from_string(m_bindIP), 0);
-            m_socket.bind(local_endpoint);
-            std::cout << "Socket bound to " << local_endpoint.address().to_string() << std::endl;
+    if (!bindIP.empty()) {
+        asio::ip::tcp::endpoint local_endpoint(asio::ip::address::from_string(bindIP, error), 0);
+        if (!error) {
+            socket.bind(local_endpoint, error);
         }
-        catch (const std::exception& e) {
-            std::cerr << "Socket bind error: " << e.what() << std::endl;
-            throw;
+        if (error) {
+            throw SendDataException("Socket bind error: " + error.message());
         }
+        std::cout << "Socket bound to " << local_endpoint.address().to_string() << std::endl;
     }
     else {
         std::cout << "Using default network interface." << std::endl;
     }
+    m_socketOptions.apply(socket);
 
-    asio::ip::tcp::endpoint endpoint(asio::ip::address::from_string(m_host), m_port);
-    m_socket.async_connect(endpoint, [runCallback, this](std::error_code ec) {
-        if (ec) {
-            std::cout << "Connection failed: " << ec.message() << std::endl;
-        }
-        else {
-            std::cout << "Connection succeeded" << std::endl;
-        }
-        runCallback(*this);
+    asio::ip::tcp::endpoint endpoint(asio::ip::address::from_string(host, error), port);
+    if (!error) {
+        socket.connect(endpoint, error);
+    }
+    if (error) {
+        throw SendDataException("Connection to " + host + ":" + std::to_string(port) + " failed: " + error.message());
+    }
+    std::cout << "Connection succeeded" << std::endl;
+
+    // The io thread runs from the first destination until disconnect()
+    if (!m_ioThread.joinable()) {
+        m_ioContext.restart();
+        m_workGuard.reset(new asio::executor_work_guard<asio::io_context::executor_type>(m_ioContext.get_executor()));
+        m_ioThread = std::thread([this]() {
+            m_ioContext.run();
         });
+    }
+
+    std::lock_guard<std::mutex> lock(m_destinationsMutex);
+    const DestinationId id = m_nextDestinationId++;
+    m_destinations[id] = std::make_shared<Destination>(*this, id, host + ":" + std::to_string(port), std::move(socket));
+    return id;
+}
+
+void CameraDataSender::removeDestination(DestinationId id, std::chrono::milliseconds flushTimeout) {
+    std::shared_ptr<Destination> destination;
+    {
+        std::lock_guard<std::mutex> lock(m_destinationsMutex);
+        auto it = m_destinations.find(id);
+        if (it == m_destinations.end()) {
+            return;
+        }
+        destination = it->second;
+        m_destinations.erase(it);
+    }
+    destination->close(flushTimeout);
+}
+
+void CameraDataSender::sendFrame(const uint8_t* data, size_t size) {
+    queueFrame(nullptr, 0, data, size, nullptr);
+}
+
+void CameraDataSender::sendFrame(const uint8_t* prefix, size_t prefixSize, const uint8_t* data, size_t size) {
+    queueFrame(prefix, prefixSize, data, size, nullptr);
+}
+
+void CameraDataSender::sendFrame(const AVPacket* packet) {
+    queueFrame(nullptr, 0, packet->data, static_cast<size_t>(packet->size), packet->buf);
 }
 
-void CameraDataSender::sendData(const char* data, uint32_t dataLength) {
-    // Check if connection is successful
-    if (!m_socket.is_open()) {
-        // Now, we throw an exception here because the connection is not active.
+void CameraDataSender::queueFrame(const uint8_t* prefix, size_t prefixSize, const uint8_t* data, size_t size,
+                                  AVBufferRef* payloadBuffer) {
+    if (prefixSize + size > UINT32_MAX) {
+        throw SendDataException("Frame too large for the 4-byte length header");
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_destinationsMutex);
+        m_sendTargets.clear();
+        for (const auto& entry : m_destinations) {
+            m_sendTargets.push_back(entry.second);
+        }
+    }
+    if (m_sendTargets.empty()) {
         throw SendDataException("Socket is not connected. Cannot send data.");
     }
 
-    asio::error_code error;
-    size_t total_bytes_sent = 0;
+    std::shared_ptr<EncodedFrame> frame = makeFrame(prefix, prefixSize, data, size, payloadBuffer);
+    H264StreamFormat format = m_format;
+    if (format == H264StreamFormat::Auto) {
+        format = H264BitstreamConverter::detectFormat(frame->payload, frame->payloadSize);
+    }
+    frame->kind = classifyFrame(frame->payload, frame->payloadSize, format);
+    frame->queuedTime = std::chrono::steady_clock::now();
+    if (!frame->prefix.empty()) {
+        m_parameterSets.update(frame->prefix.data(), frame->prefix.size(), format);
+    }
+    m_parameterSets.update(frame->payload, frame->payloadSize, format);
 
-    // Loop until all data is sent
-    while (total_bytes_sent < dataLength) {
-        size_t bytes_sent = m_socket.send(asio::buffer(data + total_bytes_sent, dataLength - total_bytes_sent), 0, error);
-        if (error) {
-            // Throw an exception on send error
-            throw SendDataException("Send error: " + error.message());
+    // Destinations that start at this IDR, or dropped the parameter sets queued before it,
+    // get them as a packet of their own, so the IDR frame itself stays shared
+    std::shared_ptr<EncodedFrame> parameterSets;
+    if (frame->kind == H264FrameKind::IDR && !hasParameterSets(frame->prefix.data(), frame->prefix.size(), format)) {
+        if (m_parameterSets.getIDRPrefix(frame->payload, frame->payloadSize, m_parameterSetPrefix, format)) {
+            parameterSets = makeFrame(m_parameterSetPrefix.data(), m_parameterSetPrefix.size(), nullptr, 0, nullptr);
+            parameterSets->kind = H264FrameKind::Unknown;
+            parameterSets->queuedTime = frame->queuedTime;
+        }
+    }
+
+    bool sent = false;
+    for (const std::shared_ptr<Destination>& destination : m_sendTargets) {
+        sent = destination->enqueue(frame, parameterSets) || sent;
+    }
+    m_sendTargets.clear();
+    recycle(frame);
+    if (parameterSets) {
+        recycle(parameterSets);
+    }
+    if (!sent) {
+        throw SendDataException("Send error: no destination is connected");
+    }
+}
+
+std::shared_ptr<EncodedFrame> CameraDataSender::makeFrame(const uint8_t* prefix, size_t prefixSize,
+                                                          const uint8_t* data, size_t size, AVBufferRef* payloadBuffer) {
+    std::shared_ptr<EncodedFrame> frame = std::make_shared<EncodedFrame>();
+    const size_t total = prefixSize + size;
+    frame->header[0] = static_cast<uint8_t>(total >> 24);
+    frame->header[1] = static_cast<uint8_t>(total >> 16);
+    frame->header[2] = static_cast<uint8_t>(total >> 8);
+    frame->header[3] = static_cast<uint8_t>(total);
+    // Small and only ahead of IDR frames, not worth pooling
+    frame->prefix.assign(prefix, prefix + prefixSize);
+    frame->payloadSize = size;
+
+    if (payloadBuffer) {
+        frame->payloadRef = av_buffer_ref(payloadBuffer);
+    }
+    if (frame->payloadRef) {
+        frame->payload = data;
+        return frame;
+    }
+
+    // Raw data is copied once into a buffer that is reused when every destination is done with it
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        if (!m_freeBuffers.empty()) {
+            frame->payloadCopy = std::move(m_freeBuffers.back());
+            m_freeBuffers.pop_back();
         }
-        total_bytes_sent += bytes_sent;
     }
+    frame->payloadCopy.assign(data, data + size);
+    frame->payload = frame->payloadCopy.data();
+    return frame;
 }
 
+H264FrameKind CameraDataSender::classifyFrame(const uint8_t* payload, size_t size, H264StreamFormat format) const {
+    const H264NALUParser::PacketInfo info = (format == H264StreamFormat::AVCC)
+                                                ? H264NALUParser::classifyAVCCPacket(payload, size)
+                                                : H264NALUParser::classifyPacket(payload, size);
+    if (!info.hasSlice) {
+        return H264FrameKind::Unknown;
+    }
+    if (info.hasIDR) {
+        return H264FrameKind::IDR;
+    }
+    return info.isReference ? H264FrameKind::Reference : H264FrameKind::NonReference;
+}
 
-void CameraDataSender::disconnect() {
-    m_socket.close();
-    std::cout << "Client disconnected" << std::endl;
+void CameraDataSender::recycle(std::shared_ptr<EncodedFrame>& frame) {
+    // A count of 1 means no queue, write or caller holds the frame any more
+    if (frame.use_count() != 1) {
+        return;
+    }
+    // The encoder can reuse the packet buffer as soon as no frame refers to it
+    av_buffer_unref(&frame->payloadRef);
+    if (frame->payloadCopy.capacity() == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    if (m_freeBuffers.size() <= m_maxQueuedFrames) {
+        m_freeBuffers.push_back(std::move(frame->payloadCopy));
+    }
+}
+
+bool CameraDataSender::needsKeyframe() const {
+    std::lock_guard<std::mutex> lock(m_destinationsMutex);
+    for (const auto& entry : m_destinations) {
+        if (entry.second->awaitingIDR()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<CameraDataSender::Stats> CameraDataSender::getStats() const {
+    std::vector<Stats> stats;
+    std::lock_guard<std::mutex> lock(m_destinationsMutex);
+    for (const auto& entry : m_destinations) {
+        stats.push_back(entry.second->getStats());
+    }
+    return stats;
 }
 
-void CameraDataSender::runIOContext() {
-    std::cout << "Starting io_context.run()" << std::endl;
-    m_ioContext.run();
-    std::cout << "io_context.run() completed" << std::endl;
-}
\ No newline at end of file
+void CameraDataSender::disconnect(std::chrono::milliseconds flushTimeout) {
+    // Without the io thread every destination is already closed
+    if (!m_ioThread.joinable()) {
+        return;
+    }
+
+    // Removed like removeDestination() does, so a later connect() starts without them
+    std::map<DestinationId, std::shared_ptr<Destination>> destinations;
+    {
+        std::lock_guard<std::mutex> lock(m_destinationsMutex);
+        destinations.swap(m_destinations);
+    }
+    for (const auto& entry : destinations) {
+        entry.second->close(flushTimeout);
+    }
+
+    // run() returns once the posted closes and the writes they abort have completed
+    m_workGuard.reset();
+    m_ioThread.join();
+    std::cout << "Client disconnected" << std::endl;
+}
@@ -2,9 +2,21 @@
 #ifndef CAMERATCPSENDER_H
 #define CAMERATCPSENDER_H
 
+#include "H264BitstreamConverter.h"
+#include "H264ParameterSets.h"
+#include "H264SliceHeader.h"
+#include "SocketOptions.h"
 #include <asio.hpp>
+#include <array>
 #include <iostream>
 #include <functional>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 class SendDataException : public std::runtime_error {
 public:
@@ -12,20 +24,134 @@ public:
         : std::runtime_error(message) {}
 };
 
+// Forward declarations of required FFmpeg structures
+struct AVBufferRef;
+struct AVPacket;
+
+// One encoded frame ready for the wire: the 4-byte big-endian length header expected by
+// CameraDataReceiver, an optional prefix and the payload, written as one buffer sequence.
+// The payload references the encoder's refcounted packet buffer when there is one and is
+// copied into a pooled buffer otherwise. Frames are shared, not copied, between the queues
+// of all destinations and the writes in progress.
+struct EncodedFrame {
+    EncodedFrame() = default;
+    ~EncodedFrame();
+    EncodedFrame(const EncodedFrame&) = delete;
+    EncodedFrame& operator=(const EncodedFrame&) = delete;
+
+    // Header, prefix and payload
+    std::array<asio::const_buffer, 3> buffers() const;
+
+    uint8_t header[4] = {0, 0, 0, 0};
+    std::vector<uint8_t> prefix;
+    AVBufferRef* payloadRef = nullptr;  // Keeps a refcounted payload alive
+    std::vector<uint8_t> payloadCopy;   // Holds the payload when it was not refcounted
+    const uint8_t* payload = nullptr;
+    size_t payloadSize = 0;
+    H264FrameKind kind = H264FrameKind::Unknown;
+    std::chrono::steady_clock::time_point queuedTime;
+};
+
+// Sends length-prefixed H264 frames to one or more receivers on a dedicated io thread.
+// sendFrame takes a reference to an encoder packet, or copies raw data once into a pooled
+// buffer, and queues the frame for every destination, so the capture/encode thread never
+// blocks on a socket, and a slow destination only fills its own queue.
+// When a destination's queue is full, its queued non-reference frames are dropped first;
+// once a reference frame has to go, every frame up to the next IDR is dropped as well,
+// since the receiver could not decode them anyway. A destination that joins a running
+// stream also starts at the next IDR, preceded by the parameter sets if the IDR lacks them.
 class CameraDataSender {
 public:
-    CameraDataSender(const std::string& host, int port, const std::string& bindIP = "");
-    void startConnect(std::function<void(CameraDataSender&)> runCallback);
-    void sendData(const char* data, uint32_t dataLength);
-    void disconnect();
-    void runIOContext();
+    using DestinationId = int;
+
+    struct Stats {
+        DestinationId id;
+        std::string destination;      // host:port
+        bool connected;               // False once a send has failed or the destination was removed
+        std::string error;
+        size_t queueDepth;            // Frames waiting for the socket, including the one being written
+        size_t maxQueueDepth;         // High-water mark of the queue
+        uint64_t framesQueued;
+        uint64_t framesSent;
+        uint64_t bytesSent;
+        uint64_t nonReferenceDropped; // Non-reference frames dropped to make room
+        uint64_t referenceDropped;    // Reference frames dropped to make room, or superseded by a queued IDR
+        uint64_t awaitingIDRDropped;  // Frames dropped while waiting for an IDR
+        uint64_t lastQueueLatencyUs;  // Time from sendFrame until the frame's write started
+        uint64_t maxQueueLatencyUs;
+        double avgQueueLatencyUs;
+        double avgWriteTimeUs;        // Time the socket took to accept a frame
+    };
+
+    // maxQueuedFrames bounds the queue of each destination. format tells how to find the
+    // frame type and parameter sets of the packets passed to sendFrame.
+    explicit CameraDataSender(size_t maxQueuedFrames = 8, H264StreamFormat format = H264StreamFormat::Auto);
+    // Single destination, connected by connect()
+    CameraDataSender(const std::string& host, int port, const std::string& bindIP = "",
+                     size_t maxQueuedFrames = 8, H264StreamFormat format = H264StreamFormat::Auto);
+    ~CameraDataSender();
+
+    // Options for the sockets of destinations added from now on
+    void setSocketOptions(const SocketOptions& options);
+
+    // Connect to the destination given to the constructor. Throws SendDataException on failure.
+    void connect();
+    // Connect to another receiver, which gets the stream from the next IDR frame on.
+    // Throws SendDataException on failure.
+    DestinationId addDestination(const std::string& host, int port, const std::string& bindIP = "");
+    // Give the destination's queued frames up to flushTimeout to reach the socket, then close it
+    void removeDestination(DestinationId id, std::chrono::milliseconds flushTimeout = std::chrono::milliseconds(1000));
+
+    // Queue a frame with the 4-byte big-endian length header for every connected destination.
+    // Call from one thread. Throws SendDataException when no destination is connected.
+    void sendFrame(const uint8_t* data, size_t size);
+    // Same, with prefix placed between the header and the payload, e.g. parameter sets ahead of an IDR frame
+    void sendFrame(const uint8_t* prefix, size_t prefixSize, const uint8_t* data, size_t size);
+    // Same for an encoder packet, whose payload is queued by reference instead of copied
+    // when the packet is refcounted
+    void sendFrame(const AVPacket* packet);
+    // True while a destination drops frames until the next IDR, the encoder should be asked for one
+    bool needsKeyframe() const;
+    // One entry per destination, including failed ones, in the order they were added
+    std::vector<Stats> getStats() const;
+    // Remove all destinations and stop the io thread
+    void disconnect(std::chrono::milliseconds flushTimeout = std::chrono::milliseconds(1000));
 
 private:
+    class Destination;
+
+    void queueFrame(const uint8_t* prefix, size_t prefixSize, const uint8_t* data, size_t size,
+                    AVBufferRef* payloadBuffer);
+    // Reference data in payloadBuffer if given, copy it otherwise
+    std::shared_ptr<EncodedFrame> makeFrame(const uint8_t* prefix, size_t prefixSize,
+                                            const uint8_t* data, size_t size, AVBufferRef* payloadBuffer);
+    H264FrameKind classifyFrame(const uint8_t* payload, size_t size, H264StreamFormat format) const;
+    // Release the frame's payload reference and return its buffers to the pool if nothing
+    // else refers to the frame
+    void recycle(std::shared_ptr<EncodedFrame>& frame);
+
     std::string m_host;
     int m_port;
     std::string m_bindIP;
+    const size_t m_maxQueuedFrames;
+    const H264StreamFormat m_format;
+    SocketOptions m_socketOptions;
+
     asio::io_context m_ioContext;
-    asio::ip::tcp::socket m_socket;
+    std::unique_ptr<asio::executor_work_guard<asio::io_context::executor_type>> m_workGuard;
+    std::thread m_ioThread;
+
+    mutable std::mutex m_destinationsMutex;
+    std::map<DestinationId, std::shared_ptr<Destination>> m_destinations;
+    DestinationId m_nextDestinationId;
+
+    // Used by sendFrame only
+    ParameterSetCache m_parameterSets;
+    std::vector<std::shared_ptr<Destination>> m_sendTargets;
+    std::vector<uint8_t> m_parameterSetPrefix;
+
+    std::mutex m_poolMutex;
+    std::vector<std::vector<uint8_t>> m_freeBuffers;
 };
 
 #endif // CAMERATCPSENDER_H
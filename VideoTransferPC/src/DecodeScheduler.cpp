@@ -0,0 +1,148 @@
+//Decode scheduler implementation, fair per-stream scheduling on a fixed worker pool
+#include "DecodeScheduler.h"
+#include <chrono>
+#include <iostream>
+
+DecodeScheduler::DecodeScheduler(unsigned workerCount)
+    : m_nextStreamId(0), m_stopping(false) {
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+    }
+    if (workerCount == 0) {
+        workerCount = 1;
+    }
+
+    std::cout << "DecodeScheduler: starting " << workerCount << " workers" << std::endl;
+    for (unsigned i = 0; i < workerCount; i++) {
+        m_workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+DecodeScheduler::~DecodeScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workCond.notify_all();
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    std::cout << "DecodeScheduler: workers stopped" << std::endl;
+}
+
+DecodeScheduler::StreamId DecodeScheduler::addStream(StreamWork work) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    StreamId id = m_nextStreamId++;
+    auto stream = std::make_shared<Stream>();
+    stream->work = std::move(work);
+    m_streams[id] = stream;
+    return id;
+}
+
+void DecodeScheduler::removeStream(StreamId id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) {
+        return;
+    }
+
+    std::shared_ptr<Stream> stream = it->second;
+    stream->removed = true;
+    m_idleCond.wait(lock, [&stream]() { return !stream->running; });
+    // Stale entries in the ready queue are skipped by the workers
+    m_streams.erase(id);
+}
+
+void DecodeScheduler::notify(StreamId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) {
+        return;
+    }
+
+    Stream& stream = *it->second;
+    if (stream.running) {
+        // The worker requeues the stream when its current turn ends
+        stream.pending = true;
+    }
+    else if (!stream.queued) {
+        stream.queued = true;
+        m_ready.push_back(id);
+        m_workCond.notify_one();
+    }
+}
+
+DecodeScheduler::StreamStats DecodeScheduler::getStreamStats(StreamId id) const {
+    StreamStats stats = {0, 0, 0, 0.0};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(id);
+    if (it != m_streams.end()) {
+        const Stream& stream = *it->second;
+        stats.packetsDecoded = stream.packetsDecoded;
+        stats.totalDecodeTimeUs = stream.totalDecodeTimeUs;
+        stats.maxDecodeTimeUs = stream.maxDecodeTimeUs;
+        stats.avgDecodeTimeUs = stream.packetsDecoded > 0
+            ? static_cast<double>(stream.totalDecodeTimeUs) / stream.packetsDecoded : 0.0;
+    }
+    return stats;
+}
+
+unsigned DecodeScheduler::workerCount() const {
+    return static_cast<unsigned>(m_workers.size());
+}
+
+void DecodeScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workCond.wait(lock, [this]() { return m_stopping || !m_ready.empty(); });
+        if (m_stopping) {
+            break;
+        }
+
+        StreamId id = m_ready.front();
+        m_ready.pop_front();
+        auto it = m_streams.find(id);
+        if (it == m_streams.end() || it->second->removed) {
+            continue;
+        }
+
+        std::shared_ptr<Stream> stream = it->second;
+        stream->queued = false;
+        stream->running = true;
+        stream->pending = false;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        WorkResult result = WorkResult::Idle;
+        try {
+            result = stream->work();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "DecodeScheduler: exception in stream " << id << ": " << e.what() << std::endl;
+        }
+        uint64_t elapsedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        lock.lock();
+        stream->running = false;
+        if (result != WorkResult::Idle) {
+            stream->packetsDecoded++;
+            stream->totalDecodeTimeUs += elapsedUs;
+            if (elapsedUs > stream->maxDecodeTimeUs) {
+                stream->maxDecodeTimeUs = elapsedUs;
+            }
+        }
+
+        if (stream->removed) {
+            m_idleCond.notify_all();
+        }
+        else if (result == WorkResult::MorePending || stream->pending) {
+            // Back of the queue, so other ready streams get their turn first
+            stream->queued = true;
+            m_ready.push_back(id);
+            m_workCond.notify_one();
+        }
+    }
+}
@@ -0,0 +1,81 @@
+//Decode scheduler class for running the decoders of many video streams on a shared thread pool
+#ifndef DECODESCHEDULER_H
+#define DECODESCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Runs the decode work of N streams on a fixed pool of worker threads.
+// A stream is never processed by two workers at once, so its packets keep their order.
+// Each turn decodes a single packet and the stream is then requeued at the back,
+// which shares the workers round-robin between busy streams.
+class DecodeScheduler {
+public:
+    using StreamId = int;
+
+    // Outcome of one turn of a stream's work
+    enum class WorkResult {
+        Idle,           // Nothing was queued, the turn is left out of the statistics
+        Decoded,        // Decoded a packet and none is left
+        MorePending     // Decoded a packet and more are queued
+    };
+
+    // Decodes at most one queued packet of the stream
+    using StreamWork = std::function<WorkResult()>;
+
+    // Counts and times only the turns that decoded a packet
+    struct StreamStats {
+        uint64_t packetsDecoded;
+        uint64_t totalDecodeTimeUs;
+        uint64_t maxDecodeTimeUs;
+        double avgDecodeTimeUs;
+    };
+
+    // workerCount 0 sizes the pool to the number of hardware threads
+    explicit DecodeScheduler(unsigned workerCount = 0);
+    ~DecodeScheduler();
+
+    DecodeScheduler(const DecodeScheduler&) = delete;
+    DecodeScheduler& operator=(const DecodeScheduler&) = delete;
+
+    StreamId addStream(StreamWork work);
+    // Blocks until the stream's running work, if any, has finished
+    void removeStream(StreamId id);
+    // Signal that the stream has packets to decode
+    void notify(StreamId id);
+
+    StreamStats getStreamStats(StreamId id) const;
+    unsigned workerCount() const;
+
+private:
+    struct Stream {
+        StreamWork work;
+        bool queued = false;   // In the ready queue
+        bool running = false;  // Being processed by a worker
+        bool pending = false;  // Notified while running
+        bool removed = false;
+        uint64_t packetsDecoded = 0;
+        uint64_t totalDecodeTimeUs = 0;
+        uint64_t maxDecodeTimeUs = 0;
+    };
+
+    void workerLoop();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workCond;
+    std::condition_variable m_idleCond;
+    std::unordered_map<StreamId, std::shared_ptr<Stream>> m_streams;
+    std::deque<StreamId> m_ready;
+    std::vector<std::thread> m_workers;
+    StreamId m_nextStreamId;
+    bool m_stopping;
+};
+
+#endif // DECODESCHEDULER_H
@@ -0,0 +1,170 @@
+// H264 access unit assembler implementation
+#include "H264AccessUnitAssembler.h"
+#include "H264NALUParser.h"
+#include <algorithm>
+#include <cstring>
+
+H264AccessUnitAssembler::H264AccessUnitAssembler(AccessUnitCallback callback,
+                                                 size_t maxAccessUnitSize)
+    : m_callback(std::move(callback)),
+      m_maxAccessUnitSize(maxAccessUnitSize), m_stats() {
+  reset();
+}
+
+void H264AccessUnitAssembler::reset() {
+  m_size = 0;
+  m_auStart = 0;
+  m_scanPos = 0;
+  m_nalStart = 0;
+  m_nalHeader = 0;
+  m_synced = false;
+  m_headerPending = false;
+  m_hasVCL = false;
+  m_oversized = false;
+}
+
+void H264AccessUnitAssembler::push(const uint8_t *data, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  // The buffer only ever grows, so steady-state pushes do not allocate
+  if (m_size + size > m_buffer.size()) {
+    m_buffer.resize(std::max(m_size + size, m_buffer.size() * 2));
+  }
+  memcpy(m_buffer.data() + m_size, data, size);
+  m_size += size;
+
+  const uint8_t *buffer = m_buffer.data();
+  const uint8_t *end = buffer + m_size;
+  while (true) {
+    if (m_headerPending) {
+      if (!classifyNAL()) {
+        break;
+      }
+      m_headerPending = false;
+    }
+
+    const uint8_t *start_code =
+        H264NALUParser::findStartCode(buffer + m_scanPos, end);
+    if (start_code == end) {
+      // A start code may straddle the next chunk, so rescan the last 3 bytes
+      const size_t rescan = m_size >= 3 ? m_size - 3 : 0;
+      if (!m_synced) {
+        m_stats.bytesDiscarded += rescan - m_auStart;
+        m_auStart = rescan;
+      }
+      m_scanPos = std::max(rescan, m_synced ? m_nalHeader : m_auStart);
+      break;
+    }
+
+    const size_t start = start_code - buffer;
+    if (!m_synced) {
+      m_stats.bytesDiscarded += start - m_auStart;
+      m_auStart = start;
+      m_synced = true;
+    }
+    m_nalStart = start;
+    m_nalHeader = start + (start_code[2] == 1 ? 3 : 4);
+    m_scanPos = m_nalHeader;
+    m_headerPending = true;
+  }
+
+  if (m_size - m_auStart > m_maxAccessUnitSize) {
+    // Release what has been scanned so far, the rest of the access unit is
+    // dropped when it completes. A pending NAL header may start the next one.
+    const size_t drop_to = m_headerPending ? m_nalStart : m_scanPos;
+    m_stats.bytesDiscarded += drop_to - m_auStart;
+    m_auStart = drop_to;
+    m_oversized = true;
+  }
+  compact();
+}
+
+void H264AccessUnitAssembler::flush() {
+  if (m_synced) {
+    emit(m_size);
+  } else {
+    m_stats.bytesDiscarded += m_size - m_auStart;
+  }
+  reset();
+}
+
+bool H264AccessUnitAssembler::isVCL(int nalType) {
+  return nalType >= H264NALUParser::NAL_SLICE &&
+         nalType <= H264NALUParser::NAL_IDR_SLICE;
+}
+
+bool H264AccessUnitAssembler::startsAccessUnit(const uint8_t *nal,
+                                               size_t size) {
+  if (size == 0) {
+    return false;
+  }
+  switch (nal[0] & 0x1F) {
+  case H264NALUParser::NAL_SLICE:
+  case H264NALUParser::NAL_DPA:
+  case H264NALUParser::NAL_IDR_SLICE:
+    // first_mb_in_slice is the first ue(v) of the header, a leading 1 bit means 0
+    return size >= 2 && (nal[1] & 0x80) != 0;
+  case H264NALUParser::NAL_SEI:
+  case H264NALUParser::NAL_SPS:
+  case H264NALUParser::NAL_PPS:
+  case H264NALUParser::NAL_AUD:
+  case H264NALUParser::NAL_PREFIX:
+  case H264NALUParser::NAL_SUB_SPS:
+  case 16:
+  case 17:
+  case 18:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool H264AccessUnitAssembler::classifyNAL() {
+  if (m_nalHeader >= m_size) {
+    return false;
+  }
+  const uint8_t *nal = m_buffer.data() + m_nalHeader;
+  const size_t available = m_size - m_nalHeader;
+  const int type = nal[0] & 0x1F;
+  if (available < 2 && (type == H264NALUParser::NAL_SLICE ||
+                        type == H264NALUParser::NAL_DPA ||
+                        type == H264NALUParser::NAL_IDR_SLICE)) {
+    return false;
+  }
+
+  if (m_hasVCL && startsAccessUnit(nal, available)) {
+    emit(m_nalStart);
+  }
+  if (isVCL(type)) {
+    m_hasVCL = true;
+  }
+  return true;
+}
+
+void H264AccessUnitAssembler::emit(size_t end) {
+  if (end > m_auStart) {
+    if (m_oversized || end - m_auStart > m_maxAccessUnitSize) {
+      m_stats.bytesDiscarded += end - m_auStart;
+      m_oversized = false;
+    } else {
+      m_stats.accessUnits++;
+      m_callback(m_buffer.data() + m_auStart, end - m_auStart);
+    }
+  }
+  m_auStart = end;
+  m_hasVCL = false;
+}
+
+void H264AccessUnitAssembler::compact() {
+  if (m_auStart == 0) {
+    return;
+  }
+  // Only the unfinished access unit is kept, so this moves at most one frame
+  memmove(m_buffer.data(), m_buffer.data() + m_auStart, m_size - m_auStart);
+  m_size -= m_auStart;
+  m_scanPos -= m_auStart;
+  m_nalStart = m_nalStart >= m_auStart ? m_nalStart - m_auStart : 0;
+  m_nalHeader = m_nalHeader >= m_auStart ? m_nalHeader - m_auStart : 0;
+  m_auStart = 0;
+}
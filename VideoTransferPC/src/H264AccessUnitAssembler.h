@@ -0,0 +1,70 @@
+// H264 access unit assembler for splitting raw Annex-B byte streams into frames
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Incremental splitter for Annex-B byte streams that carry no framing of their
+// own, such as .h264 files or third-party stream ingest. Chunks of any size go
+// in and complete access units come out, each with its start codes.
+//
+// A new access unit begins at the first AUD, SPS, PPS, SEI (or NAL type 14-18)
+// after a coded slice, or at a slice with first_mb_in_slice == 0 (7.4.1.2.3).
+// An access unit is emitted once the first NAL header of the next one arrives,
+// or on flush(). The bytes are assembled in one internal buffer that is reused,
+// so after warm-up no memory is allocated per access unit.
+class H264AccessUnitAssembler {
+public:
+  // data points into the internal buffer and is only valid during the call
+  using AccessUnitCallback = std::function<void(const uint8_t *data, size_t size)>;
+
+  struct Stats {
+    uint64_t accessUnits;    // Access units emitted
+    uint64_t bytesDiscarded; // Bytes before the first start code or in oversized access units
+  };
+
+  // Access units larger than maxAccessUnitSize are dropped, which bounds the
+  // buffer when the input is not H.264
+  explicit H264AccessUnitAssembler(AccessUnitCallback callback,
+                                   size_t maxAccessUnitSize = 8 * 1024 * 1024);
+
+  // Append a chunk of the byte stream
+  void push(const uint8_t *data, size_t size);
+
+  // Emit the access unit in progress, call at the end of the stream
+  void flush();
+
+  // Drop all buffered data, e.g. before switching to another stream
+  void reset();
+
+  Stats getStats() const { return m_stats; }
+
+  // Boundary rules, for callers that walk NAL units themselves.
+  // A NAL unit that starts an access unit only does so after a coded slice.
+  static bool isVCL(int nalType);
+  // nal starts at the NAL header byte. Slices need 2 bytes to be classified.
+  static bool startsAccessUnit(const uint8_t *nal, size_t size);
+
+private:
+  // Classify the NAL unit whose header starts at m_buffer[m_nalHeader].
+  // Returns false if more bytes are needed to decide.
+  bool classifyNAL();
+  void emit(size_t end);
+  void compact();
+
+  AccessUnitCallback m_callback;
+  const size_t m_maxAccessUnitSize;
+  std::vector<uint8_t> m_buffer; // Current access unit followed by unscanned bytes
+  size_t m_size;                 // Bytes used in m_buffer
+  size_t m_auStart;              // Start of the current access unit, 0 between pushes
+  size_t m_scanPos;              // Where the search for the next start code resumes
+  size_t m_nalStart;             // Start code of the newest NAL unit
+  size_t m_nalHeader;            // Header byte of the newest NAL unit
+  bool m_synced;                 // A start code has been seen
+  bool m_headerPending;          // The newest NAL unit is not classified yet
+  bool m_hasVCL;                 // The current access unit contains a coded slice
+  bool m_oversized;              // The current access unit exceeded the size limit
+  Stats m_stats;
+};
@@ -0,0 +1,110 @@
+// H264 bitstream converter implementation
+#include "H264BitstreamConverter.h"
+#include "H264NALUParser.h"
+#include <algorithm>
+
+namespace {
+
+void writeLength(uint8_t *dst, size_t length) {
+  dst[0] = static_cast<uint8_t>((length >> 24) & 0xFF);
+  dst[1] = static_cast<uint8_t>((length >> 16) & 0xFF);
+  dst[2] = static_cast<uint8_t>((length >> 8) & 0xFF);
+  dst[3] = static_cast<uint8_t>(length & 0xFF);
+}
+
+size_t readLength(const uint8_t *src) {
+  return (static_cast<size_t>(src[0]) << 24) |
+         (static_cast<size_t>(src[1]) << 16) |
+         (static_cast<size_t>(src[2]) << 8) | src[3];
+}
+
+void writeStartCode(uint8_t *dst) {
+  dst[0] = 0;
+  dst[1] = 0;
+  dst[2] = 0;
+  dst[3] = 1;
+}
+
+} // namespace
+
+bool H264BitstreamConverter::isValidAVCC(const uint8_t *data, size_t size) {
+  size_t pos = 0;
+  while (pos < size) {
+    if (size - pos < 5) {
+      return false;
+    }
+    size_t length = readLength(data + pos);
+    pos += 4;
+    // forbidden_zero_bit must be clear in every NAL header
+    if (length == 0 || length > size - pos || (data[pos] & 0x80) != 0) {
+      return false;
+    }
+    pos += length;
+  }
+  return size > 0;
+}
+
+H264StreamFormat H264BitstreamConverter::detectFormat(const uint8_t *data,
+                                                      size_t size) {
+  return isValidAVCC(data, size) ? H264StreamFormat::AVCC
+                                 : H264StreamFormat::AnnexB;
+}
+
+bool H264BitstreamConverter::annexBToAVCCInPlace(uint8_t *data, size_t size) {
+  size_t expected_offset = 4;
+  size_t converted = 0;
+  bool ok = true;
+  for (const H264NALUParser::NALUnit &nalu :
+       H264NALUParser::enumerateNALUs(data, size)) {
+    if (nalu.startCodeLength != 4 || nalu.offset != expected_offset) {
+      ok = false;
+      break;
+    }
+    // The start code is already behind the scan position, so it can be replaced
+    writeLength(data + nalu.offset - 4, nalu.size);
+    expected_offset = nalu.offset + nalu.size + 4;
+    converted++;
+  }
+  if (ok && converted > 0 && expected_offset - 4 == size) {
+    return true;
+  }
+
+  // Put back the start codes written so far
+  size_t pos = 0;
+  for (size_t i = 0; i < converted; i++) {
+    size_t length = readLength(data + pos);
+    writeStartCode(data + pos);
+    pos += 4 + length;
+  }
+  return false;
+}
+
+bool H264BitstreamConverter::annexBToAVCC(const uint8_t *data, size_t size,
+                                          std::vector<uint8_t> &out) {
+  out.clear();
+  for (const H264NALUParser::NALUnit &nalu :
+       H264NALUParser::enumerateNALUs(data, size)) {
+    size_t length = nalu.size;
+    while (length > 1 && nalu.data[length - 1] == 0) {
+      length--;
+    }
+    size_t pos = out.size();
+    out.resize(pos + 4 + length);
+    writeLength(out.data() + pos, length);
+    std::copy(nalu.data, nalu.data + length, out.begin() + pos + 4);
+  }
+  return !out.empty();
+}
+
+bool H264BitstreamConverter::avccToAnnexBInPlace(uint8_t *data, size_t size) {
+  if (!isValidAVCC(data, size)) {
+    return false;
+  }
+  size_t pos = 0;
+  while (pos < size) {
+    size_t length = readLength(data + pos);
+    writeStartCode(data + pos);
+    pos += 4 + length;
+  }
+  return true;
+}
@@ -0,0 +1,38 @@
+// H264 bitstream converter between Annex-B and length-prefixed (AVCC) NAL units
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Framing of the NAL units in a packet
+enum class H264StreamFormat {
+  Auto,   // Detect from the data
+  AnnexB, // 00 00 01 / 00 00 00 01 start codes
+  AVCC    // 4-byte big-endian length prefix per NAL unit
+};
+
+// Converts packets between Annex-B and AVCC framing. Length-prefixed packets
+// can be split into NAL units by following the length fields, without
+// scanning the payload for start codes.
+class H264BitstreamConverter {
+public:
+  // Length-prefixed if the length fields exactly cover the packet, otherwise Annex-B
+  static H264StreamFormat detectFormat(const uint8_t *data, size_t size);
+
+  // True if the packet is a valid chain of 4-byte length-prefixed NAL units
+  static bool isValidAVCC(const uint8_t *data, size_t size);
+
+  // Overwrite each start code with the NAL unit length. Only possible when
+  // every start code is 4 bytes long and nothing precedes the first one, which
+  // is what the encoder produces. Returns false and leaves the data unchanged otherwise.
+  static bool annexBToAVCCInPlace(uint8_t *data, size_t size);
+
+  // Convert any Annex-B packet into out, trailing zero bytes are dropped
+  static bool annexBToAVCC(const uint8_t *data, size_t size,
+                           std::vector<uint8_t> &out);
+
+  // Overwrite each length prefix with a 4-byte start code, always possible in place.
+  // Returns false and leaves the data unchanged if the packet is malformed.
+  static bool avccToAnnexBInPlace(uint8_t *data, size_t size);
+};
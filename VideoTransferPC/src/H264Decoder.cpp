@@ -3,15 +3,125 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
 }
 
 #include "H264Decoder.h"
 #include <stdio.h>
 #include <stdexcept>
 #include "FFmpegUtils.h"
+#include "H264NALUParser.h"
+#include "H264ParameterSets.h"
+#include "PixelFormatConverter.h"
+#include <chrono>
 #include <memory>
+#include <vector>
+
+namespace {
+
+int64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DecodedPixelFormat toDecodedPixelFormat(int format) {
+    switch (format) {
+    case AV_PIX_FMT_NV12:
+        return DecodedPixelFormat::NV12;
+    case AV_PIX_FMT_BGRA:
+        return DecodedPixelFormat::BGRA;
+    default:
+        return DecodedPixelFormat::YUV420P;
+    }
+}
+
+AVPixelFormat toAVPixelFormat(DecodedPixelFormat format) {
+    switch (format) {
+    case DecodedPixelFormat::NV12:
+        return AV_PIX_FMT_NV12;
+    case DecodedPixelFormat::BGRA:
+        return AV_PIX_FMT_BGRA;
+    default:
+        return AV_PIX_FMT_YUV420P;
+    }
+}
+
+// FFmpeg exports each user_data_unregistered SEI message as AV_FRAME_DATA_SEI_UNREGISTERED
+// side data, the UUID tells ours apart from others such as x264's version string
+bool findFrameMetadata(const AVFrame* frame, FrameMetadata& metadata) {
+    for (int i = 0; i < frame->nb_side_data; i++) {
+        const AVFrameSideData* sideData = frame->side_data[i];
+        if (sideData->type == AV_FRAME_DATA_SEI_UNREGISTERED &&
+            H264FrameMetadataSEI::readPayload(sideData->data, sideData->size, metadata)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+DecodedFrame::DecodedFrame(AVFrame* frame)
+    : format(toDecodedPixelFormat(frame->format)), width(frame->width), height(frame->height),
+      pts(frame->pts), hasMetadata(false), m_frame(frame) {
+    for (int i = 0; i < 3; i++) {
+        data[i] = frame->data[i];
+        linesize[i] = frame->linesize[i];
+    }
+}
+
+size_t DecodedFrame::packedSize() const {
+    switch (format) {
+    case DecodedPixelFormat::BGRA:
+        return static_cast<size_t>(width) * height * 4;
+    case DecodedPixelFormat::NV12:
+    case DecodedPixelFormat::YUV420P:
+    default:
+        return static_cast<size_t>(width) * height * 3 / 2;
+    }
+}
+
+void DecodedFrame::packTo(uint8_t* dst) const {
+    int widths[3] = {width, width / 2, width / 2};
+    int heights[3] = {height, height / 2, height / 2};
+    int planes = 3;
+    if (format == DecodedPixelFormat::NV12) {
+        widths[1] = width;
+        planes = 2;
+    }
+    else if (format == DecodedPixelFormat::BGRA) {
+        widths[0] = width * 4;
+        planes = 1;
+    }
+
+    for (int i = 0; i < planes; i++) {
+        for (int j = 0; j < heights[i]; j++) {
+            memcpy(dst, data[i] + j * linesize[i], widths[i]);
+            dst += widths[i];
+        }
+    }
+}
+
+DecodedFrame::~DecodedFrame() {
+    av_frame_free(&m_frame);
+}
 
 void H264Decoder::cleanup() {
+    if (m_scaler) {
+        sws_freeContext(m_scaler);
+        m_scaler = nullptr;
+    }
+    if (m_scaledPool) {
+        // Buffers still held by frame views keep the pool alive until they are released
+        av_buffer_pool_uninit(&m_scaledPool);
+    }
+    if (m_convertedPool) {
+        av_buffer_pool_uninit(&m_convertedPool);
+    }
+    if (m_parser) {
+        av_parser_close(m_parser);
+        m_parser = nullptr;
+    }
     if (m_pkt) {
         av_packet_free(&m_pkt);
         m_pkt = nullptr;
@@ -27,13 +137,38 @@ void H264Decoder::cleanup() {
     m_initialized = false;
 }
 
-H264Decoder::H264Decoder(DecodeCallback callback)
-    : m_decCtx(nullptr), m_frame(nullptr), m_pkt(nullptr), m_initialized(false), m_callback(callback) {
-    try {
-        if (!callback) {
-            throw std::runtime_error("Invalid callback function");
-        }
+H264Decoder::H264Decoder(DecodeCallback callback, const H264DecoderOptions& options)
+    : m_decCtx(nullptr), m_frame(nullptr), m_pkt(nullptr), m_parser(nullptr), m_initialized(false), m_callback(callback),
+      m_needsKeyframe(true), m_packetLossPending(false), m_discardNonReference(false),
+      m_framesDecoded(0), m_framesConcealed(0), m_framesDropped(0), m_resyncCount(0),
+      m_options(options), m_inputFormat(options.inputFormat), m_packetCounter(0), m_lastDecodeLatencyUs(0), m_maxDecodeLatencyUs(0),
+      m_totalDecodeLatencyUs(0), m_framesSameCall(0),
+      m_previewRequested(options.preview), m_previewActive(false), m_scaler(nullptr), m_scaledPool(nullptr),
+      m_convertedPool(nullptr), m_convertedPoolSize(0) {
+    if (!callback) {
+        fprintf(stderr, "H264Decoder initialization failed: Invalid callback function\n");
+        throw std::runtime_error("Invalid callback function");
+    }
+    init();
+}
 
+H264Decoder::H264Decoder(FrameCallback frameCallback, const H264DecoderOptions& options)
+    : m_decCtx(nullptr), m_frame(nullptr), m_pkt(nullptr), m_parser(nullptr), m_initialized(false), m_frameCallback(frameCallback),
+      m_needsKeyframe(true), m_packetLossPending(false), m_discardNonReference(false),
+      m_framesDecoded(0), m_framesConcealed(0), m_framesDropped(0), m_resyncCount(0),
+      m_options(options), m_inputFormat(options.inputFormat), m_packetCounter(0), m_lastDecodeLatencyUs(0), m_maxDecodeLatencyUs(0),
+      m_totalDecodeLatencyUs(0), m_framesSameCall(0),
+      m_previewRequested(options.preview), m_previewActive(false), m_scaler(nullptr), m_scaledPool(nullptr),
+      m_convertedPool(nullptr), m_convertedPoolSize(0) {
+    if (!frameCallback) {
+        fprintf(stderr, "H264Decoder initialization failed: Invalid callback function\n");
+        throw std::runtime_error("Invalid callback function");
+    }
+    init();
+}
+
+void H264Decoder::init() {
+    try {
         // Initialize decoder
         const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
         if (!codec) {
@@ -58,6 +193,35 @@ H264Decoder::H264Decoder(DecodeCallback callback)
             throw std::runtime_error("Failed to allocate packet");
         }
 
+        // Do not output frames the decoder knows are broken (missing references,
+        // concealed macroblocks). Recovery is driven by the next IDR frame instead.
+        m_decCtx->flags &= ~AV_CODEC_FLAG_OUTPUT_CORRUPT;
+
+        // Low-delay configuration. With AV_CODEC_FLAG_LOW_DELAY and no B-frames in the
+        // baseline stream the decoder keeps no reorder buffer and outputs each frame
+        // as soon as its packet is decoded.
+        if (m_options.lowDelay) {
+            m_decCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+        if (m_options.fast) {
+            m_decCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+        }
+        m_decCtx->thread_type = FF_THREAD_SLICE;
+        m_decCtx->thread_count = m_options.threadCount > 0 ? m_options.threadCount : 1;
+        applyPreviewMode(m_options.preview);
+
+        if (m_options.inputFormat == H264StreamFormat::AVCC) {
+            // avcC record without parameter sets. It only tells the decoder that NAL units carry
+            // 4-byte length prefixes, the SPS/PPS still arrive in-band.
+            static const uint8_t avcc[7] = {1, 66, 0, 31, 0xFF, 0xE0, 0};
+            m_decCtx->extradata = static_cast<uint8_t*>(av_mallocz(sizeof(avcc) + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (!m_decCtx->extradata) {
+                throw std::runtime_error("Failed to allocate decoder extradata");
+            }
+            memcpy(m_decCtx->extradata, avcc, sizeof(avcc));
+            m_decCtx->extradata_size = sizeof(avcc);
+        }
+
         // Open decoder
         if (avcodec_open2(m_decCtx, codec, nullptr) < 0) {
             throw std::runtime_error("Failed to open decoder");
@@ -82,14 +246,128 @@ void H264Decoder::decode(const uint8_t* data, size_t size) {
         return;
     }
 
+    decodePacket(data, size);
+}
+
+void H264Decoder::decodeStream(const uint8_t* data, size_t size) {
+    if (!m_initialized || !data) {
+        fprintf(stderr, "H264Decoder not initialized or invalid input data\n");
+        return;
+    }
+
+    // The parser splits the input at start codes
+    if (m_inputFormat == H264StreamFormat::AVCC) {
+        fprintf(stderr, "H264Decoder stream input requires Annex-B data\n");
+        return;
+    }
+    if (m_inputFormat == H264StreamFormat::Auto) {
+        resolveInputFormat(H264StreamFormat::AnnexB);
+    }
+
+    if (!m_parser) {
+        m_parser = av_parser_init(AV_CODEC_ID_H264);
+        if (!m_parser) {
+            fprintf(stderr, "Failed to create H264 parser\n");
+            return;
+        }
+    }
+
+    while (size > 0) {
+        uint8_t* out = nullptr;
+        int outSize = 0;
+        int consumed = av_parser_parse2(m_parser, m_decCtx, &out, &outSize,
+                                        data, static_cast<int>(size), AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (consumed < 0) {
+            fprintf(stderr, "Error parsing H264 stream: %s\n", av_err2str_cpp(consumed));
+            return;
+        }
+        data += consumed;
+        size -= consumed;
+
+        if (outSize > 0) {
+            decodePacket(out, outSize);
+        }
+    }
+}
+
+void H264Decoder::flushStream() {
+    if (!m_initialized || !m_parser) {
+        return;
+    }
+
+    uint8_t* out = nullptr;
+    int outSize = 0;
+    av_parser_parse2(m_parser, m_decCtx, &out, &outSize, nullptr, 0, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+    if (outSize > 0) {
+        decodePacket(out, outSize);
+    }
+}
+
+void H264Decoder::resolveInputFormat(H264StreamFormat format) {
+    m_inputFormat = format;
+    if (m_inputFormat == H264StreamFormat::AVCC) {
+        // The framing is fixed when the codec is opened, nothing has been decoded yet
+        printf("H264Decoder: length-prefixed input detected\n");
+        cleanup();
+        m_options.inputFormat = H264StreamFormat::AVCC;
+        init();
+    }
+
+    if (!m_pendingParameterSets.empty()) {
+        std::vector<uint8_t> parameterSets;
+        parameterSets.swap(m_pendingParameterSets);
+        if (m_inputFormat == H264StreamFormat::AVCC) {
+            H264BitstreamConverter::annexBToAVCCInPlace(parameterSets.data(), parameterSets.size());
+        }
+        decodePacket(parameterSets.data(), parameterSets.size());
+    }
+}
+
+void H264Decoder::decodePacket(const uint8_t* data, size_t size) {
+    if (m_inputFormat == H264StreamFormat::Auto) {
+        resolveInputFormat(H264BitstreamConverter::detectFormat(data, size));
+    }
+
+    if (m_previewRequested != m_previewActive) {
+        applyPreviewMode(m_previewRequested);
+    }
+
+    if (m_packetLossPending.exchange(false)) {
+        requestKeyframe("packet loss reported");
+    }
+
+    // While references are broken, only an IDR frame can restore a clean picture.
+    // Packets without slices (e.g. SPS/PPS) are still passed through.
+    const H264NALUParser::PacketInfo info = (m_inputFormat == H264StreamFormat::AVCC)
+        ? H264NALUParser::classifyAVCCPacket(data, size)
+        : H264NALUParser::classifyPacket(data, size);
+    if (info.hasIDR) {
+        if (m_needsKeyframe) {
+            avcodec_flush_buffers(m_decCtx);
+            m_needsKeyframe = false;
+        }
+    }
+    else if (info.hasSlice && m_needsKeyframe) {
+        m_framesDropped++;
+        return;
+    }
+    else if (info.hasSlice && !info.isReference && m_discardNonReference) {
+        // Nothing references this frame, so skipping it keeps the stream intact
+        m_framesDropped++;
+        return;
+    }
+
     // Set packet data directly
     m_pkt->data = const_cast<uint8_t*>(data);
     m_pkt->size = size;
+    m_pkt->pts = m_packetCounter++;
+    m_sendTimeUs[m_pkt->pts % kSendTimeSlots] = steadyNowUs();
 
     // Send packet to decoder
     int send_ret = avcodec_send_packet(m_decCtx, m_pkt);
     if (send_ret < 0) {
         fprintf(stderr, "Error sending packet to decoder: %s\n", av_err2str_cpp(send_ret));
+        requestKeyframe("send packet failed");
         return;
     }
 
@@ -102,32 +380,266 @@ void H264Decoder::decode(const uint8_t* data, size_t size) {
         if (recv_ret < 0) {
             fprintf(stderr, "Error during decoding: %s\n", av_err2str_cpp(recv_ret));
             av_frame_unref(m_frame);
+            requestKeyframe("receive frame failed");
             break;
         }
 
-        // Calculate YUV plane sizes after getting frame
-        const int widths[3] = {m_frame->width, m_frame->width/2, m_frame->width/2};
-        const int heights[3] = {m_frame->height, m_frame->height/2, m_frame->height/2};
+        if (m_frame->decode_error_flags || (m_frame->flags & AV_FRAME_FLAG_CORRUPT)) {
+            // The frame was concealed, do not show it and wait for a clean IDR
+            m_framesConcealed++;
+            av_frame_unref(m_frame);
+            requestKeyframe("corrupt frame");
+            continue;
+        }
 
-        // Calculate total size and allocate buffer
-        size_t totalSize = 0;
-        for (int i = 0; i < 3; i++) {
-            totalSize += widths[i] * heights[i];
+        if (m_needsKeyframe) {
+            // Frames still in flight after a loss are based on broken references
+            m_framesDropped++;
+            av_frame_unref(m_frame);
+            continue;
         }
-        auto buffer = std::make_unique<uint8_t[]>(totalSize);
-        uint8_t* currentPos = buffer.get();
 
-        // Copy data from three planes to continuous buffer
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < heights[i]; j++) {
-                memcpy(currentPos, m_frame->data[i] + j * m_frame->linesize[i], widths[i]);
-                currentPos += widths[i];
+        // Frames are matched with their send time through the packet number in pts
+        const int64_t framePts = m_frame->pts;
+        if (framePts >= 0 && framePts < m_packetCounter && m_packetCounter - framePts <= kSendTimeSlots) {
+            const uint64_t latencyUs = static_cast<uint64_t>(steadyNowUs() - m_sendTimeUs[framePts % kSendTimeSlots]);
+            m_lastDecodeLatencyUs = latencyUs;
+            m_totalDecodeLatencyUs += latencyUs;
+            if (latencyUs > m_maxDecodeLatencyUs) {
+                m_maxDecodeLatencyUs = latencyUs;
+            }
+            if (framePts == m_packetCounter - 1) {
+                m_framesSameCall++;
             }
         }
 
-        // Call callback function to process data
-        m_callback(buffer.get(), totalSize, m_frame->width, m_frame->height);
+        m_framesDecoded++;
+        deliverFrame();
 
         av_frame_unref(m_frame);
     }
 }
+
+void H264Decoder::requestKeyframe(const char* reason) {
+    if (m_needsKeyframe.exchange(true)) {
+        return;
+    }
+    m_resyncCount++;
+    fprintf(stderr, "H264Decoder: %s, waiting for next IDR frame\n", reason);
+    if (m_keyframeRequestCallback) {
+        m_keyframeRequestCallback();
+    }
+}
+
+void H264Decoder::setParameterSets(const ParameterSetCache& parameterSets) {
+    std::vector<uint8_t> packet;
+    parameterSets.appendParameterSets(packet);
+    if (packet.empty()) {
+        return;
+    }
+    if (m_inputFormat == H264StreamFormat::Auto) {
+        // Sent in the stream's framing once the first packet shows what it is
+        m_pendingParameterSets = std::move(packet);
+        return;
+    }
+    if (m_inputFormat == H264StreamFormat::AVCC) {
+        H264BitstreamConverter::annexBToAVCCInPlace(packet.data(), packet.size());
+    }
+    // A packet without slices is never dropped, even while waiting for an IDR frame
+    decode(packet.data(), packet.size());
+}
+
+void H264Decoder::notifyPacketLoss() {
+    m_packetLossPending = true;
+}
+
+void H264Decoder::setDiscardNonReference(bool discard) {
+    m_discardNonReference = discard;
+}
+
+void H264Decoder::setPreviewMode(bool enabled) {
+    m_previewRequested = enabled;
+}
+
+bool H264Decoder::needsKeyframe() const {
+    return m_needsKeyframe;
+}
+
+void H264Decoder::setKeyframeRequestCallback(KeyframeRequestCallback callback) {
+    m_keyframeRequestCallback = callback;
+}
+
+H264Decoder::Stats H264Decoder::getStats() const {
+    Stats stats;
+    stats.framesDecoded = m_framesDecoded;
+    stats.framesConcealed = m_framesConcealed;
+    stats.framesDropped = m_framesDropped;
+    stats.resyncCount = m_resyncCount;
+    stats.framesSameCall = m_framesSameCall;
+    stats.lastDecodeLatencyUs = m_lastDecodeLatencyUs;
+    stats.maxDecodeLatencyUs = m_maxDecodeLatencyUs;
+    stats.avgDecodeLatencyUs = stats.framesDecoded > 0
+        ? static_cast<double>(m_totalDecodeLatencyUs) / stats.framesDecoded : 0.0;
+    return stats;
+}
+
+void H264Decoder::deliverFrame() {
+    // Read the metadata before the frame is scaled, converted or moved
+    FrameMetadata metadata;
+    bool hasMetadata = findFrameMetadata(m_frame, metadata);
+
+    // In preview mode the output is a downscaled copy, otherwise the decoder frame itself
+    AVFrame* output = m_frame;
+    if (m_previewActive && m_options.previewWidth > 0 && m_options.previewHeight > 0) {
+        output = scaleFrame();
+        if (!output) {
+            return;
+        }
+    }
+
+    if (m_options.outputFormat != DecodedPixelFormat::YUV420P) {
+        AVFrame* converted = convertFrame(output);
+        if (output != m_frame) {
+            av_frame_free(&output);
+        }
+        if (!converted) {
+            return;
+        }
+        output = converted;
+    }
+
+    if (output == m_frame) {
+        // Hand the frame buffers over to a refcounted view instead of copying them.
+        // m_frame is left empty and is refilled by the next avcodec_receive_frame.
+        output = av_frame_alloc();
+        if (!output) {
+            fprintf(stderr, "Failed to allocate frame for decoded output\n");
+            return;
+        }
+        av_frame_move_ref(output, m_frame);
+    }
+    auto view = std::make_shared<DecodedFrame>(output);
+    view->hasMetadata = hasMetadata;
+    view->metadata = metadata;
+
+    if (m_frameCallback) {
+        m_frameCallback(view);
+        return;
+    }
+
+    // Copy the planes to a continuous buffer for the legacy callback
+    size_t totalSize = view->packedSize();
+    auto buffer = std::make_unique<uint8_t[]>(totalSize);
+    view->packTo(buffer.get());
+
+    // Call callback function to process data
+    m_callback(buffer.get(), totalSize, view->width, view->height);
+}
+
+void H264Decoder::applyPreviewMode(bool enabled) {
+    if (enabled) {
+        m_decCtx->skip_loop_filter = AVDISCARD_ALL;
+        m_decCtx->skip_frame = m_options.previewSkipNonRef ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        m_decCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+    }
+    else {
+        m_decCtx->skip_loop_filter = AVDISCARD_DEFAULT;
+        m_decCtx->skip_frame = AVDISCARD_DEFAULT;
+        if (!m_options.fast) {
+            m_decCtx->flags2 &= ~AV_CODEC_FLAG2_FAST;
+        }
+    }
+    m_previewActive = enabled;
+}
+
+AVFrame* H264Decoder::scaleFrame() {
+    const int width = m_options.previewWidth & ~1;
+    const int height = m_options.previewHeight & ~1;
+
+    m_scaler = sws_getCachedContext(m_scaler, m_frame->width, m_frame->height, static_cast<AVPixelFormat>(m_frame->format),
+                                    width, height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_scaler) {
+        fprintf(stderr, "Failed to create preview scaler\n");
+        return nullptr;
+    }
+
+    if (!m_scaledPool) {
+        int bufferSize = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 32);
+        m_scaledPool = av_buffer_pool_init(bufferSize, av_buffer_alloc);
+        if (!m_scaledPool) {
+            fprintf(stderr, "Failed to allocate preview buffer pool\n");
+            return nullptr;
+        }
+    }
+
+    AVFrame* scaled = av_frame_alloc();
+    if (!scaled) {
+        fprintf(stderr, "Failed to allocate preview frame\n");
+        return nullptr;
+    }
+    scaled->buf[0] = av_buffer_pool_get(m_scaledPool);
+    if (!scaled->buf[0]) {
+        fprintf(stderr, "Failed to get preview buffer\n");
+        av_frame_free(&scaled);
+        return nullptr;
+    }
+    scaled->format = AV_PIX_FMT_YUV420P;
+    scaled->width = width;
+    scaled->height = height;
+    scaled->pts = m_frame->pts;
+    av_image_fill_arrays(scaled->data, scaled->linesize, scaled->buf[0]->data, AV_PIX_FMT_YUV420P, width, height, 32);
+
+    sws_scale(m_scaler, m_frame->data, m_frame->linesize, 0, m_frame->height, scaled->data, scaled->linesize);
+    return scaled;
+}
+
+AVFrame* H264Decoder::convertFrame(const AVFrame* source) {
+    if (source->format != AV_PIX_FMT_YUV420P && source->format != AV_PIX_FMT_YUVJ420P) {
+        fprintf(stderr, "Unsupported decoded pixel format %d for conversion\n", source->format);
+        return nullptr;
+    }
+
+    const AVPixelFormat format = toAVPixelFormat(m_options.outputFormat);
+    const int width = source->width & ~1;
+    const int height = source->height & ~1;
+
+    int bufferSize = av_image_get_buffer_size(format, width, height, 32);
+    if (!m_convertedPool || bufferSize != m_convertedPoolSize) {
+        av_buffer_pool_uninit(&m_convertedPool);
+        m_convertedPool = av_buffer_pool_init(bufferSize, av_buffer_alloc);
+        if (!m_convertedPool) {
+            fprintf(stderr, "Failed to allocate conversion buffer pool\n");
+            return nullptr;
+        }
+        m_convertedPoolSize = bufferSize;
+    }
+
+    AVFrame* converted = av_frame_alloc();
+    if (!converted) {
+        fprintf(stderr, "Failed to allocate converted frame\n");
+        return nullptr;
+    }
+    converted->buf[0] = av_buffer_pool_get(m_convertedPool);
+    if (!converted->buf[0]) {
+        fprintf(stderr, "Failed to get conversion buffer\n");
+        av_frame_free(&converted);
+        return nullptr;
+    }
+    converted->format = format;
+    converted->width = width;
+    converted->height = height;
+    converted->pts = source->pts;
+    av_image_fill_arrays(converted->data, converted->linesize, converted->buf[0]->data, format, width, height, 32);
+
+    if (format == AV_PIX_FMT_NV12) {
+        PixelFormatConverter::i420ToNV12(source->data[0], source->linesize[0], source->data[1], source->linesize[1],
+                                         source->data[2], source->linesize[2], converted->data[0], converted->linesize[0],
+                                         converted->data[1], converted->linesize[1], width, height);
+    }
+    else {
+        PixelFormatConverter::i420ToBGRA(source->data[0], source->linesize[0], source->data[1], source->linesize[1],
+                                         source->data[2], source->linesize[2], converted->data[0], converted->linesize[0],
+                                         width, height);
+    }
+    return converted;
+}
@@ -1,31 +1,192 @@
 //H264 decoder class for decoding H264 video streams using FFmpeg
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <vector>
+#include "H264BitstreamConverter.h"
+#include "H264FrameMetadata.h"
 
 // Forward declarations of required FFmpeg structures
 struct AVCodecContext;
 struct AVFrame;
 struct AVPacket;
+struct AVCodecParserContext;
+struct AVBufferPool;
+struct SwsContext;
+
+class ParameterSetCache;
+
+// Pixel layout of the pictures handed to the callbacks
+enum class DecodedPixelFormat {
+    YUV420P, // Three planes as decoded, no conversion
+    NV12,    // Y plane and interleaved UV plane, uploaded directly by most GPU video paths
+    BGRA     // Single packed plane, 4 bytes per pixel
+};
+
+// Refcounted view of a decoded picture.
+// The plane pointers reference the decoder's AVFrame buffers directly, so no pixel
+// data is copied. The AVFrame is kept alive until the last reference to the view is released.
+class DecodedFrame {
+public:
+    // Takes ownership of frame
+    explicit DecodedFrame(AVFrame* frame);
+    ~DecodedFrame();
+
+    DecodedFrame(const DecodedFrame&) = delete;
+    DecodedFrame& operator=(const DecodedFrame&) = delete;
+
+    // Size of the picture with all planes packed without row padding
+    size_t packedSize() const;
+    // Copy the planes into a contiguous buffer of packedSize() bytes
+    void packTo(uint8_t* dst) const;
+
+    DecodedPixelFormat format;
+    const uint8_t* data[3]; // Unused planes are null
+    int linesize[3];
+    int width;
+    int height;
+    int64_t pts;
+    bool hasMetadata;       // Frame metadata was found in the access unit's SEI
+    FrameMetadata metadata;
+
+private:
+    AVFrame* m_frame;
+};
 
 // Define callback function type
 using DecodeCallback = std::function<void(const uint8_t* data, size_t size, int width, int height)>;
 
+// Zero-copy callback type, the consumer may hold the frame for as long as it needs it
+using FrameCallback = std::function<void(std::shared_ptr<const DecodedFrame> frame)>;
+
+// Called when the decoder loses its reference chain and waits for the next IDR frame
+using KeyframeRequestCallback = std::function<void()>;
+
+// Decoder configuration applied when the codec is opened.
+// The defaults favor latency: every packet should produce its frame on the same decode() call.
+struct H264DecoderOptions {
+    bool lowDelay = true;   // AV_CODEC_FLAG_LOW_DELAY, no reorder delay before output
+    bool fast = true;       // AV_CODEC_FLAG2_FAST, safe for the baseline streams sent by H264Encoder
+    int threadCount = 1;    // Slice threads, frame threading is never used since it adds a frame of delay per thread
+
+    // Preview mode for monitoring many streams at thumbnail size. The deblocking filter is
+    // skipped, which lowers picture quality but keeps the stream live at a fraction of the cost.
+    bool preview = false;
+    bool previewSkipNonRef = false; // In preview mode, also skip decoding non-reference frames
+    int previewWidth = 0;           // In preview mode, downscale the output to this size (0 keeps the decoded size)
+    int previewHeight = 0;
+
+    // Output pixel format. Conversions run in the decode thread with SIMD (see PixelFormatConverter)
+    // into pooled buffers, so display consumers can upload the frame without converting it themselves.
+    DecodedPixelFormat outputFormat = DecodedPixelFormat::YUV420P;
+
+    // Framing of the packets passed to decode(). Auto detects it from the first packet.
+    // decodeStream() always expects Annex-B.
+    H264StreamFormat inputFormat = H264StreamFormat::Auto;
+};
+
 class H264Decoder {
 private:
     AVCodecContext* m_decCtx;
     AVFrame* m_frame;
     AVPacket* m_pkt;
+    AVCodecParserContext* m_parser; // Created on first use of decodeStream
     bool m_initialized;
     DecodeCallback m_callback;
+    FrameCallback m_frameCallback;
+    KeyframeRequestCallback m_keyframeRequestCallback;
+
+    // Loss handling state. Corrupt output is suppressed until the next IDR frame.
+    std::atomic_bool m_needsKeyframe;
+    std::atomic_bool m_packetLossPending;
+    std::atomic_bool m_discardNonReference;
+    std::atomic<uint64_t> m_framesDecoded;
+    std::atomic<uint64_t> m_framesConcealed;
+    std::atomic<uint64_t> m_framesDropped;
+    std::atomic<uint64_t> m_resyncCount;
+
+    H264DecoderOptions m_options;
+    H264StreamFormat m_inputFormat;              // Auto until the first packet is seen
+    std::vector<uint8_t> m_pendingParameterSets; // Fed once the input format is known
+
+    // Decode latency measurement, from avcodec_send_packet to the frame coming out.
+    // Packets are numbered through pts so each frame can be matched with its send time.
+    static const int kSendTimeSlots = 16;
+    int64_t m_packetCounter;
+    int64_t m_sendTimeUs[kSendTimeSlots];
+    std::atomic<uint64_t> m_lastDecodeLatencyUs;
+    std::atomic<uint64_t> m_maxDecodeLatencyUs;
+    std::atomic<uint64_t> m_totalDecodeLatencyUs;
+    std::atomic<uint64_t> m_framesSameCall;
+
+    // Preview mode state. The mode can be toggled from any thread and is applied
+    // to the codec context before the next packet.
+    std::atomic_bool m_previewRequested;
+    bool m_previewActive;
+    SwsContext* m_scaler;
+    AVBufferPool* m_scaledPool; // Recycles the downscaled output buffers
+
+    // Output format conversion buffers, recreated when the picture size changes
+    AVBufferPool* m_convertedPool;
+    int m_convertedPoolSize;
 
     // Add private method for resource cleanup
     void cleanup();
+    void init();
+    void decodePacket(const uint8_t* data, size_t size);
+    void resolveInputFormat(H264StreamFormat format);
+    void deliverFrame();
+    void applyPreviewMode(bool enabled);
+    AVFrame* scaleFrame();
+    AVFrame* convertFrame(const AVFrame* source);
+    void requestKeyframe(const char* reason);
 
 public:
-    H264Decoder(DecodeCallback callback);
+    struct Stats {
+        uint64_t framesDecoded;   // Frames delivered to the callback
+        uint64_t framesConcealed; // Frames with decode errors that were withheld
+        uint64_t framesDropped;   // Packets skipped without decoding
+        uint64_t resyncCount;     // Times the decoder lost its references
+        uint64_t framesSameCall;  // Frames output by the decode call that sent their packet
+        uint64_t lastDecodeLatencyUs;
+        uint64_t maxDecodeLatencyUs;
+        double avgDecodeLatencyUs;
+    };
+
+    H264Decoder(DecodeCallback callback, const H264DecoderOptions& options = H264DecoderOptions());
+    H264Decoder(FrameCallback frameCallback, const H264DecoderOptions& options = H264DecoderOptions());
     ~H264Decoder();
 
+    // Decode one complete access unit, the data is passed to FFmpeg without copying
     void decode(const uint8_t* data, size_t size);
+
+    // Streaming input: accepts arbitrary byte chunks of an Annex-B stream (e.g. read from a
+    // file or a third-party sender) and decodes each access unit once the parser has
+    // assembled it. An access unit is emitted when the start of the next one is seen.
+    void decodeStream(const uint8_t* data, size_t size);
+    // Emit the access unit still buffered by decodeStream at the end of the stream
+    void flushStream();
+
+    // Feed cached SPS/PPS to the decoder ahead of the stream, e.g. when joining a
+    // stream mid-way, so the first IDR frame decodes even without in-band parameter sets
+    void setParameterSets(const ParameterSetCache& parameterSets);
+
+    // Report that packets were lost before reaching the decoder. Safe to call from any thread.
+    void notifyPacketLoss();
+
+    // Skip packets whose slices are all non-reference, used when the decoder falls behind.
+    // Safe to call from any thread.
+    void setDiscardNonReference(bool discard);
+
+    // Switch preview mode (see H264DecoderOptions) on or off. Safe to call from any thread.
+    void setPreviewMode(bool enabled);
+
+    // True while the decoder waits for an IDR frame to recover from a loss or decode error
+    bool needsKeyframe() const;
+    void setKeyframeRequestCallback(KeyframeRequestCallback callback);
+
+    Stats getStats() const;
 };
@@ -15,9 +15,10 @@ extern "C" {
 #include <inttypes.h>
 #include "FFmpegUtils.h"
 
-H264Encoder::H264Encoder(int width, int height, AVpacketWriteCallback writeCallback, int fps, int64_t bitrate)
+H264Encoder::H264Encoder(int width, int height, AVpacketWriteCallback writeCallback, int fps, int64_t bitrate,
+                         H264StreamFormat streamFormat)
     : m_encCtx(nullptr), m_frame(nullptr), m_pkt(nullptr), m_writeCallback(writeCallback),
-      m_ptsCounter(0)
+      m_ptsCounter(0), m_keyframeRequested(false)
 {
     // Move all variable declarations to function start
     const AVCodec* codec = nullptr;
@@ -90,8 +91,14 @@ H264Encoder::H264Encoder(int width, int height, AVpacketWriteCallback writeCallb
     av_opt_set(m_encCtx->priv_data, "preset", "ultrafast", 0);
     av_opt_set(m_encCtx->priv_data, "tune", "zerolatency", 0);
     av_opt_set(m_encCtx->priv_data, "profile", "baseline", 0);
-    av_opt_set(m_encCtx->priv_data, "annexb", "1", 0);
+    // Without annexb, x264 writes a 4-byte length before each NAL unit. SPS/PPS stay in-band
+    // because AV_CODEC_FLAG_GLOBAL_HEADER is not set.
+    av_opt_set(m_encCtx->priv_data, "annexb", streamFormat == H264StreamFormat::AVCC ? "0" : "1", 0);
     av_opt_set(m_encCtx->priv_data, "sc_threshold", "0", 0);
+    // Write AV_FRAME_DATA_SEI_UNREGISTERED side data into the bitstream, used for frame metadata
+    av_opt_set(m_encCtx->priv_data, "udu_sei", "1", 0);
+    // Frames forced to AV_PICTURE_TYPE_I by requestKeyframe become IDR frames
+    av_opt_set(m_encCtx->priv_data, "forced-idr", "1", 0);
 
     // Step 7: Open encoder
     if (avcodec_open2(m_encCtx, codec, nullptr) < 0) {
@@ -109,8 +116,9 @@ cleanup:
 }
 
 void H264Encoder::encodeFrame(const uint8_t* y, const uint8_t* u, const uint8_t* v,
-                            size_t y_size, size_t u_size, size_t v_size) {
-    if (!m_encCtx || !m_frame || !m_pkt || !m_writeCallback) {
+                            size_t y_size, size_t u_size, size_t v_size,
+                            const FrameMetadata* metadata) {
+    if (!m_encCtx || !m_frame || !m_pkt || (!m_writeCallback && !m_packetCallback)) {
         fprintf(stderr, "Encoder not initialized\n");
         return;
     }
@@ -120,6 +128,22 @@ void H264Encoder::encodeFrame(const uint8_t* y, const uint8_t* u, const uint8_t*
     memcpy(m_frame->data[1], u, u_size);
     memcpy(m_frame->data[2], v, v_size);
     m_frame->pts = m_ptsCounter++;
+    m_frame->pict_type = m_keyframeRequested ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    m_keyframeRequested = false;
+
+    // The frame is reused, so drop the previous frame's metadata first
+    av_frame_remove_side_data(m_frame, AV_FRAME_DATA_SEI_UNREGISTERED);
+    if (metadata) {
+        uint8_t payload[H264FrameMetadataSEI::kMaxPayloadSize];
+        size_t payloadSize = H264FrameMetadataSEI::writePayload(*metadata, payload);
+        AVFrameSideData* sideData = av_frame_new_side_data(m_frame, AV_FRAME_DATA_SEI_UNREGISTERED, payloadSize);
+        if (sideData) {
+            memcpy(sideData->data, payload, payloadSize);
+        }
+        else {
+            fprintf(stderr, "Failed to attach frame metadata\n");
+        }
+    }
 
     // Send frame to encoder
     if (avcodec_send_frame(m_encCtx, m_frame) < 0) {
@@ -136,11 +160,28 @@ void H264Encoder::encodeFrame(const uint8_t* y, const uint8_t* u, const uint8_t*
             break;
         }
 
-        m_writeCallback(m_pkt->data, m_pkt->size);
+        deliverPacket();
         av_packet_unref(m_pkt);
     }
 }
 
+void H264Encoder::setPacketCallback(AVpacketCallback packetCallback) {
+    m_packetCallback = packetCallback;
+}
+
+void H264Encoder::deliverPacket() {
+    if (m_packetCallback) {
+        m_packetCallback(m_pkt);
+    }
+    else if (m_writeCallback) {
+        m_writeCallback(m_pkt->data, m_pkt->size);
+    }
+}
+
+void H264Encoder::requestKeyframe() {
+    m_keyframeRequested = true;
+}
+
 void H264Encoder::finalize() {
     printf("Finalizing encoder and flushing remaining frames...\n");
     int ret = avcodec_send_frame(m_encCtx, nullptr);
@@ -158,7 +199,7 @@ void H264Encoder::finalize() {
             break;
         }
 
-        m_writeCallback(m_pkt->data, m_pkt->size);
+        deliverPacket();
         av_packet_unref(m_pkt);
     }
     printf("Encoder finalization complete\n");
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <functional>
+#include "H264BitstreamConverter.h"
+#include "H264FrameMetadata.h"
 
 // Forward declarations of required FFmpeg structures
 struct AVCodecContext;
@@ -11,6 +13,8 @@ struct AVPacket;
 
 // Define callback function type
 using AVpacketWriteCallback = std::function<void(const uint8_t* data, size_t size)>;
+// Receives the encoder's refcounted packet, valid for the duration of the call
+using AVpacketCallback = std::function<void(const AVPacket* packet)>;
 
 class H264Encoder {
 private:
@@ -18,13 +22,31 @@ private:
     AVFrame* m_frame;
     AVPacket* m_pkt;
     AVpacketWriteCallback m_writeCallback;
+    AVpacketCallback m_packetCallback;
     int64_t m_ptsCounter;
+    bool m_keyframeRequested;
+
+    // Pass m_pkt to the packet callback, or its data to the write callback
+    void deliverPacket();
 
 public:
-    H264Encoder(int width, int height, AVpacketWriteCallback writeCallback, int fps, int64_t bitrate = 4000000);
+    // streamFormat selects start codes (AnnexB) or 4-byte length prefixes (AVCC) in the output packets
+    H264Encoder(int width, int height, AVpacketWriteCallback writeCallback, int fps, int64_t bitrate = 4000000,
+                H264StreamFormat streamFormat = H264StreamFormat::AnnexB);
 
+    // When metadata is given it is written into the frame's access unit as a
+    // user_data_unregistered SEI message (see H264FrameMetadataSEI)
     void encodeFrame(const uint8_t* y, const uint8_t* u, const uint8_t* v,
-                     size_t y_size, size_t u_size, size_t v_size);
+                     size_t y_size, size_t u_size, size_t v_size,
+                     const FrameMetadata* metadata = nullptr);
+
+    // Hand out the packets themselves instead of calling the write callback, so a consumer can
+    // keep the payload with av_packet_ref instead of copying it. Call before encoding.
+    void setPacketCallback(AVpacketCallback packetCallback);
+
+    // Make the next encoded frame an IDR frame, e.g. after the sender had to drop a reference frame.
+    // Call from the thread that calls encodeFrame.
+    void requestKeyframe();
 
     void finalize();
 
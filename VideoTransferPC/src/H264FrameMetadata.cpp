@@ -0,0 +1,188 @@
+// H264 frame metadata SEI encoding and parsing implementation
+#include "H264FrameMetadata.h"
+#include "H264NALUParser.h"
+#include "H264RBSP.h"
+#include <cstring>
+
+namespace {
+
+const uint8_t kVersion = 1;
+const uint8_t kFlagPose = 0x01;
+const int kSEIUserDataUnregistered = 5;
+
+// SEI messages of interest sit well within this many payload bytes; longer
+// SEI NAL units are only searched up to here
+const size_t kMaxSEIPrefix = 1024;
+
+void writeLE64(uint8_t *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+uint64_t readLE64(const uint8_t *in) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+void writeFloat(uint8_t *out, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (int i = 0; i < 4; i++) {
+    out[i] = static_cast<uint8_t>(bits >> (8 * i));
+  }
+}
+
+float readFloat(const uint8_t *in) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 4; i++) {
+    bits |= static_cast<uint32_t>(in[i]) << (8 * i);
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Walk the sei_message()s of an SEI RBSP (7.3.2.3.1)
+bool findInSEI(const uint8_t *rbsp, size_t size, FrameMetadata &metadata) {
+  size_t pos = 0;
+  while (pos < size && rbsp[pos] != 0x80) {
+    uint32_t payload_type = 0;
+    while (pos < size && rbsp[pos] == 0xFF) {
+      payload_type += 255;
+      pos++;
+    }
+    if (pos >= size) {
+      return false;
+    }
+    payload_type += rbsp[pos++];
+
+    size_t payload_size = 0;
+    while (pos < size && rbsp[pos] == 0xFF) {
+      payload_size += 255;
+      pos++;
+    }
+    if (pos >= size) {
+      return false;
+    }
+    payload_size += rbsp[pos++];
+    if (payload_size > size - pos) {
+      return false;
+    }
+
+    if (payload_type == kSEIUserDataUnregistered &&
+        H264FrameMetadataSEI::readPayload(rbsp + pos, payload_size,
+                                          metadata)) {
+      return true;
+    }
+    pos += payload_size;
+  }
+  return false;
+}
+
+} // namespace
+
+const uint8_t H264FrameMetadataSEI::kUUID[16] = {
+    0xb6, 0xa2, 0xf1, 0xd4, 0x3c, 0x5e, 0x4e, 0x8a,
+    0x9f, 0x17, 0x52, 0xc0, 0xd8, 0xe4, 0xa7, 0xb3};
+
+size_t H264FrameMetadataSEI::writePayload(const FrameMetadata &metadata,
+                                          uint8_t *out) {
+  memcpy(out, kUUID, sizeof(kUUID));
+  uint8_t *p = out + sizeof(kUUID);
+  *p++ = kVersion;
+  *p++ = metadata.hasPose ? kFlagPose : 0;
+  writeLE64(p, metadata.frameId);
+  p += 8;
+  writeLE64(p, static_cast<uint64_t>(metadata.captureTimeUs));
+  p += 8;
+  if (metadata.hasPose) {
+    for (float value : metadata.position) {
+      writeFloat(p, value);
+      p += 4;
+    }
+    for (float value : metadata.orientation) {
+      writeFloat(p, value);
+      p += 4;
+    }
+  }
+  return p - out;
+}
+
+bool H264FrameMetadataSEI::readPayload(const uint8_t *payload, size_t size,
+                                       FrameMetadata &metadata) {
+  const size_t header_size = sizeof(kUUID) + 2 + 8 + 8;
+  if (size < header_size || memcmp(payload, kUUID, sizeof(kUUID)) != 0) {
+    return false;
+  }
+  const uint8_t *p = payload + sizeof(kUUID);
+  // Later versions may only append fields
+  if (p[0] < kVersion) {
+    return false;
+  }
+  const bool has_pose = (p[1] & kFlagPose) != 0;
+  if (has_pose && size < header_size + 7 * 4) {
+    return false;
+  }
+  p += 2;
+
+  metadata = FrameMetadata();
+  metadata.frameId = readLE64(p);
+  p += 8;
+  metadata.captureTimeUs = static_cast<int64_t>(readLE64(p));
+  p += 8;
+  metadata.hasPose = has_pose;
+  if (has_pose) {
+    for (float &value : metadata.position) {
+      value = readFloat(p);
+      p += 4;
+    }
+    for (float &value : metadata.orientation) {
+      value = readFloat(p);
+      p += 4;
+    }
+  }
+  return true;
+}
+
+bool H264FrameMetadataSEI::findInNAL(const uint8_t *nal, size_t size,
+                                     FrameMetadata &metadata) {
+  if (size < 2 || (nal[0] & 0x1F) != H264NALUParser::NAL_SEI) {
+    return false;
+  }
+  uint8_t rbsp[kMaxSEIPrefix];
+  const size_t prefix = (size - 1 < kMaxSEIPrefix) ? size - 1 : kMaxSEIPrefix;
+  return findInSEI(rbsp, H264RBSP::ebspToRbsp(nal + 1, prefix, rbsp), metadata);
+}
+
+bool H264FrameMetadataSEI::findInPacket(const uint8_t *data, size_t size,
+                                        H264StreamFormat format,
+                                        FrameMetadata &metadata) {
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(data, size);
+  }
+
+  auto search = [&](const H264NALUParser::NALUnit &nalu) {
+    return nalu.type == H264NALUParser::NAL_SEI &&
+           findInNAL(nalu.data, nalu.size, metadata);
+  };
+  if (format == H264StreamFormat::AVCC) {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateAVCCNALUs(data, size)) {
+      if (search(nalu)) {
+        return true;
+      }
+    }
+  } else {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateNALUs(data, size)) {
+      if (search(nalu)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
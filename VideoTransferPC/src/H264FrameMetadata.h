@@ -0,0 +1,44 @@
+// Per-frame metadata carried in-band in H264 user_data_unregistered SEI messages
+#pragma once
+
+#include "H264BitstreamConverter.h"
+#include <cstddef>
+#include <cstdint>
+
+// Capture information that travels with each encoded frame. Being part of the
+// bitstream, it survives recording and remuxing (e.g. into MP4), which the
+// length-prefixed TCP framing does not.
+struct FrameMetadata {
+  uint64_t frameId = 0;
+  int64_t captureTimeUs = 0; // Sender clock, microseconds
+  bool hasPose = false;
+  float position[3] = {0.0f, 0.0f, 0.0f};          // Metres
+  float orientation[4] = {0.0f, 0.0f, 0.0f, 1.0f}; // Quaternion x, y, z, w
+};
+
+// Encoding of FrameMetadata as a user_data_unregistered SEI payload (D.1.7):
+// a fixed UUID followed by a version byte, a flags byte, frameId and
+// captureTimeUs, then the pose if present. Integers and floats are little-endian.
+class H264FrameMetadataSEI {
+public:
+  static const uint8_t kUUID[16];
+  // UUID included, with pose
+  static const size_t kMaxPayloadSize = 16 + 2 + 8 + 8 + 7 * 4;
+
+  // Write the payload, UUID first, as FFmpeg expects for
+  // AV_FRAME_DATA_SEI_UNREGISTERED side data. out needs kMaxPayloadSize bytes.
+  // Returns the payload size.
+  static size_t writePayload(const FrameMetadata &metadata, uint8_t *out);
+
+  // Parse a user_data_unregistered payload. Returns false if the UUID is not
+  // ours or the payload is truncated.
+  static bool readPayload(const uint8_t *payload, size_t size,
+                          FrameMetadata &metadata);
+
+  // Look for the metadata in one SEI NAL unit, starting at the NAL header byte
+  static bool findInNAL(const uint8_t *nal, size_t size, FrameMetadata &metadata);
+
+  // Look for the metadata in the SEI NAL units of a packet, without decoding it
+  static bool findInPacket(const uint8_t *data, size_t size,
+                           H264StreamFormat format, FrameMetadata &metadata);
+};
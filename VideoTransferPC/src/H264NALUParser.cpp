@@ -1,8 +1,58 @@
 // H264 NALU parser implementation for analyzing video stream structure
 #include "H264NALUParser.h"
 #include <cstddef>
+#include <cstring>
 #include <stdio.h>
 
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NALU_PARSER_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NALU_PARSER_NEON 1
+#endif
+
+namespace {
+
+#if defined(NALU_PARSER_SSE2) || defined(NALU_PARSER_NEON)
+// Completes a candidate at the first zero pair of the scan, p[0] == p[1] == 0.
+// Returns the start code, or null if the zero run is not followed by 0x01, in
+// which case resume is set to the first byte after the run.
+const uint8_t *matchZeroRun(const uint8_t *start, const uint8_t *p,
+                            const uint8_t *end, const uint8_t *&resume) {
+  const uint8_t *q = p + 2;
+  while (q < end && *q == 0) {
+    q++;
+  }
+  if (q < end && *q == 1) {
+    // Same result as the state machine: 4-byte start code when at least three
+    // zeros of the run lie inside the scanned range
+    return (q - start >= 3 && q[-3] == 0) ? q - 3 : q - 2;
+  }
+  resume = q;
+  return nullptr;
+}
+#endif
+
+template <typename Range>
+H264NALUParser::PacketInfo classifyNALUs(const Range &nalus) {
+  H264NALUParser::PacketInfo info = {false, false, false};
+
+  for (const H264NALUParser::NALUnit &nalu : nalus) {
+    if (nalu.type >= H264NALUParser::NAL_SLICE &&
+        nalu.type <= H264NALUParser::NAL_IDR_SLICE) {
+      info.hasSlice = true;
+      info.hasIDR = info.hasIDR || nalu.type == H264NALUParser::NAL_IDR_SLICE;
+      info.isReference = info.isReference || nalu.refIdc != 0;
+    }
+  }
+
+  return info;
+}
+
+} // namespace
+
 const char *H264NALUParser::getNALUTypeStr(int nal_type) {
   switch (nal_type) {
   case NAL_SLICE:
@@ -46,6 +96,77 @@ const char *H264NALUParser::getNALUTypeStr(int nal_type) {
 
 const uint8_t *H264NALUParser::findStartCode(const uint8_t *p,
                                              const uint8_t *end) {
+  const uint8_t *start = p;
+
+#if defined(NALU_PARSER_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  // Each step tests the 16 pairs p[i], p[i + 1] for i in [p, p + 16)
+  while (end - p >= 17) {
+    __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(current, zero),
+                                               _mm_cmpeq_epi8(next, zero)));
+    if (mask == 0) {
+      p += 16;
+      continue;
+    }
+
+    int offset = 0;
+    while ((mask & (1 << offset)) == 0) {
+      offset++;
+    }
+    const uint8_t *resume = end;
+    const uint8_t *found = matchZeroRun(start, p + offset, end, resume);
+    if (found) {
+      return found;
+    }
+    p = resume;
+  }
+#elif defined(NALU_PARSER_NEON)
+  const uint8x16_t zero = vdupq_n_u8(0);
+  while (end - p >= 17) {
+    uint8x16_t pairs = vandq_u8(vceqq_u8(vld1q_u8(p), zero),
+                                vceqq_u8(vld1q_u8(p + 1), zero));
+    if (vmaxvq_u8(pairs) == 0) {
+      p += 16;
+      continue;
+    }
+
+    int offset = 0;
+    while (p[offset] != 0 || p[offset + 1] != 0) {
+      offset++;
+    }
+    const uint8_t *resume = end;
+    const uint8_t *found = matchZeroRun(start, p + offset, end, resume);
+    if (found) {
+      return found;
+    }
+    p = resume;
+  }
+#else
+  // Without SIMD, let memchr find the 0x01 bytes and check the two bytes before
+  const uint8_t *candidate = p + 2;
+  while (candidate < end) {
+    candidate = static_cast<const uint8_t *>(
+        memchr(candidate, 1, static_cast<size_t>(end - candidate)));
+    if (!candidate) {
+      break;
+    }
+    if (candidate[-1] == 0 && candidate[-2] == 0) {
+      return (candidate - start >= 3 && candidate[-3] == 0) ? candidate - 3
+                                                            : candidate - 2;
+    }
+    candidate++;
+  }
+  p = end;
+#endif
+
+  // No zero pair starts before p, so the state machine can finish the tail
+  return findStartCodeScalar(p, end);
+}
+
+const uint8_t *H264NALUParser::findStartCodeScalar(const uint8_t *p,
+                                                   const uint8_t *end) {
   StartCodeState state = INIT;
 
   while (p < end) {
@@ -93,32 +214,82 @@ const uint8_t *H264NALUParser::findStartCode(const uint8_t *p,
   return end;
 }
 
+H264NALUParser::NALUIterator::NALUIterator(const uint8_t *begin,
+                                           const uint8_t *end)
+    : m_begin(begin), m_end(end), m_next(nullptr), m_unit() {
+  advance(begin);
+}
+
+void H264NALUParser::NALUIterator::advance(const uint8_t *from) {
+  const uint8_t *start_code = from ? findStartCode(from, m_end) : m_end;
+  // A start code needs at least the NAL header byte after it
+  uint8_t start_code_length = 0;
+  if (start_code < m_end) {
+    start_code_length = (start_code[2] == 0) ? 4 : 3;
+  }
+  if (start_code >= m_end || m_end - start_code <= start_code_length) {
+    m_unit = NALUnit();
+    m_next = nullptr;
+    return;
+  }
+
+  const uint8_t *nal_start = start_code + start_code_length;
+  m_next = findStartCode(nal_start, m_end);
+
+  m_unit.data = nal_start;
+  m_unit.offset = static_cast<size_t>(nal_start - m_begin);
+  m_unit.size = static_cast<size_t>(m_next - nal_start);
+  m_unit.startCodeLength = start_code_length;
+  m_unit.type = nal_start[0] & 0x1F;
+  m_unit.refIdc = (nal_start[0] >> 5) & 0x03;
+}
+
 void H264NALUParser::analyzeNALUs(const uint8_t *data, size_t size) {
-  const uint8_t *end = data + size;
   int count = 0;
 
-  // Find start code
-  const uint8_t *nal_start = findStartCode(data, end);
-  while (nal_start < end) {
-    // Check if it's 3-byte or 4-byte start code
-    if (*(nal_start + 2) == 0) { // If the third byte is 0
-      nal_start += 4;            // It's a 4-byte start code, skip 4 bytes
-    } else {
-      nal_start += 3; // Otherwise it's a 3-byte start code, skip 3 bytes
-    }
+  for (const NALUnit &nalu : enumerateNALUs(data, size)) {
+    printf("NALU %d: Type=0x%02X (%d, %s), Size=%zu bytes\n", count++,
+           nalu.data[0], nalu.type, getNALUTypeStr(nalu.type), nalu.size);
+  }
 
-    // Get NALU type
-    uint8_t nal_type = nal_start[0] & 0x1F;
+  printf("Total NALUs: %d\n", count);
+}
 
-    // Find next start code to calculate NALU size
-    const uint8_t *next_nal = findStartCode(nal_start, end);
-    size_t nal_size = next_nal - nal_start;
+H264NALUParser::AVCCIterator::AVCCIterator(const uint8_t *begin,
+                                           const uint8_t *end)
+    : m_begin(begin), m_end(end), m_unit() {
+  advance(begin);
+}
 
-    printf("NALU %d: Type=0x%02X (%d, %s), Size=%zu bytes\n", count++,
-           nal_start[0], nal_type, getNALUTypeStr(nal_type), nal_size);
+void H264NALUParser::AVCCIterator::advance(const uint8_t *from) {
+  if (!from || m_end - from < 5) {
+    m_unit = NALUnit();
+    return;
+  }
 
-    nal_start = next_nal;
+  const size_t nal_size = (static_cast<size_t>(from[0]) << 24) |
+                          (static_cast<size_t>(from[1]) << 16) |
+                          (static_cast<size_t>(from[2]) << 8) | from[3];
+  const uint8_t *nal_start = from + 4;
+  if (nal_size == 0 || nal_size > static_cast<size_t>(m_end - nal_start)) {
+    m_unit = NALUnit();
+    return;
   }
 
-  printf("Total NALUs: %d\n", count);
+  m_unit.data = nal_start;
+  m_unit.offset = static_cast<size_t>(nal_start - m_begin);
+  m_unit.size = nal_size;
+  m_unit.startCodeLength = 4;
+  m_unit.type = nal_start[0] & 0x1F;
+  m_unit.refIdc = (nal_start[0] >> 5) & 0x03;
+}
+
+H264NALUParser::PacketInfo H264NALUParser::classifyPacket(const uint8_t *data,
+                                                          size_t size) {
+  return classifyNALUs(enumerateNALUs(data, size));
+}
+
+H264NALUParser::PacketInfo
+H264NALUParser::classifyAVCCPacket(const uint8_t *data, size_t size) {
+  return classifyNALUs(enumerateAVCCNALUs(data, size));
 }
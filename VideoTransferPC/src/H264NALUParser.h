@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 
 class H264NALUParser {
 public:
@@ -38,12 +39,162 @@ private:
   };
 
 public:
+  // Summary of the coded slices contained in one packet
+  struct PacketInfo {
+    bool hasSlice;    // Contains at least one coded slice
+    bool hasIDR;      // Contains an IDR slice
+    bool isReference; // At least one slice has nal_ref_idc != 0
+  };
+
+  // Location and header fields of one NAL unit inside an Annex-B buffer
+  struct NALUnit {
+    const uint8_t *data;     // NAL header byte, points into the scanned buffer
+    size_t offset;           // Offset of the NAL header byte from the buffer start
+    size_t size;             // Size from the NAL header byte up to the next start code
+    uint8_t startCodeLength; // 3 or 4
+    uint8_t type;            // nal_unit_type
+    uint8_t refIdc;          // nal_ref_idc
+  };
+
+  // Forward iterator over the NAL units of a buffer. It only holds pointers into
+  // the buffer, so iterating allocates nothing.
+  class NALUIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = NALUnit;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const NALUnit *;
+    using reference = const NALUnit &;
+
+    // End iterator
+    NALUIterator() : m_begin(nullptr), m_end(nullptr), m_next(nullptr), m_unit() {}
+    NALUIterator(const uint8_t *begin, const uint8_t *end);
+
+    reference operator*() const { return m_unit; }
+    pointer operator->() const { return &m_unit; }
+
+    NALUIterator &operator++() {
+      advance(m_next);
+      return *this;
+    }
+    NALUIterator operator++(int) {
+      NALUIterator previous = *this;
+      advance(m_next);
+      return previous;
+    }
+
+    bool operator==(const NALUIterator &other) const {
+      return m_unit.data == other.m_unit.data;
+    }
+    bool operator!=(const NALUIterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    void advance(const uint8_t *from);
+
+    const uint8_t *m_begin;
+    const uint8_t *m_end;
+    const uint8_t *m_next; // Start code following the current unit
+    NALUnit m_unit;        // data is null once the iteration is done
+  };
+
+  // Range over the NAL units of a buffer, for use with range-for
+  class NALURange {
+  public:
+    NALURange(const uint8_t *data, size_t size)
+        : m_data(data), m_size(size) {}
+    NALUIterator begin() const { return NALUIterator(m_data, m_data + m_size); }
+    NALUIterator end() const { return NALUIterator(); }
+
+  private:
+    const uint8_t *m_data;
+    size_t m_size;
+  };
+
+  // Forward iterator over a buffer of NAL units with 4-byte big-endian length
+  // prefixes (AVCC). Each step reads one length field, so no bytes are scanned.
+  // Iteration stops at a length that runs past the end of the buffer.
+  class AVCCIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = NALUnit;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const NALUnit *;
+    using reference = const NALUnit &;
+
+    // End iterator
+    AVCCIterator() : m_begin(nullptr), m_end(nullptr), m_unit() {}
+    AVCCIterator(const uint8_t *begin, const uint8_t *end);
+
+    reference operator*() const { return m_unit; }
+    pointer operator->() const { return &m_unit; }
+
+    AVCCIterator &operator++() {
+      advance(m_unit.data + m_unit.size);
+      return *this;
+    }
+    AVCCIterator operator++(int) {
+      AVCCIterator previous = *this;
+      advance(m_unit.data + m_unit.size);
+      return previous;
+    }
+
+    bool operator==(const AVCCIterator &other) const {
+      return m_unit.data == other.m_unit.data;
+    }
+    bool operator!=(const AVCCIterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    void advance(const uint8_t *from);
+
+    const uint8_t *m_begin;
+    const uint8_t *m_end;
+    NALUnit m_unit; // data is null once the iteration is done
+  };
+
+  class AVCCRange {
+  public:
+    AVCCRange(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+    AVCCIterator begin() const { return AVCCIterator(m_data, m_data + m_size); }
+    AVCCIterator end() const { return AVCCIterator(); }
+
+  private:
+    const uint8_t *m_data;
+    size_t m_size;
+  };
+
+  // Enumerate the NAL units of an Annex-B buffer:
+  //   for (const auto &nalu : H264NALUParser::enumerateNALUs(data, size)) { ... }
+  static NALURange enumerateNALUs(const uint8_t *data, size_t size) {
+    return NALURange(data, size);
+  }
+
+  // Enumerate the NAL units of a length-prefixed (AVCC) buffer.
+  // NALUnit::startCodeLength is the size of the length prefix.
+  static AVCCRange enumerateAVCCNALUs(const uint8_t *data, size_t size) {
+    return AVCCRange(data, size);
+  }
+
   // Get string description of NALU type
   static const char *getNALUTypeStr(int nal_type);
 
-  // Find start code
+  // Find start code. Returns the first byte of the next 3- or 4-byte start code
+  // at or after p, or end if there is none. Checks 16 bytes per step for zero
+  // pairs with SSE2 or NEON.
   static const uint8_t *findStartCode(const uint8_t *p, const uint8_t *end);
 
+  // Byte-at-a-time reference implementation of findStartCode
+  static const uint8_t *findStartCodeScalar(const uint8_t *p,
+                                            const uint8_t *end);
+
   // Analyze NALU
   static void analyzeNALUs(const uint8_t *data, size_t size);
+
+  // Classify the slices of an Annex-B packet without decoding it
+  static PacketInfo classifyPacket(const uint8_t *data, size_t size);
+  // Same for a packet of length-prefixed NAL units
+  static PacketInfo classifyAVCCPacket(const uint8_t *data, size_t size);
 };
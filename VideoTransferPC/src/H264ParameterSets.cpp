@@ -0,0 +1,397 @@
+// H264 parameter set parser and cache implementation
+#include "H264ParameterSets.h"
+#include "H264RBSP.h"
+#include <algorithm>
+
+namespace {
+
+void skipScalingList(H264BitReader &reader, int size) {
+  int last_scale = 8;
+  int next_scale = 8;
+  for (int j = 0; j < size; j++) {
+    if (next_scale != 0) {
+      int delta_scale = reader.readSE();
+      next_scale = (last_scale + delta_scale + 256) % 256;
+    }
+    last_scale = (next_scale == 0) ? last_scale : next_scale;
+  }
+}
+
+bool hasChromaFormatSyntax(int profile_idc) {
+  switch (profile_idc) {
+  case 100:
+  case 110:
+  case 122:
+  case 244:
+  case 44:
+  case 83:
+  case 86:
+  case 118:
+  case 128:
+  case 138:
+  case 139:
+  case 134:
+  case 135:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Trailing zero bytes before a 3-byte start code belong to the byte stream, not the NAL unit
+size_t trimTrailingZeros(const uint8_t *data, size_t size) {
+  while (size > 0 && data[size - 1] == 0) {
+    size--;
+  }
+  return size;
+}
+
+bool sameNAL(const std::vector<uint8_t> &stored, bool valid,
+             const uint8_t *data, size_t size) {
+  return valid && stored.size() == size &&
+         std::equal(data, data + size, stored.begin());
+}
+
+const uint8_t kStartCode[4] = {0, 0, 0, 1};
+
+} // namespace
+
+bool H264ParameterSets::parseSPS(const uint8_t *nal, size_t size,
+                                 H264SPS &sps) {
+  if (size < 4 || (nal[0] & 0x1F) != H264NALUParser::NAL_SPS) {
+    return false;
+  }
+
+  std::vector<uint8_t> rbsp;
+  H264RBSP::ebspToRbsp(nal + 1, size - 1, rbsp);
+  H264BitReader reader(rbsp.data(), rbsp.size());
+
+  sps = H264SPS();
+  sps.profileIdc = reader.readBits(8);
+  sps.constraintFlags = reader.readBits(8);
+  sps.levelIdc = reader.readBits(8);
+  uint32_t sps_id = reader.readUE();
+  if (sps_id >= ParameterSetCache::kMaxSPS) {
+    return false;
+  }
+  sps.id = static_cast<int>(sps_id);
+
+  sps.chromaFormatIdc = 1;
+  sps.bitDepthLuma = 8;
+  sps.bitDepthChroma = 8;
+  if (hasChromaFormatSyntax(sps.profileIdc)) {
+    uint32_t chroma_format_idc = reader.readUE();
+    if (chroma_format_idc > 3) {
+      return false;
+    }
+    sps.chromaFormatIdc = static_cast<int>(chroma_format_idc);
+    if (sps.chromaFormatIdc == 3) {
+      sps.separateColourPlane = reader.readFlag();
+    }
+    sps.bitDepthLuma = reader.readUE() + 8;
+    sps.bitDepthChroma = reader.readUE() + 8;
+    reader.readFlag(); // qpprime_y_zero_transform_bypass_flag
+    if (reader.readFlag()) { // seq_scaling_matrix_present_flag
+      int lists = (sps.chromaFormatIdc != 3) ? 8 : 12;
+      for (int i = 0; i < lists; i++) {
+        if (reader.readFlag()) {
+          skipScalingList(reader, i < 6 ? 16 : 64);
+        }
+      }
+    }
+  }
+
+  uint32_t log2_max_frame_num = reader.readUE() + 4;
+  if (log2_max_frame_num > 16) {
+    return false;
+  }
+  sps.log2MaxFrameNum = static_cast<int>(log2_max_frame_num);
+  sps.picOrderCntType = reader.readUE();
+  if (sps.picOrderCntType == 0) {
+    uint32_t log2_max_poc_lsb = reader.readUE() + 4;
+    if (log2_max_poc_lsb > 16) {
+      return false;
+    }
+    sps.log2MaxPicOrderCntLsb = static_cast<int>(log2_max_poc_lsb);
+  } else if (sps.picOrderCntType == 1) {
+    sps.deltaPicOrderAlwaysZero = reader.readFlag();
+    reader.readSE(); // offset_for_non_ref_pic
+    reader.readSE(); // offset_for_top_to_bottom_field
+    uint32_t cycle = reader.readUE();
+    if (cycle > 255) {
+      return false;
+    }
+    for (uint32_t i = 0; i < cycle; i++) {
+      reader.readSE(); // offset_for_ref_frame
+    }
+  } else if (sps.picOrderCntType != 2) {
+    return false;
+  }
+
+  sps.maxNumRefFrames = reader.readUE();
+  sps.gapsInFrameNumAllowed = reader.readFlag();
+  sps.widthInMbs = reader.readUE() + 1;
+  sps.heightInMapUnits = reader.readUE() + 1;
+  sps.frameMbsOnly = reader.readFlag();
+  if (!sps.frameMbsOnly) {
+    reader.readFlag(); // mb_adaptive_frame_field_flag
+  }
+  reader.readFlag(); // direct_8x8_inference_flag
+
+  int crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+  if (reader.readFlag()) { // frame_cropping_flag
+    crop_left = reader.readUE();
+    crop_right = reader.readUE();
+    crop_top = reader.readUE();
+    crop_bottom = reader.readUE();
+  }
+  // VUI parameters are not needed and are left unread
+
+  if (reader.overrun()) {
+    return false;
+  }
+
+  // Cropping units depend on the chroma subsampling (7.4.2.1.1)
+  const int chroma_array_type =
+      sps.separateColourPlane ? 0 : sps.chromaFormatIdc;
+  const int sub_width_c = (sps.chromaFormatIdc == 3) ? 1 : 2;
+  const int sub_height_c = (sps.chromaFormatIdc == 1) ? 2 : 1;
+  const int crop_unit_x = (chroma_array_type == 0) ? 1 : sub_width_c;
+  const int crop_unit_y = ((chroma_array_type == 0) ? 1 : sub_height_c) *
+                          (sps.frameMbsOnly ? 1 : 2);
+
+  sps.cropLeft = crop_left * crop_unit_x;
+  sps.cropRight = crop_right * crop_unit_x;
+  sps.cropTop = crop_top * crop_unit_y;
+  sps.cropBottom = crop_bottom * crop_unit_y;
+  sps.width = sps.widthInMbs * 16 - sps.cropLeft - sps.cropRight;
+  sps.height = sps.heightInMapUnits * (sps.frameMbsOnly ? 1 : 2) * 16 -
+               sps.cropTop - sps.cropBottom;
+  return sps.width > 0 && sps.height > 0;
+}
+
+bool H264ParameterSets::parsePPS(const uint8_t *nal, size_t size,
+                                 H264PPS &pps) {
+  if (size < 2 || (nal[0] & 0x1F) != H264NALUParser::NAL_PPS) {
+    return false;
+  }
+
+  std::vector<uint8_t> rbsp;
+  H264RBSP::ebspToRbsp(nal + 1, size - 1, rbsp);
+  H264BitReader reader(rbsp.data(), rbsp.size());
+
+  pps = H264PPS();
+  uint32_t pps_id = reader.readUE();
+  uint32_t sps_id = reader.readUE();
+  if (pps_id >= ParameterSetCache::kMaxPPS ||
+      sps_id >= ParameterSetCache::kMaxSPS) {
+    return false;
+  }
+  pps.id = static_cast<int>(pps_id);
+  pps.spsId = static_cast<int>(sps_id);
+  pps.entropyCodingMode = reader.readFlag();
+  pps.bottomFieldPicOrderInFramePresent = reader.readFlag();
+  uint32_t num_slice_groups = reader.readUE() + 1;
+  if (num_slice_groups > 8) {
+    return false;
+  }
+  pps.numSliceGroups = static_cast<int>(num_slice_groups);
+  if (pps.numSliceGroups > 1) {
+    uint32_t map_type = reader.readUE();
+    if (map_type == 0) {
+      for (int i = 0; i < pps.numSliceGroups; i++) {
+        reader.readUE(); // run_length_minus1
+      }
+    } else if (map_type == 2) {
+      for (int i = 0; i < pps.numSliceGroups - 1; i++) {
+        reader.readUE(); // top_left
+        reader.readUE(); // bottom_right
+      }
+    } else if (map_type >= 3 && map_type <= 5) {
+      reader.readFlag(); // slice_group_change_direction_flag
+      reader.readUE();   // slice_group_change_rate_minus1
+    } else if (map_type == 6) {
+      uint32_t map_units = reader.readUE() + 1;
+      int bits = 0;
+      while ((1 << bits) < pps.numSliceGroups) {
+        bits++;
+      }
+      reader.skipBits(static_cast<size_t>(map_units) * bits);
+    }
+  }
+  pps.numRefIdxL0DefaultActive = reader.readUE() + 1;
+  pps.numRefIdxL1DefaultActive = reader.readUE() + 1;
+  pps.weightedPred = reader.readFlag();
+  pps.weightedBipredIdc = reader.readBits(2);
+  pps.picInitQp = 26 + reader.readSE();
+  reader.readSE(); // pic_init_qs_minus26
+  pps.chromaQpIndexOffset = reader.readSE();
+  pps.deblockingFilterControlPresent = reader.readFlag();
+  pps.constrainedIntraPred = reader.readFlag();
+  pps.redundantPicCntPresent = reader.readFlag();
+  return !reader.overrun();
+}
+
+bool ParameterSetCache::update(const uint8_t *data, size_t size,
+                               H264StreamFormat format) {
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(data, size);
+  }
+
+  bool changed = false;
+  if (format == H264StreamFormat::AVCC) {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateAVCCNALUs(data, size)) {
+      changed = store(nalu) || changed;
+    }
+  } else {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateNALUs(data, size)) {
+      changed = store(nalu) || changed;
+    }
+  }
+  return changed;
+}
+
+bool ParameterSetCache::store(const H264NALUParser::NALUnit &nalu) {
+  bool changed = false;
+  if (nalu.type != H264NALUParser::NAL_SPS &&
+      nalu.type != H264NALUParser::NAL_PPS) {
+    return false;
+  }
+  const size_t nal_size = trimTrailingZeros(nalu.data, nalu.size);
+
+  if (nalu.type == H264NALUParser::NAL_SPS) {
+    H264SPS sps;
+    if (!H264ParameterSets::parseSPS(nalu.data, nal_size, sps)) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &entry = m_spsNal[sps.id];
+    if (!sameNAL(entry.nal, entry.valid, nalu.data, nal_size)) {
+      m_spsCount += entry.valid ? 0 : 1;
+      entry.nal.assign(nalu.data, nalu.data + nal_size);
+      entry.valid = true;
+      m_sps[sps.id] = sps;
+      changed = true;
+    }
+    m_activeSPS = sps.id;
+  } else {
+    H264PPS pps;
+    if (!H264ParameterSets::parsePPS(nalu.data, nal_size, pps)) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &entry = m_ppsNal[pps.id];
+    if (!sameNAL(entry.nal, entry.valid, nalu.data, nal_size)) {
+      m_ppsCount += entry.valid ? 0 : 1;
+      entry.nal.assign(nalu.data, nalu.data + nal_size);
+      entry.valid = true;
+      m_pps[pps.id] = pps;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool ParameterSetCache::hasParameterSets() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_spsCount > 0 && m_ppsCount > 0;
+}
+
+bool ParameterSetCache::getActiveSPS(H264SPS &sps) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_activeSPS < 0) {
+    return false;
+  }
+  sps = m_sps[m_activeSPS];
+  return true;
+}
+
+bool ParameterSetCache::getSPS(int id, H264SPS &sps) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (id < 0 || id >= kMaxSPS || !m_spsNal[id].valid) {
+    return false;
+  }
+  sps = m_sps[id];
+  return true;
+}
+
+bool ParameterSetCache::getPPS(int id, H264PPS &pps) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (id < 0 || id >= kMaxPPS || !m_ppsNal[id].valid) {
+    return false;
+  }
+  pps = m_pps[id];
+  return true;
+}
+
+void ParameterSetCache::appendParameterSets(std::vector<uint8_t> &out) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const Entry &entry : m_spsNal) {
+    if (entry.valid) {
+      out.insert(out.end(), kStartCode, kStartCode + 4);
+      out.insert(out.end(), entry.nal.begin(), entry.nal.end());
+    }
+  }
+  for (const Entry &entry : m_ppsNal) {
+    if (entry.valid) {
+      out.insert(out.end(), kStartCode, kStartCode + 4);
+      out.insert(out.end(), entry.nal.begin(), entry.nal.end());
+    }
+  }
+}
+
+bool ParameterSetCache::getIDRPrefix(const uint8_t *data, size_t size,
+                                     std::vector<uint8_t> &prefix,
+                                     H264StreamFormat format) const {
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(data, size);
+  }
+
+  bool has_idr = false;
+  bool has_sps = false;
+  bool has_pps = false;
+  auto check = [&](const H264NALUParser::NALUnit &nalu) {
+    has_idr = has_idr || nalu.type == H264NALUParser::NAL_IDR_SLICE;
+    has_sps = has_sps || nalu.type == H264NALUParser::NAL_SPS;
+    has_pps = has_pps || nalu.type == H264NALUParser::NAL_PPS;
+  };
+  if (format == H264StreamFormat::AVCC) {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateAVCCNALUs(data, size)) {
+      check(nalu);
+    }
+  } else {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateNALUs(data, size)) {
+      check(nalu);
+    }
+  }
+  if (!has_idr || (has_sps && has_pps) || !hasParameterSets()) {
+    return false;
+  }
+
+  prefix.clear();
+  appendParameterSets(prefix);
+  if (format == H264StreamFormat::AVCC) {
+    // The stored sets are written with 4-byte start codes, so this always succeeds
+    H264BitstreamConverter::annexBToAVCCInPlace(prefix.data(), prefix.size());
+  }
+  return true;
+}
+
+void ParameterSetCache::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (Entry &entry : m_spsNal) {
+    entry.nal.clear();
+    entry.valid = false;
+  }
+  for (Entry &entry : m_ppsNal) {
+    entry.nal.clear();
+    entry.valid = false;
+  }
+  m_activeSPS = -1;
+  m_spsCount = 0;
+  m_ppsCount = 0;
+}
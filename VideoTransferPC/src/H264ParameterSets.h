@@ -0,0 +1,113 @@
+// H264 parameter set parser and cache for SPS/PPS handling
+#pragma once
+
+#include "H264BitstreamConverter.h"
+#include "H264NALUParser.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fields of a sequence parameter set needed to configure decoders and parse slice headers
+struct H264SPS {
+  int id;
+  int profileIdc;
+  int constraintFlags; // constraint_set0..5 flags as transmitted
+  int levelIdc;
+  int chromaFormatIdc;
+  bool separateColourPlane;
+  int bitDepthLuma;
+  int bitDepthChroma;
+  int log2MaxFrameNum;
+  int picOrderCntType;
+  int log2MaxPicOrderCntLsb; // Only for picOrderCntType 0
+  bool deltaPicOrderAlwaysZero;
+  int maxNumRefFrames;
+  bool gapsInFrameNumAllowed;
+  bool frameMbsOnly;
+  int widthInMbs;
+  int heightInMapUnits;
+  int cropLeft; // Frame cropping offsets in samples
+  int cropRight;
+  int cropTop;
+  int cropBottom;
+  int width; // Displayed size after cropping
+  int height;
+};
+
+// Fields of a picture parameter set needed to parse slice headers
+struct H264PPS {
+  int id;
+  int spsId;
+  bool entropyCodingMode; // CABAC
+  bool bottomFieldPicOrderInFramePresent;
+  int numSliceGroups;
+  int numRefIdxL0DefaultActive;
+  int numRefIdxL1DefaultActive;
+  bool weightedPred;
+  int weightedBipredIdc;
+  int picInitQp;
+  int chromaQpIndexOffset;
+  bool deblockingFilterControlPresent;
+  bool constrainedIntraPred;
+  bool redundantPicCntPresent;
+};
+
+class H264ParameterSets {
+public:
+  // Parse an SPS or PPS NAL unit, starting at the NAL header byte.
+  // Returns false if the data is truncated or uses unsupported syntax.
+  static bool parseSPS(const uint8_t *nal, size_t size, H264SPS &sps);
+  static bool parsePPS(const uint8_t *nal, size_t size, H264PPS &pps);
+};
+
+// Per-stream store of the latest SPS/PPS, indexed by id. The sets are kept as
+// transmitted so they can be sent again ahead of an IDR frame or to a decoder
+// that joins the stream late. Safe to use from several threads.
+class ParameterSetCache {
+public:
+  static const int kMaxSPS = 32;
+  static const int kMaxPPS = 256;
+
+  // Store the SPS/PPS NAL units of a packet.
+  // Returns true if a stored set was added or changed.
+  bool update(const uint8_t *data, size_t size,
+              H264StreamFormat format = H264StreamFormat::AnnexB);
+
+  // True once at least one SPS and one PPS have been stored
+  bool hasParameterSets() const;
+
+  // Parsed form of the most recently received SPS
+  bool getActiveSPS(H264SPS &sps) const;
+  bool getSPS(int id, H264SPS &sps) const;
+  bool getPPS(int id, H264PPS &pps) const;
+
+  // Append all stored SPS and PPS NAL units with 4-byte start codes
+  void appendParameterSets(std::vector<uint8_t> &out) const;
+
+  // If the packet holds an IDR slice but no parameter sets of its own, fill
+  // prefix with the stored sets to send ahead of it and return true.
+  // The sets are framed the same way as the packet.
+  bool getIDRPrefix(const uint8_t *data, size_t size,
+                    std::vector<uint8_t> &prefix,
+                    H264StreamFormat format = H264StreamFormat::AnnexB) const;
+
+  void clear();
+
+private:
+  bool store(const H264NALUParser::NALUnit &nalu);
+
+  struct Entry {
+    std::vector<uint8_t> nal; // Without start code
+    bool valid = false;
+  };
+
+  mutable std::mutex m_mutex;
+  Entry m_spsNal[kMaxSPS];
+  H264SPS m_sps[kMaxSPS];
+  Entry m_ppsNal[kMaxPPS];
+  H264PPS m_pps[kMaxPPS];
+  int m_activeSPS = -1;
+  int m_spsCount = 0;
+  int m_ppsCount = 0;
+};
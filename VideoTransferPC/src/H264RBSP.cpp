@@ -0,0 +1,263 @@
+// H264 RBSP utilities implementation with SSE2 and NEON fast paths
+#include "H264RBSP.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RBSP_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RBSP_NEON 1
+#endif
+
+namespace {
+
+#if defined(RBSP_SSE2)
+// True if any of the pairs p[i], p[i + 1] for i in [0, 16) is 00 00. Reads 17 bytes.
+inline bool hasZeroPair(const uint8_t *p) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+  return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(current, zero),
+                                         _mm_cmpeq_epi8(next, zero))) != 0;
+}
+#elif defined(RBSP_NEON)
+inline bool hasZeroPair(const uint8_t *p) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  uint8x16_t pairs = vandq_u8(vceqq_u8(vld1q_u8(p), zero),
+                              vceqq_u8(vld1q_u8(p + 1), zero));
+  return vmaxvq_u8(pairs) != 0;
+}
+#endif
+
+// Emulation prevention only ever involves zero pairs. A 16-byte block with no
+// pair, entered with no pending zeros, is copied as is. A zero at the end of
+// such a block is always followed by a non-zero byte, so no state carries over.
+#if defined(RBSP_SSE2) || defined(RBSP_NEON)
+#define RBSP_SIMD 1
+#endif
+
+inline void removeStep(const uint8_t *src, size_t &i, uint8_t *dst,
+                       size_t &out, int &zeros) {
+  uint8_t value = src[i++];
+  if (zeros >= 2 && value == 3) {
+    zeros = 0;
+    return;
+  }
+  zeros = (value == 0) ? zeros + 1 : 0;
+  dst[out++] = value;
+}
+
+inline void insertStep(const uint8_t *src, size_t &i, uint8_t *dst,
+                       size_t &out, int &zeros) {
+  uint8_t value = src[i++];
+  if (zeros >= 2 && value <= 3) {
+    dst[out++] = 3;
+    zeros = 0;
+  }
+  dst[out++] = value;
+  zeros = (value == 0) ? zeros + 1 : 0;
+}
+
+} // namespace
+
+size_t H264RBSP::ebspToRbsp(const uint8_t *src, size_t size, uint8_t *dst) {
+  size_t i = 0;
+  size_t out = 0;
+  int zeros = 0;
+#if defined(RBSP_SIMD)
+  while (size - i >= 17) {
+    if (zeros == 0 && !hasZeroPair(src + i)) {
+      // dst may alias src, the output never runs ahead of the input
+      memmove(dst + out, src + i, 16);
+      out += 16;
+      i += 16;
+      continue;
+    }
+    const size_t block_end = i + 16;
+    while (i < block_end) {
+      removeStep(src, i, dst, out, zeros);
+    }
+  }
+#endif
+  while (i < size) {
+    removeStep(src, i, dst, out, zeros);
+  }
+  return out;
+}
+
+void H264RBSP::ebspToRbsp(const uint8_t *src, size_t size,
+                          std::vector<uint8_t> &rbsp) {
+  rbsp.resize(size);
+  rbsp.resize(ebspToRbsp(src, size, rbsp.data()));
+}
+
+size_t H264RBSP::rbspToEbsp(const uint8_t *src, size_t size, uint8_t *dst) {
+  size_t i = 0;
+  size_t out = 0;
+  int zeros = 0;
+#if defined(RBSP_SIMD)
+  while (size - i >= 17) {
+    if (zeros == 0 && !hasZeroPair(src + i)) {
+      memcpy(dst + out, src + i, 16);
+      out += 16;
+      i += 16;
+      continue;
+    }
+    const size_t block_end = i + 16;
+    while (i < block_end) {
+      insertStep(src, i, dst, out, zeros);
+    }
+  }
+#endif
+  while (i < size) {
+    insertStep(src, i, dst, out, zeros);
+  }
+  // A payload ending in 00 00 (cabac_zero_word) gets a final 0x03 (7.4.1)
+  if (zeros >= 2) {
+    dst[out++] = 3;
+  }
+  return out;
+}
+
+void H264RBSP::rbspToEbsp(const uint8_t *src, size_t size,
+                          std::vector<uint8_t> &ebsp) {
+  ebsp.resize(maxEbspSize(size));
+  ebsp.resize(rbspToEbsp(src, size, ebsp.data()));
+}
+
+size_t H264RBSP::ebspToRbspScalar(const uint8_t *src, size_t size,
+                                  uint8_t *dst) {
+  size_t i = 0;
+  size_t out = 0;
+  int zeros = 0;
+  while (i < size) {
+    removeStep(src, i, dst, out, zeros);
+  }
+  return out;
+}
+
+size_t H264RBSP::rbspToEbspScalar(const uint8_t *src, size_t size,
+                                  uint8_t *dst) {
+  size_t i = 0;
+  size_t out = 0;
+  int zeros = 0;
+  while (i < size) {
+    insertStep(src, i, dst, out, zeros);
+  }
+  if (zeros >= 2) {
+    dst[out++] = 3;
+  }
+  return out;
+}
+
+uint32_t H264BitReader::readBits(int count) {
+  uint32_t value = 0;
+  while (count > 0) {
+    if (m_pos >= m_size * 8) {
+      m_overrun = true;
+      return count >= 32 ? 0 : value << count;
+    }
+    const int bit_offset = static_cast<int>(m_pos & 7);
+    const int available = 8 - bit_offset;
+    const int take = count < available ? count : available;
+    const uint32_t bits =
+        (m_data[m_pos >> 3] >> (available - take)) & ((1u << take) - 1);
+    value = (value << take) | bits;
+    count -= take;
+    m_pos += take;
+  }
+  return value;
+}
+
+uint32_t H264BitReader::readUE() {
+  int leading_zeros = 0;
+  while (readBits(1) == 0) {
+    if (m_overrun || ++leading_zeros > 31) {
+      m_overrun = true;
+      return 0;
+    }
+  }
+  if (leading_zeros == 0) {
+    return 0;
+  }
+  return ((1u << leading_zeros) - 1) + readBits(leading_zeros);
+}
+
+int32_t H264BitReader::readSE() {
+  uint32_t value = readUE();
+  if (value & 1) {
+    return static_cast<int32_t>((value + 1) / 2);
+  }
+  return -static_cast<int32_t>(value / 2);
+}
+
+void H264BitReader::skipBits(size_t count) {
+  m_pos += count;
+  if (m_pos > m_size * 8) {
+    m_pos = m_size * 8;
+    m_overrun = true;
+  }
+}
+
+bool H264BitReader::moreRbspData() const {
+  // The last set bit of the payload is the rbsp_stop_one_bit
+  size_t last = m_size;
+  while (last > 0 && m_data[last - 1] == 0) {
+    last--;
+  }
+  if (last == 0) {
+    return false;
+  }
+  const uint8_t final_byte = m_data[last - 1];
+  int trailing = 0;
+  while (((final_byte >> trailing) & 1) == 0) {
+    trailing++;
+  }
+  const size_t stop_bit_pos = last * 8 - 1 - trailing;
+  return m_pos < stop_bit_pos;
+}
+
+void H264BitWriter::writeBits(uint32_t value, int count) {
+  for (int i = count - 1; i >= 0; i--) {
+    if ((m_bitCount & 7) == 0) {
+      m_data.push_back(0);
+    }
+    if ((value >> i) & 1) {
+      m_data.back() |= static_cast<uint8_t>(0x80 >> (m_bitCount & 7));
+    }
+    m_bitCount++;
+  }
+}
+
+void H264BitWriter::writeUE(uint32_t value) {
+  // Values up to 2^32 - 2, the largest H264BitReader::readUE accepts
+  const uint64_t code = static_cast<uint64_t>(value) + 1;
+  int bits = 0;
+  while ((code >> (bits + 1)) != 0) {
+    bits++;
+  }
+  writeBits(0, bits);
+  if (bits + 1 > 32) {
+    writeBits(static_cast<uint32_t>(code >> 32), bits + 1 - 32);
+    writeBits(static_cast<uint32_t>(code), 32);
+  } else {
+    writeBits(static_cast<uint32_t>(code), bits + 1);
+  }
+}
+
+void H264BitWriter::writeSE(int32_t value) {
+  if (value > 0) {
+    writeUE(static_cast<uint32_t>(value) * 2 - 1);
+  } else {
+    writeUE(static_cast<uint32_t>(-static_cast<int64_t>(value)) * 2);
+  }
+}
+
+void H264BitWriter::writeTrailingBits() {
+  writeBits(1, 1);
+  while (!byteAligned()) {
+    writeBits(0, 1);
+  }
+}
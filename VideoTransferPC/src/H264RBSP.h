@@ -0,0 +1,89 @@
+// H264 RBSP utilities: emulation prevention handling and bit-level reading/writing
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Conversion between the raw byte sequence payload (RBSP) and the encapsulated
+// form carried in NAL units (EBSP), where every 00 00 0x sequence with x <= 3
+// is broken up by an emulation prevention byte 0x03. Stretches without a zero
+// pair are copied 16 bytes at a time using SSE2 or NEON to find the pairs.
+class H264RBSP {
+public:
+  // Remove emulation prevention bytes. dst needs room for size bytes and may
+  // be src itself. Returns the RBSP size.
+  static size_t ebspToRbsp(const uint8_t *src, size_t size, uint8_t *dst);
+  static void ebspToRbsp(const uint8_t *src, size_t size,
+                         std::vector<uint8_t> &rbsp);
+
+  // Insert emulation prevention bytes. dst needs room for maxEbspSize(size)
+  // bytes. Returns the EBSP size.
+  static size_t rbspToEbsp(const uint8_t *src, size_t size, uint8_t *dst);
+  static void rbspToEbsp(const uint8_t *src, size_t size,
+                         std::vector<uint8_t> &ebsp);
+
+  // Worst case: one prevention byte per two input bytes, plus a final 0x03
+  // after a trailing zero pair
+  static size_t maxEbspSize(size_t size) { return size + size / 2 + 1; }
+
+  // Byte-at-a-time reference implementations
+  static size_t ebspToRbspScalar(const uint8_t *src, size_t size,
+                                 uint8_t *dst);
+  static size_t rbspToEbspScalar(const uint8_t *src, size_t size,
+                                 uint8_t *dst);
+};
+
+// MSB-first reader over RBSP data with Exp-Golomb support. Reading past the end
+// yields zero bits and sets the overrun flag instead of failing immediately.
+class H264BitReader {
+public:
+  H264BitReader(const uint8_t *data, size_t size)
+      : m_data(data), m_size(size), m_pos(0), m_overrun(false) {}
+
+  // Read up to 32 bits
+  uint32_t readBits(int count);
+  bool readFlag() { return readBits(1) != 0; }
+  uint32_t readUE(); // ue(v)
+  int32_t readSE();  // se(v)
+  void skipBits(size_t count);
+
+  bool byteAligned() const { return (m_pos & 7) == 0; }
+  size_t bitPosition() const { return m_pos; }
+  size_t bitsLeft() const { return m_pos < m_size * 8 ? m_size * 8 - m_pos : 0; }
+  // True if there is data before the rbsp_trailing_bits
+  bool moreRbspData() const;
+  bool overrun() const { return m_overrun; }
+
+private:
+  const uint8_t *m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_overrun;
+};
+
+// MSB-first writer producing RBSP data, the counterpart of H264BitReader
+class H264BitWriter {
+public:
+  H264BitWriter() : m_bitCount(0) {}
+
+  // Write the low count bits of value, up to 32
+  void writeBits(uint32_t value, int count);
+  void writeFlag(bool value) { writeBits(value ? 1 : 0, 1); }
+  void writeUE(uint32_t value); // ue(v)
+  void writeSE(int32_t value);  // se(v)
+  // rbsp_trailing_bits: a stop bit followed by zero bits up to the byte boundary
+  void writeTrailingBits();
+
+  bool byteAligned() const { return (m_bitCount & 7) == 0; }
+  size_t bitCount() const { return m_bitCount; }
+  const std::vector<uint8_t> &data() const { return m_data; }
+  void clear() {
+    m_data.clear();
+    m_bitCount = 0;
+  }
+
+private:
+  std::vector<uint8_t> m_data;
+  size_t m_bitCount;
+};
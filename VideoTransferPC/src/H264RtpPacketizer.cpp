@@ -0,0 +1,502 @@
+// H264 RTP packetization and depacketization implementation
+#include "H264RtpPacketizer.h"
+#include "H264NALUParser.h"
+#include <cstring>
+#include <random>
+
+namespace {
+
+const int kNALSTAPA = 24;
+const int kNALFUA = 28;
+const uint8_t kFUStart = 0x80;
+const uint8_t kFUEnd = 0x40;
+const size_t kNoNAL = static_cast<size_t>(-1);
+// Largest UDP payload, keeps STAP-A's 16-bit NAL sizes valid as well
+const size_t kMaxRtpPacket = 65507;
+const size_t kMinRtpPacket = H264RtpPacketizer::kHeaderSize + 16;
+
+void writeBE16(uint8_t *out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value >> 8);
+  out[1] = static_cast<uint8_t>(value);
+}
+
+void writeBE32(uint8_t *out, uint32_t value) {
+  out[0] = static_cast<uint8_t>(value >> 24);
+  out[1] = static_cast<uint8_t>(value >> 16);
+  out[2] = static_cast<uint8_t>(value >> 8);
+  out[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t readBE32(const uint8_t *in) {
+  return (static_cast<uint32_t>(in[0]) << 24) |
+         (static_cast<uint32_t>(in[1]) << 16) |
+         (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// True if the packet visibly starts an access unit: an access unit delimiter, SEI or
+// parameter set first, or a non-IDR slice with first_mb_in_slice 0 (its ue(v) code is a
+// single 1 bit). An IDR slice first means the parameter sets sent ahead of it were lost.
+bool beginsAccessUnit(const uint8_t *payload, size_t size) {
+  if (size < 2) {
+    return false;
+  }
+  const int type = payload[0] & 0x1F;
+  uint8_t nal = payload[0];
+  const uint8_t *data = payload + 1;
+  const uint8_t *end = payload + size;
+  if (type == kNALSTAPA) {
+    if (size < 5) {
+      return false;
+    }
+    nal = payload[3];
+    data = payload + 4;
+  } else if (type == kNALFUA) {
+    if (size < 3 || !(payload[1] & kFUStart)) {
+      return false;
+    }
+    nal = payload[1];
+    data = payload + 2;
+  } else if (type > 23) {
+    return false;
+  }
+  switch (nal & 0x1F) {
+  case 6: // SEI
+  case 7: // SPS
+  case 8: // PPS
+  case 9: // Access unit delimiter
+    return true;
+  case 1:
+    return data < end && (data[0] & 0x80) != 0;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+H264RtpPacketizer::H264RtpPacketizer(PacketCallback callback, size_t mtu,
+                                     uint32_t ssrc, uint8_t payloadType)
+    : m_callback(std::move(callback)),
+      m_maxPayload((mtu < kMinRtpPacket   ? kMinRtpPacket
+                    : mtu > kMaxRtpPacket ? kMaxRtpPacket
+                                          : mtu) -
+                   kHeaderSize),
+      m_ssrc(ssrc != 0 ? ssrc : std::random_device()()),
+      m_payloadType(payloadType & 0x7F), m_timestamp(0), m_aggregateSize(0),
+      m_stats() {
+  // Random initial sequence number as recommended by RFC 3550 5.1
+  m_sequence = static_cast<uint16_t>(std::random_device()());
+  m_packet.resize(kHeaderSize + m_maxPayload);
+}
+
+void H264RtpPacketizer::packetize(const uint8_t *data, size_t size,
+                                  uint32_t timestamp, H264StreamFormat format) {
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(data, size);
+  }
+  m_timestamp = timestamp;
+  m_aggregate.clear();
+  m_aggregateSize = 0;
+  m_stats.accessUnits++;
+
+  // Each NAL unit is added once the next one is found, so the last one is
+  // known and can carry the marker bit
+  const uint8_t *pending = nullptr;
+  size_t pending_size = 0;
+  auto visit = [&](const H264NALUParser::NALUnit &nalu) {
+    if (nalu.size == 0) {
+      return;
+    }
+    if (pending) {
+      addNAL(pending, pending_size, false);
+    }
+    pending = nalu.data;
+    pending_size = nalu.size;
+  };
+  if (format == H264StreamFormat::AVCC) {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateAVCCNALUs(data, size)) {
+      visit(nalu);
+    }
+  } else {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateNALUs(data, size)) {
+      visit(nalu);
+    }
+  }
+  if (pending) {
+    addNAL(pending, pending_size, true);
+  }
+}
+
+void H264RtpPacketizer::addNAL(const uint8_t *nal, size_t size, bool last) {
+  if (size > m_maxPayload) {
+    flushAggregate(false);
+    sendFragmented(nal, size, last);
+    return;
+  }
+
+  // STAP-A costs one header byte plus a 2-byte size per NAL unit
+  if (!m_aggregate.empty() && m_aggregateSize + 2 + size > m_maxPayload) {
+    flushAggregate(false);
+  }
+  m_aggregateSize += (m_aggregate.empty() ? 3 : 2) + size;
+  m_aggregate.emplace_back(nal, size);
+  if (last) {
+    flushAggregate(true);
+  }
+}
+
+void H264RtpPacketizer::flushAggregate(bool marker) {
+  if (m_aggregate.empty()) {
+    return;
+  }
+  uint8_t *payload = beginPacket(marker);
+  if (m_aggregate.size() == 1) {
+    memcpy(payload, m_aggregate[0].first, m_aggregate[0].second);
+    sendPacket(kHeaderSize + m_aggregate[0].second);
+    m_stats.singleNALPackets++;
+  } else {
+    // The STAP-A header takes the highest F and NRI of the aggregated units
+    // (RFC 6184 5.7.1)
+    uint8_t forbidden = 0;
+    uint8_t nri = 0;
+    size_t pos = 1;
+    for (const auto &nal : m_aggregate) {
+      forbidden |= nal.first[0] & 0x80;
+      if ((nal.first[0] & 0x60) > nri) {
+        nri = nal.first[0] & 0x60;
+      }
+      writeBE16(payload + pos, static_cast<uint16_t>(nal.second));
+      memcpy(payload + pos + 2, nal.first, nal.second);
+      pos += 2 + nal.second;
+    }
+    payload[0] = forbidden | nri | kNALSTAPA;
+    sendPacket(kHeaderSize + pos);
+    m_stats.stapAPackets++;
+  }
+  m_aggregate.clear();
+  m_aggregateSize = 0;
+}
+
+void H264RtpPacketizer::sendFragmented(const uint8_t *nal, size_t size,
+                                       bool marker) {
+  // The NAL header is not sent, the FU indicator and header carry its fields
+  const uint8_t indicator = (nal[0] & 0xE0) | kNALFUA;
+  const uint8_t type = nal[0] & 0x1F;
+  const size_t chunk = m_maxPayload - 2;
+  size_t pos = 1;
+  while (pos < size) {
+    const size_t length = (size - pos < chunk) ? size - pos : chunk;
+    const bool end = pos + length == size;
+    uint8_t *payload = beginPacket(marker && end);
+    payload[0] = indicator;
+    payload[1] = type | (pos == 1 ? kFUStart : 0) | (end ? kFUEnd : 0);
+    memcpy(payload + 2, nal + pos, length);
+    sendPacket(kHeaderSize + 2 + length);
+    m_stats.fuAPackets++;
+    pos += length;
+  }
+}
+
+uint8_t *H264RtpPacketizer::beginPacket(bool marker) {
+  uint8_t *header = m_packet.data();
+  header[0] = 0x80; // Version 2, no padding, extension or CSRCs
+  header[1] = (marker ? 0x80 : 0) | m_payloadType;
+  writeBE16(header + 2, m_sequence);
+  writeBE32(header + 4, m_timestamp);
+  writeBE32(header + 8, m_ssrc);
+  return header + kHeaderSize;
+}
+
+void H264RtpPacketizer::sendPacket(size_t size) {
+  m_sequence++;
+  m_stats.packets++;
+  m_stats.bytes += size;
+  m_callback(m_packet.data(), size);
+}
+
+H264RtpDepacketizer::H264RtpDepacketizer(
+    AccessUnitCallback callback, H264StreamFormat outputFormat,
+    size_t reorderWindow, std::chrono::microseconds maxReorderDelay,
+    size_t maxAccessUnitSize)
+    : m_callback(std::move(callback)),
+      m_lengthPrefixed(outputFormat == H264StreamFormat::AVCC),
+      m_reorderWindow(reorderWindow), m_maxReorderDelay(maxReorderDelay),
+      m_maxAccessUnitSize(maxAccessUnitSize), m_nextSequence(-1),
+      m_highestSequence(-1), m_inAccessUnit(false), m_timestamp(0),
+      m_damaged(false), m_synchronized(false), m_nalStart(kNoNAL), m_stats() {}
+
+bool H264RtpDepacketizer::parseHeader(const uint8_t *packet, size_t size,
+                                      uint16_t &sequence, uint32_t &timestamp,
+                                      uint32_t &ssrc, bool &marker,
+                                      size_t &payloadOffset,
+                                      size_t &payloadSize) {
+  if (size < H264RtpPacketizer::kHeaderSize || (packet[0] >> 6) != 2) {
+    return false;
+  }
+  size_t offset = H264RtpPacketizer::kHeaderSize + 4 * (packet[0] & 0x0F);
+  if (packet[0] & 0x10) {
+    // Header extension: 16-bit profile, 16-bit length in 32-bit words
+    if (offset + 4 > size) {
+      return false;
+    }
+    offset += 4 + 4 * ((static_cast<size_t>(packet[offset + 2]) << 8) |
+                       packet[offset + 3]);
+  }
+  size_t padding = (packet[0] & 0x20) ? packet[size - 1] : 0;
+  if (offset + padding > size) {
+    return false;
+  }
+  sequence = static_cast<uint16_t>((packet[2] << 8) | packet[3]);
+  timestamp = readBE32(packet + 4);
+  ssrc = readBE32(packet + 8);
+  marker = (packet[1] & 0x80) != 0;
+  payloadOffset = offset;
+  payloadSize = size - offset - padding;
+  return true;
+}
+
+bool H264RtpDepacketizer::push(const uint8_t *packet, size_t size,
+                               Clock::time_point now) {
+  uint16_t sequence;
+  uint32_t timestamp, ssrc;
+  bool marker;
+  size_t offset, payload_size;
+  if (!parseHeader(packet, size, sequence, timestamp, ssrc, marker, offset,
+                   payload_size)) {
+    m_stats.packetsInvalid++;
+    return false;
+  }
+  m_stats.packetsReceived++;
+
+  // Extend to 64 bits relative to the highest sequence number seen so far
+  int64_t extended;
+  if (m_highestSequence < 0) {
+    // m_nextSequence stays unset until the first packet is released, so an
+    // earlier packet arriving within the reorder limits still gets its place
+    extended = (int64_t(1) << 32) + sequence;
+    m_highestSequence = extended;
+  } else {
+    const int16_t delta = static_cast<int16_t>(
+        sequence - static_cast<uint16_t>(m_highestSequence));
+    extended = m_highestSequence + delta;
+  }
+
+  if (m_nextSequence >= 0 && extended < m_nextSequence) {
+    m_stats.packetsLate++;
+    return true;
+  }
+  if (m_pending.count(extended)) {
+    m_stats.packetsDuplicate++;
+    return true;
+  }
+  if (extended < m_highestSequence) {
+    m_stats.packetsReordered++;
+  } else {
+    m_highestSequence = extended;
+  }
+
+  Packet &stored = m_pending[extended];
+  if (!m_freeBuffers.empty()) {
+    stored.data = std::move(m_freeBuffers.back());
+    m_freeBuffers.pop_back();
+  }
+  stored.data.assign(packet, packet + size);
+  stored.arrival = now;
+
+  // Release what is in order; a gap is given up on once enough later packets
+  // are waiting behind it
+  while (!m_pending.empty()) {
+    auto first = m_pending.begin();
+    if (first->first != m_nextSequence) {
+      if (m_pending.size() <= m_reorderWindow) {
+        break;
+      }
+      skipTo(first->first);
+    }
+    release(first->first, first->second);
+    m_pending.erase(first);
+  }
+  expire(now);
+  return true;
+}
+
+void H264RtpDepacketizer::expire(Clock::time_point now) {
+  while (!m_pending.empty()) {
+    auto first = m_pending.begin();
+    if (first->first != m_nextSequence) {
+      // The packet after the gap is the one that has waited longest for it
+      if (now - first->second.arrival <= m_maxReorderDelay) {
+        break;
+      }
+      skipTo(first->first);
+    }
+    release(first->first, first->second);
+    m_pending.erase(first);
+  }
+}
+
+void H264RtpDepacketizer::flush() {
+  while (!m_pending.empty()) {
+    auto first = m_pending.begin();
+    if (first->first != m_nextSequence) {
+      skipTo(first->first);
+    }
+    release(first->first, first->second);
+    m_pending.erase(first);
+  }
+  if (m_inAccessUnit) {
+    finishAccessUnit();
+  }
+}
+
+void H264RtpDepacketizer::reset() {
+  m_pending.clear();
+  m_nextSequence = -1;
+  m_highestSequence = -1;
+  m_accessUnit.clear();
+  m_inAccessUnit = false;
+  m_damaged = false;
+  m_synchronized = false;
+  m_nalStart = kNoNAL;
+}
+
+void H264RtpDepacketizer::skipTo(int64_t sequence) {
+  // Before the first release nothing is known to be missing, processPayload()
+  // checks whether the first access unit is complete
+  if (m_nextSequence >= 0) {
+    m_stats.packetsLost += sequence - m_nextSequence;
+    // The missing packets belong to the access unit in progress or, if there
+    // is none, to the next one
+    m_damaged = true;
+  }
+  m_nextSequence = sequence;
+}
+
+void H264RtpDepacketizer::release(int64_t sequence, Packet &packet) {
+  uint16_t sequence16;
+  uint32_t timestamp, ssrc;
+  bool marker;
+  size_t offset, payload_size;
+  parseHeader(packet.data.data(), packet.data.size(), sequence16, timestamp,
+              ssrc, marker, offset, payload_size);
+  processPayload(packet.data.data() + offset, payload_size, timestamp, marker);
+  m_nextSequence = sequence + 1;
+  m_freeBuffers.push_back(std::move(packet.data));
+}
+
+void H264RtpDepacketizer::processPayload(const uint8_t *payload, size_t size,
+                                         uint32_t timestamp, bool marker) {
+  if (m_inAccessUnit && timestamp != m_timestamp) {
+    // The previous access unit lost its marker packet, the loss may have taken
+    // the first packets of this one as well
+    const bool lost_boundary = m_damaged;
+    finishAccessUnit();
+    m_damaged = lost_boundary;
+  }
+  if (!m_inAccessUnit) {
+    m_inAccessUnit = true;
+    m_timestamp = timestamp;
+    m_accessUnit.clear();
+    m_nalStart = kNoNAL;
+    if (!m_synchronized) {
+      // The packets ahead of the first one released may have been lost
+      m_synchronized = true;
+      if (!beginsAccessUnit(payload, size)) {
+        m_damaged = true;
+      }
+    }
+  }
+
+  const int type = size > 0 ? payload[0] & 0x1F : 0;
+  if (type >= 1 && type <= 23) {
+    if (m_nalStart != kNoNAL) {
+      m_damaged = true; // FU-A without its end fragment
+      m_nalStart = kNoNAL;
+    }
+    beginNAL(payload[0]);
+    appendNAL(payload + 1, size - 1);
+    endNAL();
+  } else if (type == kNALSTAPA) {
+    size_t pos = 1;
+    while (pos + 2 <= size) {
+      const size_t length = (static_cast<size_t>(payload[pos]) << 8) |
+                            payload[pos + 1];
+      pos += 2;
+      if (length == 0 || length > size - pos) {
+        m_stats.packetsInvalid++;
+        m_damaged = true;
+        break;
+      }
+      beginNAL(payload[pos]);
+      appendNAL(payload + pos + 1, length - 1);
+      endNAL();
+      pos += length;
+    }
+  } else if (type == kNALFUA && size >= 2) {
+    const uint8_t fu_header = payload[1];
+    if (fu_header & kFUStart) {
+      if (m_nalStart != kNoNAL) {
+        m_damaged = true;
+      }
+      beginNAL((payload[0] & 0xE0) | (fu_header & 0x1F));
+    } else if (m_nalStart == kNoNAL) {
+      // The start fragment is missing
+      m_damaged = true;
+    }
+    if (m_nalStart != kNoNAL) {
+      appendNAL(payload + 2, size - 2);
+      if (fu_header & kFUEnd) {
+        endNAL();
+      }
+    }
+  } else {
+    // STAP-B, MTAP and FU-B only occur in interleaved mode
+    m_stats.packetsInvalid++;
+    m_damaged = true;
+  }
+
+  if (m_accessUnit.size() > m_maxAccessUnitSize) {
+    m_damaged = true;
+    m_accessUnit.clear();
+    m_nalStart = kNoNAL;
+  }
+  if (marker) {
+    finishAccessUnit();
+  }
+}
+
+void H264RtpDepacketizer::beginNAL(uint8_t header) {
+  m_nalStart = m_accessUnit.size();
+  const uint8_t prefix[5] = {0, 0, 0, 1, header};
+  m_accessUnit.insert(m_accessUnit.end(), prefix, prefix + sizeof(prefix));
+}
+
+void H264RtpDepacketizer::appendNAL(const uint8_t *data, size_t size) {
+  m_accessUnit.insert(m_accessUnit.end(), data, data + size);
+}
+
+void H264RtpDepacketizer::endNAL() {
+  if (m_lengthPrefixed) {
+    writeBE32(m_accessUnit.data() + m_nalStart,
+              static_cast<uint32_t>(m_accessUnit.size() - m_nalStart - 4));
+  }
+  m_nalStart = kNoNAL;
+}
+
+void H264RtpDepacketizer::finishAccessUnit() {
+  if (m_nalStart != kNoNAL) {
+    m_damaged = true; // Ends inside a fragmented NAL unit
+  }
+  if (m_damaged) {
+    m_stats.accessUnitsDropped++;
+  } else if (!m_accessUnit.empty()) {
+    m_stats.accessUnits++;
+    m_callback(m_accessUnit.data(), m_accessUnit.size());
+  }
+  m_accessUnit.clear();
+  m_inAccessUnit = false;
+  m_damaged = false;
+  m_nalStart = kNoNAL;
+}
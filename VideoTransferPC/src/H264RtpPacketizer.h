@@ -0,0 +1,165 @@
+// H264 RTP packetization (RFC 6184) and reordering depacketization
+#pragma once
+
+#include "H264BitstreamConverter.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Splits access units into RTP packets in non-interleaved mode (RFC 6184 5.4):
+// NAL units that fit are sent as single NAL unit packets, consecutive small
+// ones are aggregated into STAP-A packets and larger ones are fragmented into
+// FU-A packets. The marker bit is set on the last packet of each access unit.
+// Packets are built in one internal buffer that is reused.
+class H264RtpPacketizer {
+public:
+  // packet is the complete RTP packet and is only valid during the call
+  using PacketCallback = std::function<void(const uint8_t *packet, size_t size)>;
+
+  static const size_t kHeaderSize = 12;
+  // 90 kHz media clock used for H.264 (RFC 6184 8.2.1)
+  static const uint32_t kClockRate = 90000;
+
+  struct Stats {
+    uint64_t accessUnits;
+    uint64_t packets;
+    uint64_t singleNALPackets;
+    uint64_t stapAPackets;
+    uint64_t fuAPackets;
+    uint64_t bytes; // RTP packet bytes including headers
+  };
+
+  // mtu is the largest RTP packet, headers included, that the callback is
+  // given. An ssrc of 0 picks a random one; the first sequence number is
+  // random unless set with setSequenceNumber.
+  H264RtpPacketizer(PacketCallback callback, size_t mtu = 1200,
+                    uint32_t ssrc = 0, uint8_t payloadType = 96);
+
+  // Packetize one access unit. Parameter sets and SEI are sent like any other
+  // NAL unit, start codes and length prefixes are not.
+  void packetize(const uint8_t *data, size_t size, uint32_t timestamp,
+                 H264StreamFormat format = H264StreamFormat::AnnexB);
+
+  void setSequenceNumber(uint16_t sequence) { m_sequence = sequence; }
+  uint16_t getSequenceNumber() const { return m_sequence; }
+  uint32_t getSSRC() const { return m_ssrc; }
+  Stats getStats() const { return m_stats; }
+
+private:
+  void addNAL(const uint8_t *nal, size_t size, bool last);
+  void flushAggregate(bool marker);
+  void sendFragmented(const uint8_t *nal, size_t size, bool marker);
+  uint8_t *beginPacket(bool marker);
+  void sendPacket(size_t size);
+
+  PacketCallback m_callback;
+  const size_t m_maxPayload;
+  const uint32_t m_ssrc;
+  const uint8_t m_payloadType;
+  uint16_t m_sequence;
+  uint32_t m_timestamp;
+
+  // NAL units waiting to share one packet, pointers into the access unit
+  std::vector<std::pair<const uint8_t *, size_t>> m_aggregate;
+  size_t m_aggregateSize; // STAP-A payload size if m_aggregate is sent as one
+  std::vector<uint8_t> m_packet;
+  Stats m_stats;
+};
+
+// Reassembles access units from RTP packets that may arrive lost, duplicated
+// or out of order. Packets are released in sequence number order; a missing
+// packet is waited for until reorderWindow later packets have arrived or it
+// is maxReorderDelay overdue. An access unit is emitted when its marker bit
+// or the first packet of the next timestamp is released. Access units that
+// lost a packet are dropped, the decoder then waits for the next IDR frame.
+// The first packet is held like one behind a gap, so an earlier one that is
+// reordered or repaired by FEC still comes first. Since nothing tells whether
+// packets ahead of it were lost, the first access unit is only emitted if it
+// visibly starts with an access unit boundary.
+class H264RtpDepacketizer {
+public:
+  // data holds the NAL units of one access unit in outputFormat and is only
+  // valid during the call
+  using AccessUnitCallback = std::function<void(const uint8_t *data, size_t size)>;
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint64_t packetsReceived;
+    uint64_t packetsLost;       // Never arrived, or arrived after being given up on
+    uint64_t packetsReordered;  // Arrived out of order but in time
+    uint64_t packetsDuplicate;
+    uint64_t packetsLate;       // Arrived after their place in the sequence was released
+    uint64_t packetsInvalid;    // Not RTP, or using unsupported payload structures
+    uint64_t accessUnits;       // Emitted complete
+    uint64_t accessUnitsDropped;
+  };
+
+  // outputFormat selects start codes (AnnexB or Auto) or 4-byte length
+  // prefixes (AVCC) in front of each NAL unit of the emitted access units
+  explicit H264RtpDepacketizer(
+      AccessUnitCallback callback,
+      H264StreamFormat outputFormat = H264StreamFormat::AnnexB,
+      size_t reorderWindow = 64,
+      std::chrono::microseconds maxReorderDelay = std::chrono::milliseconds(20),
+      size_t maxAccessUnitSize = 8 * 1024 * 1024);
+
+  // Add one RTP packet. Returns false if it is not a valid RTP packet.
+  bool push(const uint8_t *packet, size_t size, Clock::time_point now = Clock::now());
+
+  // Give up on missing packets that are more than maxReorderDelay overdue,
+  // call periodically when packets may stop arriving
+  void expire(Clock::time_point now = Clock::now());
+
+  // Release everything buffered, skipping missing packets, e.g. at the end of
+  // a stream. The access unit in progress is emitted if it is intact.
+  void flush();
+
+  void reset();
+
+  // Parse the fixed RTP header. Returns false if the packet is not RTP version 2.
+  static bool parseHeader(const uint8_t *packet, size_t size, uint16_t &sequence,
+                          uint32_t &timestamp, uint32_t &ssrc, bool &marker,
+                          size_t &payloadOffset, size_t &payloadSize);
+
+  Stats getStats() const { return m_stats; }
+
+private:
+  struct Packet {
+    std::vector<uint8_t> data;
+    Clock::time_point arrival;
+  };
+
+  void release(int64_t sequence, Packet &packet);
+  void skipTo(int64_t sequence);
+  void processPayload(const uint8_t *payload, size_t size, uint32_t timestamp, bool marker);
+  void beginNAL(uint8_t header);
+  void appendNAL(const uint8_t *data, size_t size);
+  void endNAL();
+  void finishAccessUnit();
+
+  AccessUnitCallback m_callback;
+  const bool m_lengthPrefixed;
+  const size_t m_reorderWindow;
+  const std::chrono::microseconds m_maxReorderDelay;
+  const size_t m_maxAccessUnitSize;
+
+  // Sequence numbers are extended to 64 bits so the buffer order survives the
+  // 16-bit wrap. m_nextSequence is the next one to release, -1 until the first
+  // packet is released.
+  std::map<int64_t, Packet> m_pending;
+  int64_t m_nextSequence;
+  int64_t m_highestSequence;
+  std::vector<std::vector<uint8_t>> m_freeBuffers;
+
+  // Access unit being assembled
+  std::vector<uint8_t> m_accessUnit;
+  bool m_inAccessUnit;
+  uint32_t m_timestamp;
+  bool m_damaged;        // A packet of this access unit is missing
+  bool m_synchronized;   // The first access unit has begun
+  size_t m_nalStart;     // Offset of the open FU-A NAL unit's prefix, or SIZE_MAX
+  Stats m_stats;
+};
@@ -0,0 +1,208 @@
+// H264 slice header parser and frame tracker implementation
+#include "H264SliceHeader.h"
+#include "H264NALUParser.h"
+#include "H264RBSP.h"
+
+namespace {
+
+// The fields up to pic_order_cnt_lsb fit well within this many payload bytes,
+// so only the start of the slice is unescaped
+const size_t kSliceHeaderPrefix = 64;
+
+bool isSliceNAL(int type) {
+  return type == H264NALUParser::NAL_SLICE ||
+         type == H264NALUParser::NAL_IDR_SLICE;
+}
+
+} // namespace
+
+bool H264SliceParser::parse(const uint8_t *nal, size_t size,
+                            const ParameterSetCache &parameterSets,
+                            H264SliceHeader &header) {
+  if (size < 2 || !isSliceNAL(nal[0] & 0x1F)) {
+    return false;
+  }
+
+  uint8_t rbsp[kSliceHeaderPrefix];
+  const size_t prefix =
+      (size - 1 < kSliceHeaderPrefix) ? size - 1 : kSliceHeaderPrefix;
+  H264BitReader reader(rbsp, H264RBSP::ebspToRbsp(nal + 1, prefix, rbsp));
+
+  header = H264SliceHeader();
+  header.nalType = nal[0] & 0x1F;
+  header.nalRefIdc = (nal[0] >> 5) & 0x03;
+  header.firstMbInSlice = reader.readUE();
+  uint32_t slice_type = reader.readUE();
+  uint32_t pps_id = reader.readUE();
+  if (reader.overrun() || slice_type > 9 ||
+      pps_id >= ParameterSetCache::kMaxPPS) {
+    return false;
+  }
+  header.sliceType = static_cast<int>(slice_type % 5);
+  header.ppsId = static_cast<int>(pps_id);
+
+  H264PPS pps;
+  H264SPS sps;
+  if (!parameterSets.getPPS(header.ppsId, pps) ||
+      !parameterSets.getSPS(pps.spsId, sps)) {
+    return false;
+  }
+
+  if (sps.separateColourPlane) {
+    reader.readBits(2); // colour_plane_id
+  }
+  header.frameNum = static_cast<int>(reader.readBits(sps.log2MaxFrameNum));
+  if (!sps.frameMbsOnly) {
+    header.fieldPic = reader.readFlag();
+    if (header.fieldPic) {
+      header.bottomField = reader.readFlag();
+    }
+  }
+  if (header.nalType == H264NALUParser::NAL_IDR_SLICE) {
+    header.idrPicId = static_cast<int>(reader.readUE());
+  }
+  if (sps.picOrderCntType == 0) {
+    header.picOrderCntLsb =
+        static_cast<int>(reader.readBits(sps.log2MaxPicOrderCntLsb));
+  }
+  return !reader.overrun();
+}
+
+int H264SliceParser::peekSliceType(const uint8_t *nal, size_t size) {
+  if (size < 2 || !isSliceNAL(nal[0] & 0x1F)) {
+    return -1;
+  }
+  // first_mb_in_slice and slice_type fit well within this many bytes
+  uint8_t rbsp[12];
+  const size_t prefix = (size - 1 < sizeof(rbsp)) ? size - 1 : sizeof(rbsp);
+  H264BitReader reader(rbsp, H264RBSP::ebspToRbsp(nal + 1, prefix, rbsp));
+  reader.readUE(); // first_mb_in_slice
+  uint32_t slice_type = reader.readUE();
+  if (reader.overrun() || slice_type > 9) {
+    return -1;
+  }
+  return static_cast<int>(slice_type % 5);
+}
+
+const char *H264SliceParser::getSliceTypeStr(int sliceType) {
+  switch (sliceType % 5) {
+  case 0:
+    return "P";
+  case 1:
+    return "B";
+  case 2:
+    return "I";
+  case 3:
+    return "SP";
+  case 4:
+    return "SI";
+  default:
+    return "Unknown";
+  }
+}
+
+const char *H264SliceParser::getFrameKindStr(H264FrameKind kind) {
+  switch (kind) {
+  case H264FrameKind::IDR:
+    return "IDR";
+  case H264FrameKind::Reference:
+    return "Reference";
+  case H264FrameKind::NonReference:
+    return "Non-reference";
+  default:
+    return "Unknown";
+  }
+}
+
+H264FrameTracker::H264FrameTracker(H264StreamFormat format)
+    : m_format(format), m_prevRefFrameNum(-1), m_gapCount(0) {}
+
+H264FrameTracker::FrameInfo H264FrameTracker::onPacket(const uint8_t *data,
+                                                       size_t size) {
+  H264StreamFormat format = m_format;
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(data, size);
+  }
+  m_parameterSets.update(data, size, format);
+
+  FrameInfo info = FrameInfo();
+  bool has_slice = false;
+  bool has_idr = false;
+  bool is_reference = false;
+  bool parsed = false;
+  H264SliceHeader header;
+  auto visit = [&](const H264NALUParser::NALUnit &nalu) {
+    if (!isSliceNAL(nalu.type)) {
+      return;
+    }
+    has_slice = true;
+    has_idr = has_idr || nalu.type == H264NALUParser::NAL_IDR_SLICE;
+    is_reference = is_reference || nalu.refIdc != 0;
+    // All slices of a picture share frame_num, the first one is enough
+    if (!parsed) {
+      parsed = H264SliceParser::parse(nalu.data, nalu.size, m_parameterSets,
+                                      header);
+    }
+  };
+  if (format == H264StreamFormat::AVCC) {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateAVCCNALUs(data, size)) {
+      visit(nalu);
+    }
+  } else {
+    for (const H264NALUParser::NALUnit &nalu :
+         H264NALUParser::enumerateNALUs(data, size)) {
+      visit(nalu);
+    }
+  }
+
+  if (!has_slice) {
+    info.kind = H264FrameKind::Unknown;
+    return info;
+  }
+  info.kind = has_idr        ? H264FrameKind::IDR
+              : is_reference ? H264FrameKind::Reference
+                             : H264FrameKind::NonReference;
+  if (!parsed) {
+    return info;
+  }
+  info.hasHeader = true;
+  info.frameNum = header.frameNum;
+
+  if (has_idr) {
+    m_prevRefFrameNum = header.frameNum;
+    return info;
+  }
+  // Only the first slice of a picture starts a new frame_num; packets that
+  // begin mid-picture and streams joined before an IDR are not checked
+  if (header.firstMbInSlice != 0 || m_prevRefFrameNum < 0) {
+    return info;
+  }
+
+  H264SPS sps;
+  H264PPS pps;
+  if (!m_parameterSets.getPPS(header.ppsId, pps) ||
+      !m_parameterSets.getSPS(pps.spsId, sps)) {
+    return info;
+  }
+  // frame_num either repeats PrevRefFrameNum (second field, or a non-reference
+  // picture after one) or follows it by one (8.2.5.2). Pictures using
+  // memory_management_control_operation 5 are not recognised.
+  const int max_frame_num = 1 << sps.log2MaxFrameNum;
+  const int expected = (m_prevRefFrameNum + 1) % max_frame_num;
+  if (header.frameNum != m_prevRefFrameNum && header.frameNum != expected) {
+    info.frameNumGap = true;
+    info.missingFrames =
+        (header.frameNum - expected + max_frame_num) % max_frame_num;
+    m_gapCount++;
+  }
+  if (is_reference) {
+    m_prevRefFrameNum = header.frameNum;
+  }
+  return info;
+}
+
+void H264FrameTracker::reset() {
+  m_parameterSets.clear();
+  m_prevRefFrameNum = -1;
+}
@@ -0,0 +1,75 @@
+// H264 slice header parser for frame classification and frame_num gap detection
+#pragma once
+
+#include "H264BitstreamConverter.h"
+#include "H264ParameterSets.h"
+#include <cstddef>
+#include <cstdint>
+
+// Leading fields of a slice header, up to pic_order_cnt_lsb
+struct H264SliceHeader {
+  int nalType;
+  int nalRefIdc;
+  uint32_t firstMbInSlice;
+  int sliceType; // 0 P, 1 B, 2 I, 3 SP, 4 SI (slice_type % 5)
+  int ppsId;
+  int frameNum;
+  bool fieldPic;
+  bool bottomField;
+  int idrPicId;       // Only for IDR slices
+  int picOrderCntLsb; // Only for pic_order_cnt_type 0
+};
+
+// How much the rest of the stream depends on a frame
+enum class H264FrameKind {
+  Unknown,     // No slice in the packet
+  IDR,         // Starts a new reference chain
+  Reference,   // Later frames may predict from it
+  NonReference // Can be dropped without affecting other frames
+};
+
+class H264SliceParser {
+public:
+  // Parse the header of a slice NAL unit, starting at the NAL header byte.
+  // The referenced PPS and SPS must be in the cache.
+  static bool parse(const uint8_t *nal, size_t size,
+                    const ParameterSetCache &parameterSets,
+                    H264SliceHeader &header);
+
+  // slice_type % 5 of a slice NAL unit, read without the parameter sets.
+  // Returns -1 if the NAL unit is not a slice or is truncated.
+  static int peekSliceType(const uint8_t *nal, size_t size);
+
+  static const char *getSliceTypeStr(int sliceType);
+  static const char *getFrameKindStr(H264FrameKind kind);
+};
+
+// Per-stream tracker that classifies each packet and checks that frame_num
+// advances without gaps (8.2.5.2). It learns SPS/PPS from the packets it sees.
+class H264FrameTracker {
+public:
+  struct FrameInfo {
+    H264FrameKind kind;
+    bool hasHeader;    // Slice header parsed, frameNum is valid
+    int frameNum;
+    bool frameNumGap;  // Reference frames are missing before this one
+    int missingFrames; // Number of missing frame_num values
+  };
+
+  explicit H264FrameTracker(H264StreamFormat format = H264StreamFormat::Auto);
+
+  // Classify one access unit and update the frame_num state
+  FrameInfo onPacket(const uint8_t *data, size_t size);
+
+  // Forget the frame_num state, e.g. after the stream was restarted
+  void reset();
+
+  uint64_t gapCount() const { return m_gapCount; }
+  const ParameterSetCache &parameterSets() const { return m_parameterSets; }
+
+private:
+  H264StreamFormat m_format;
+  ParameterSetCache m_parameterSets;
+  int m_prevRefFrameNum; // -1 until the first IDR frame
+  uint64_t m_gapCount;
+};
@@ -0,0 +1,117 @@
+//Memory-mapped file implementation for Windows and POSIX systems
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr) {}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize)) {
+        close();
+        return false;
+    }
+    if (fileSize.QuadPart == 0) {
+        return true; // Empty files cannot be mapped
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        close();
+        return false;
+    }
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+}
+
+void MappedFile::adviseSequential() {
+    // Covered by FILE_FLAG_SEQUENTIAL_SCAN when the file is opened
+}
+
+#else
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_fd(-1) {}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        close();
+        return false;
+    }
+    if (st.st_size == 0) {
+        return true; // Empty files cannot be mapped
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+}
+
+void MappedFile::adviseSequential() {
+    if (m_data) {
+        madvise(const_cast<uint8_t*>(m_data), m_size, MADV_SEQUENTIAL);
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
@@ -0,0 +1,40 @@
+//Read-only memory-mapped file for scanning large recordings without loading them
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Maps a whole file read-only into the address space. Pages are loaded by the OS
+// on first access, so multi-GB files can be scanned with constant memory use.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file cannot be opened or mapped. An empty file maps to size() == 0.
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // Hint that the mapping will be read front to back, enabling aggressive readahead
+    void adviseSequential();
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+#endif // MAPPEDFILE_H
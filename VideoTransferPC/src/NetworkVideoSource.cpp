@@ -1,5 +1,7 @@
 // Network video source implementation for receiving and decoding H264 streams
 #include "NetworkVideoSource.h"
+#include "H264NALUParser.h"
+#include <cstring>
 #include <iostream> // Replace QDebug
 
 #ifdef _WIN32
@@ -9,8 +11,29 @@
 #define OutputDebugStringA(x) std::cerr << x << std::endl
 #endif
 
-NetworkVideoSource::NetworkVideoSource()
-    : m_receiver(nullptr), m_decoder(nullptr) {}
+H264NALUParser::PacketInfo
+NetworkVideoSource::classifyQueuedPacket(const std::vector<uint8_t> &packet) const {
+  H264StreamFormat format = m_decoderOptions.inputFormat;
+  if (format == H264StreamFormat::Auto) {
+    format = H264BitstreamConverter::detectFormat(packet.data(), packet.size());
+  }
+  // Length-prefixed packets are split by their length fields without scanning
+  return format == H264StreamFormat::AVCC
+             ? H264NALUParser::classifyAVCCPacket(packet.data(), packet.size())
+             : H264NALUParser::classifyPacket(packet.data(), packet.size());
+}
+
+NetworkVideoSource::NetworkVideoSource(
+    size_t maxQueuedPackets, const H264DecoderOptions &decoderOptions,
+    DecodeScheduler *scheduler, unsigned networkThreadCount,
+    Transport transport, const SocketOptions &socketOptions)
+    : m_transport(transport), m_receiver(nullptr), m_rtpReceiver(nullptr),
+      m_decoderOptions(decoderOptions),
+      m_scheduler(scheduler),
+      m_networkThreadCount(networkThreadCount > 0 ? networkThreadCount : 1),
+      m_socketOptions(socketOptions),
+      m_maxQueuedPackets(maxQueuedPackets > 0 ? maxQueuedPackets : 1),
+      m_primaryStream(-1), m_nextSubscriptionId(1), m_startSubscription(-1) {}
 
 NetworkVideoSource::~NetworkVideoSource() { stop(); }
 
@@ -19,32 +42,64 @@ void NetworkVideoSource::start(
     std::function<void(const char *, int, int, int)> frameCallback) {
   std::cout << "NetworkVideoSource::start() called with ip: " << ip
             << " port: " << port << std::endl;
-  // Create decoder
-  m_decoder = new H264Decoder([frameCallback](const uint8_t *data, size_t size,
-                                              int width, int height) {
-    OutputDebugStringA((std::string("frameCallback decode output size: ") +
-                        std::to_string(size))
-                           .c_str());
-    frameCallback(reinterpret_cast<const char *>(data), size, width, height);
-  });
+  // Pack the frame view on the delivery thread for consumers that expect one buffer.
+  // While the primary stream changes two delivery threads may briefly both get here.
+  m_startSubscription = subscribe(
+      kPrimaryStream,
+      [this, frameCallback](std::shared_ptr<const DecodedFrame> frame) {
+        std::lock_guard<std::mutex> lock(m_packedFrameMutex);
+        m_packedFrame.resize(frame->packedSize());
+        frame->packTo(m_packedFrame.data());
+        frameCallback(reinterpret_cast<const char *>(m_packedFrame.data()),
+                      static_cast<int>(m_packedFrame.size()), frame->width,
+                      frame->height);
+      });
 
-  // Create data receiver
-  m_receiver = new CameraDataReceiver(ip, port);
+  startPipeline(ip, port);
+}
 
-  // Set data callback
-  auto dataCallback = [this](const char *data, size_t length) {
-    OutputDebugStringA((std::string("dataCallback decode input size: ") +
-                        std::to_string(length))
-                           .c_str());
-    m_decoder->decode(reinterpret_cast<const uint8_t *>(data), length);
-  };
+void NetworkVideoSource::start(const std::string &ip, int port,
+                               FrameCallback frameCallback) {
+  std::cout << "NetworkVideoSource::start() called with ip: " << ip
+            << " port: " << port << std::endl;
+  m_startSubscription = subscribe(kPrimaryStream, frameCallback);
+
+  startPipeline(ip, port);
+}
+
+void NetworkVideoSource::start(const std::string &ip, int port) {
+  std::cout << "NetworkVideoSource::start() called with ip: " << ip
+            << " port: " << port << std::endl;
+  startPipeline(ip, port);
+}
+
+void NetworkVideoSource::startPipeline(const std::string &ip, int port) {
+  // Create data receiver
+  if (m_transport == Transport::UDP) {
+    // Access units are reassembled in the format the decoder expects
+    m_rtpReceiver = new RtpDataReceiver(
+        ip, port,
+        m_decoderOptions.inputFormat == H264StreamFormat::AVCC
+            ? H264StreamFormat::AVCC
+            : H264StreamFormat::AnnexB);
+  } else {
+    m_receiver = new CameraDataReceiver(ip, port, m_networkThreadCount, m_socketOptions);
+  }
 
   // Create thread using lambda expression
-  m_networkThread = std::thread([this, dataCallback]() {
+  m_networkThread = std::thread([this]() {
     try {
       std::cout << "Network thread: starting receiver" << std::endl;
-      // Start receiver
-      m_receiver->run(dataCallback);
+      // Start receiver, every connection gets its own decode pipeline
+      auto onConnected = [this](StreamId id, const std::string &) {
+        return onStreamConnected(id);
+      };
+      auto onDisconnected = [this](StreamId id) { onStreamDisconnected(id); };
+      if (m_rtpReceiver) {
+        m_rtpReceiver->run(onConnected, onDisconnected);
+      } else {
+        m_receiver->run(onConnected, onDisconnected);
+      }
       std::cout << "Network thread: receiver run completed" << std::endl;
     } catch (const std::exception &e) {
       std::cout << "Network thread exception: " << e.what() << std::endl;
@@ -52,29 +107,398 @@ void NetworkVideoSource::start(
   });
 }
 
+CameraDataReceiver::DataCallback
+NetworkVideoSource::onStreamConnected(StreamId id) {
+  auto stream = std::make_shared<Stream>(id, m_decoderOptions.inputFormat);
+  Stream *streamPtr = stream.get();
+
+  // Create decoder. This runs in the receiver's accept handler, so a decoder that
+  // fails to open only rejects this connection instead of ending run() for all of them.
+  try {
+    stream->decoder.reset(new H264Decoder(
+        [this, streamPtr](std::shared_ptr<const DecodedFrame> frame) {
+          OutputDebugStringA((std::string("frameCallback decode output size: ") +
+                              std::to_string(frame->width) + "x" +
+                              std::to_string(frame->height))
+                                 .c_str());
+          onFrameDecoded(*streamPtr, std::move(frame));
+        },
+        m_decoderOptions));
+  } catch (const std::exception &e) {
+    std::cerr << "NetworkVideoSource: stream " << id
+              << " rejected, decoder initialization failed: " << e.what()
+              << std::endl;
+    return CameraDataReceiver::DataCallback();
+  }
+
+  if (m_scheduler) {
+    stream->schedulerStreamId = m_scheduler->addStream(
+        [this, streamPtr]() { return decodeNextPacket(*streamPtr); });
+  } else {
+    stream->decodeThread =
+        std::thread([this, streamPtr]() { decodeLoop(*streamPtr); });
+  }
+  stream->deliveryThread =
+      std::thread([this, streamPtr]() { deliveryLoop(*streamPtr); });
+
+  {
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    m_streams[id] = stream;
+    m_primaryStream = m_streams.begin()->first;
+  }
+  std::cout << "NetworkVideoSource: stream " << id << " started" << std::endl;
+
+  // The connection keeps the stream alive until it has been stopped
+  return [this, stream](const char *data, size_t length) {
+    OutputDebugStringA((std::string("dataCallback decode input size: ") +
+                        std::to_string(length))
+                           .c_str());
+    onPacketReceived(*stream, data, length);
+  };
+}
+
+void NetworkVideoSource::onStreamDisconnected(StreamId id) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) {
+      return;
+    }
+    stream = it->second;
+    m_streams.erase(it);
+    m_primaryStream = m_streams.empty() ? -1 : m_streams.begin()->first;
+  }
+  stopStream(*stream);
+  std::cout << "NetworkVideoSource: stream " << id << " stopped" << std::endl;
+}
+
+void NetworkVideoSource::stopStream(Stream &stream) {
+  // Wake the decode and delivery threads so they can observe the stop flag
+  {
+    std::lock_guard<std::mutex> packetLock(stream.packetMutex);
+    std::lock_guard<std::mutex> mailboxLock(stream.mailboxMutex);
+    stream.stopping = true;
+  }
+  stream.packetCond.notify_all();
+  stream.mailboxCond.notify_all();
+
+  if (stream.decodeThread.joinable()) {
+    stream.decodeThread.join();
+  }
+  if (m_scheduler && stream.schedulerStreamId >= 0) {
+    m_scheduler->removeStream(stream.schedulerStreamId);
+    stream.schedulerStreamId = -1;
+  }
+  if (stream.deliveryThread.joinable()) {
+    stream.deliveryThread.join();
+  }
+
+  stream.packetQueue.clear();
+  stream.mailbox.reset();
+}
+
+std::shared_ptr<NetworkVideoSource::Stream>
+NetworkVideoSource::findStream(StreamId id) const {
+  std::lock_guard<std::mutex> lock(m_streamsMutex);
+  if (id == kPrimaryStream) {
+    id = m_primaryStream;
+  }
+  auto it = m_streams.find(id);
+  return it != m_streams.end() ? it->second : nullptr;
+}
+
+void NetworkVideoSource::onPacketReceived(Stream &stream, const char *data,
+                                          size_t length) {
+  // A frame_num gap means the sender or the network lost reference frames, so
+  // the following frames cannot be decoded correctly until the next IDR
+  const H264FrameTracker::FrameInfo frameInfo = stream.frameTracker.onPacket(
+      reinterpret_cast<const uint8_t *>(data), length);
+  if (frameInfo.frameNumGap) {
+    stream.decoder->notifyPacketLoss();
+  }
+
+  std::lock_guard<std::mutex> lock(stream.packetMutex);
+  stream.packetsReceived++;
+  if (frameInfo.frameNumGap) {
+    stream.frameNumGaps++;
+  }
+
+  std::vector<uint8_t> packet;
+  if (!stream.freePackets.empty()) {
+    packet = std::move(stream.freePackets.back());
+    stream.freePackets.pop_back();
+  }
+  packet.assign(reinterpret_cast<const uint8_t *>(data),
+                reinterpret_cast<const uint8_t *>(data) + length);
+
+  // Never block the network thread: when the decoder falls behind, make room by
+  // discarding a queued non-reference packet, or the oldest packet if there is none
+  if (stream.packetQueue.size() >= m_maxQueuedPackets) {
+    auto victim = stream.packetQueue.begin();
+    bool lostReference = true;
+    for (auto it = stream.packetQueue.begin(); it != stream.packetQueue.end();
+         ++it) {
+      const H264NALUParser::PacketInfo info = classifyQueuedPacket(*it);
+      if (info.hasSlice && !info.isReference) {
+        victim = it;
+        lostReference = false;
+        break;
+      }
+    }
+    stream.freePackets.push_back(std::move(*victim));
+    stream.packetQueue.erase(victim);
+    stream.packetsDropped++;
+    if (lostReference) {
+      stream.decoder->notifyPacketLoss();
+      stream.parameterSetsLost = true;
+    }
+  }
+
+  stream.packetQueue.push_back(std::move(packet));
+  if (stream.packetQueue.size() > stream.maxQueueDepth) {
+    stream.maxQueueDepth = stream.packetQueue.size();
+  }
+
+  if (m_scheduler) {
+    m_scheduler->notify(stream.schedulerStreamId);
+  } else {
+    stream.packetCond.notify_one();
+  }
+}
+
+void NetworkVideoSource::onFrameDecoded(
+    Stream &stream, std::shared_ptr<const DecodedFrame> frame) {
+  std::lock_guard<std::mutex> lock(stream.mailboxMutex);
+  stream.framesDecoded++;
+  if (stream.mailbox) {
+    stream.framesSuperseded++;
+  }
+  stream.mailbox = std::move(frame);
+  stream.mailboxCond.notify_one();
+}
+
+DecodeScheduler::WorkResult
+NetworkVideoSource::decodeNextPacket(Stream &stream) {
+  std::vector<uint8_t> packet;
+  bool parameterSetsLost = false;
+  {
+    std::lock_guard<std::mutex> lock(stream.packetMutex);
+    if (stream.stopping || stream.packetQueue.empty()) {
+      return DecodeScheduler::WorkResult::Idle;
+    }
+    packet = std::move(stream.packetQueue.front());
+    stream.packetQueue.pop_front();
+    parameterSetsLost = stream.parameterSetsLost;
+    stream.parameterSetsLost = false;
+
+    // Let the decoder skip non-reference frames while the queue is backing up
+    stream.decoder->setDiscardNonReference(stream.packetQueue.size() >
+                                           m_maxQueuedPackets / 2);
+  }
+
+  if (parameterSetsLost) {
+    // Senders that write the parameter sets once, or only to a receiver that joins,
+    // would otherwise leave the decoder unable to decode any later IDR frame
+    stream.decoder->setParameterSets(stream.frameTracker.parameterSets());
+  }
+  stream.decoder->decode(packet.data(), packet.size());
+
+  std::lock_guard<std::mutex> lock(stream.packetMutex);
+  stream.freePackets.push_back(std::move(packet));
+  return stream.packetQueue.empty() ? DecodeScheduler::WorkResult::Decoded
+                                    : DecodeScheduler::WorkResult::MorePending;
+}
+
+void NetworkVideoSource::decodeLoop(Stream &stream) {
+  std::cout << "Decode thread " << stream.id << ": started" << std::endl;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stream.packetMutex);
+      stream.packetCond.wait(lock, [&stream]() {
+        return stream.stopping || !stream.packetQueue.empty();
+      });
+      if (stream.stopping) {
+        break;
+      }
+    }
+
+    decodeNextPacket(stream);
+  }
+  std::cout << "Decode thread " << stream.id << ": stopped" << std::endl;
+}
+
+void NetworkVideoSource::deliveryLoop(Stream &stream) {
+  while (true) {
+    std::shared_ptr<const DecodedFrame> frame;
+    {
+      std::unique_lock<std::mutex> lock(stream.mailboxMutex);
+      stream.mailboxCond.wait(
+          lock, [&stream]() { return stream.stopping || stream.mailbox; });
+      if (stream.stopping) {
+        break;
+      }
+      frame = std::move(stream.mailbox);
+      stream.mailbox.reset();
+    }
+
+    // Collect the subscribers first, callbacks run without the subscription list locked
+    const bool isPrimary = m_primaryStream == stream.id;
+    stream.deliveryTargets.clear();
+    {
+      std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+      for (const auto &entry : m_subscriptions) {
+        const StreamId subscribed = entry.second->stream;
+        if (subscribed == stream.id ||
+            (subscribed == kPrimaryStream && isPrimary)) {
+          stream.deliveryTargets.push_back(entry.second);
+        }
+      }
+    }
+    for (const std::shared_ptr<Subscription> &subscription :
+         stream.deliveryTargets) {
+      std::lock_guard<std::recursive_mutex> lock(subscription->mutex);
+      if (subscription->active) {
+        subscription->callback(frame);
+      }
+    }
+    stream.deliveryTargets.clear();
+  }
+}
+
+int NetworkVideoSource::subscribe(StreamId stream, FrameCallback callback) {
+  auto subscription = std::make_shared<Subscription>();
+  subscription->stream = stream;
+  subscription->callback = std::move(callback);
+
+  std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+  const int id = m_nextSubscriptionId++;
+  m_subscriptions[id] = subscription;
+  return id;
+}
+
+void NetworkVideoSource::unsubscribe(int subscriptionId) {
+  std::shared_ptr<Subscription> subscription;
+  {
+    std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+    auto it = m_subscriptions.find(subscriptionId);
+    if (it == m_subscriptions.end()) {
+      return;
+    }
+    subscription = std::move(it->second);
+    m_subscriptions.erase(it);
+  }
+  // Waits for a delivery in progress
+  std::lock_guard<std::recursive_mutex> lock(subscription->mutex);
+  subscription->active = false;
+}
+
+std::vector<NetworkVideoSource::StreamId>
+NetworkVideoSource::getStreamIds() const {
+  std::vector<StreamId> ids;
+  std::lock_guard<std::mutex> lock(m_streamsMutex);
+  for (const auto &entry : m_streams) {
+    ids.push_back(entry.first);
+  }
+  return ids;
+}
+
+std::vector<CameraDataReceiver::ConnectionStats>
+NetworkVideoSource::getConnectionStats() const {
+  if (m_rtpReceiver) {
+    return m_rtpReceiver->getConnectionStats();
+  }
+  if (!m_receiver) {
+    return std::vector<CameraDataReceiver::ConnectionStats>();
+  }
+  return m_receiver->getConnectionStats();
+}
+
+NetworkVideoSource::Stats NetworkVideoSource::getStats() const {
+  return getStats(kPrimaryStream);
+}
+
+NetworkVideoSource::Stats NetworkVideoSource::getStats(StreamId id) const {
+  Stats stats = Stats();
+  const std::shared_ptr<Stream> stream = findStream(id);
+  if (!stream) {
+    return stats;
+  }
+  {
+    std::lock_guard<std::mutex> lock(stream->packetMutex);
+    stats.queueDepth = stream->packetQueue.size();
+    stats.maxQueueDepth = stream->maxQueueDepth;
+    stats.packetsReceived = stream->packetsReceived;
+    stats.packetsDropped = stream->packetsDropped;
+    stats.frameNumGaps = stream->frameNumGaps;
+  }
+  {
+    std::lock_guard<std::mutex> lock(stream->mailboxMutex);
+    stats.framesDecoded = stream->framesDecoded;
+    stats.framesSuperseded = stream->framesSuperseded;
+  }
+  if (m_scheduler && stream->schedulerStreamId >= 0) {
+    stats.avgDecodeTimeUs =
+        m_scheduler->getStreamStats(stream->schedulerStreamId).avgDecodeTimeUs;
+  }
+  const H264Decoder::Stats decoderStats = stream->decoder->getStats();
+  stats.framesConcealed = decoderStats.framesConcealed;
+  stats.framesSkipped = decoderStats.framesDropped;
+  stats.lastDecodeLatencyUs = decoderStats.lastDecodeLatencyUs;
+  stats.avgDecodeLatencyUs = decoderStats.avgDecodeLatencyUs;
+  return stats;
+}
+
+bool NetworkVideoSource::needsKeyframe() const {
+  return needsKeyframe(kPrimaryStream);
+}
+
+bool NetworkVideoSource::needsKeyframe(StreamId id) const {
+  const std::shared_ptr<Stream> stream = findStream(id);
+  return stream && stream->decoder->needsKeyframe();
+}
+
 void NetworkVideoSource::stop() {
   std::cout << "NetworkVideoSource::stop() called" << std::endl;
   if (m_receiver) {
     m_receiver->stop();
     std::cout << "NetworkVideoSource: receiver stopped" << std::endl;
   }
+  if (m_rtpReceiver) {
+    m_rtpReceiver->stop();
+  }
 
+  // The receiver's run() returns once every connection has closed, which has
+  // stopped the pipelines of all streams
   if (m_networkThread.joinable()) {
     std::cout << "NetworkVideoSource: waiting for network thread to join"
               << std::endl;
     m_networkThread.join();
   }
 
+  std::map<StreamId, std::shared_ptr<Stream>> streams;
+  {
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    streams.swap(m_streams);
+    m_primaryStream = -1;
+  }
+  for (const auto &entry : streams) {
+    stopStream(*entry.second);
+  }
+
   if (m_receiver) {
     delete m_receiver;
     m_receiver = nullptr;
     std::cout << "NetworkVideoSource: receiver deleted" << std::endl;
   }
+  if (m_rtpReceiver) {
+    delete m_rtpReceiver;
+    m_rtpReceiver = nullptr;
+  }
 
-  if (m_decoder) {
-    delete m_decoder;
-    m_decoder = nullptr;
-    std::cout << "NetworkVideoSource: decoder deleted" << std::endl;
+  if (m_startSubscription >= 0) {
+    unsubscribe(m_startSubscription);
+    m_startSubscription = -1;
   }
   std::cout << "NetworkVideoSource::stop() completed" << std::endl;
 }
@@ -3,24 +3,189 @@
 #define NETWORKVIDEOSOURCE_H
 
 #include "CameraDataReceiver.h"
+#include "RtpDataReceiver.h"
+#include "DecodeScheduler.h"
 #include "H264Decoder.h"
+#include "H264NALUParser.h"
+#include "H264SliceHeader.h"
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 
+// Receives H264 packets on the network threads, decodes them on a dedicated decode thread
+// (or on the workers of a shared DecodeScheduler) and hands the newest decoded frame to
+// the consumer on a delivery thread.
+// The network thread only copies packets into a bounded queue, and decoded frames go
+// through a latest-wins mailbox, so neither a slow decoder nor a slow consumer
+// stalls socket reads.
+// Every connected sender is a separate stream with its own queue, decoder and delivery
+// thread. Consumers subscribe to one stream, or to the primary stream, which is the
+// oldest open connection.
+// Over UDP every RTP sender (SSRC) is a stream, and the packets arrive already
+// reassembled into access units.
 class NetworkVideoSource
 {
 public:
-    explicit NetworkVideoSource();
+    using StreamId = CameraDataReceiver::StreamId;
+    enum class Transport {
+        TCP,    // Length-prefixed packets, CameraDataReceiver
+        UDP     // RTP packets, RtpDataReceiver
+    };
+    // Subscribe with this ID to follow whichever stream is primary
+    static const StreamId kPrimaryStream = 0;
+
+    struct Stats {
+        size_t queueDepth;          // Packets currently waiting for the decoder
+        size_t maxQueueDepth;       // High-water mark of the packet queue
+        uint64_t packetsReceived;
+        uint64_t packetsDropped;    // Discarded because the packet queue was full
+        uint64_t frameNumGaps;      // Reference frames missing from the received stream
+        uint64_t framesDecoded;
+        uint64_t framesSuperseded;  // Replaced in the mailbox before the consumer took them
+        uint64_t framesConcealed;   // Withheld by the decoder because of decode errors
+        uint64_t framesSkipped;     // Skipped by the decoder while resyncing or catching up
+        uint64_t lastDecodeLatencyUs;
+        double avgDecodeLatencyUs;
+        double avgDecodeTimeUs;     // Per-packet decode time measured by the scheduler, 0 without one
+    };
+
+    // With a scheduler the source decodes on the scheduler's workers instead of its own threads.
+    // The scheduler must outlive the source. networkThreadCount io threads serve the connections,
+    // UDP always uses one. socketOptions apply to the TCP connections.
+    explicit NetworkVideoSource(size_t maxQueuedPackets = 8,
+                                const H264DecoderOptions& decoderOptions = H264DecoderOptions(),
+                                DecodeScheduler* scheduler = nullptr,
+                                unsigned networkThreadCount = 1,
+                                Transport transport = Transport::TCP,
+                                const SocketOptions& socketOptions = SocketOptions());
     ~NetworkVideoSource();
 
+    // Both variants subscribe the callback to the primary stream
     void start(const std::string& ip, int port, std::function<void(const char*, int, int, int)> frameCallback);
+    // Zero-copy variant, frames are delivered as refcounted views of the decoder output
+    void start(const std::string& ip, int port, FrameCallback frameCallback);
+    // Only listen; frames reach consumers through subscribe()
+    void start(const std::string& ip, int port);
     void stop();
 
+    // Deliver the decoded frames of a stream, or of kPrimaryStream, to callback on that
+    // stream's delivery thread. A stream ID may be subscribed before the sender connects.
+    // Returns an ID for unsubscribe().
+    int subscribe(StreamId stream, FrameCallback callback);
+    // The callback is not called any more once this returns, unless this is called from the callback itself
+    void unsubscribe(int subscriptionId);
+
+    // Streams of the currently connected senders, oldest first
+    std::vector<StreamId> getStreamIds() const;
+    // Per-connection network statistics of the connected senders
+    std::vector<CameraDataReceiver::ConnectionStats> getConnectionStats() const;
+
+    // Statistics of the primary stream, or of the given stream
+    Stats getStats() const;
+    Stats getStats(StreamId stream) const;
+
+    // True while the decoder waits for an IDR frame, a sender with a back channel can use
+    // this to request a keyframe
+    bool needsKeyframe() const;
+    bool needsKeyframe(StreamId stream) const;
+
 private:
+    struct Subscription {
+        StreamId stream;
+        FrameCallback callback;
+        // Held while the callback runs, recursive so the callback may unsubscribe itself
+        std::recursive_mutex mutex;
+        bool active = true;
+    };
+
+    // Decode pipeline of one connection
+    struct Stream {
+        explicit Stream(StreamId id, H264StreamFormat inputFormat)
+            : id(id), schedulerStreamId(-1), stopping(false), parameterSetsLost(false), frameTracker(inputFormat), maxQueueDepth(0),
+              packetsReceived(0), packetsDropped(0), frameNumGaps(0), framesDecoded(0), framesSuperseded(0) {}
+
+        const StreamId id;
+        DecodeScheduler::StreamId schedulerStreamId;
+        std::thread decodeThread;
+        std::thread deliveryThread;
+        bool stopping;              // Guarded by both packetMutex and mailboxMutex
+
+        // Bounded packet queue between the network and decode threads.
+        // Consumed packet buffers are recycled through freePackets to avoid per-packet allocations.
+        // When the queue is full non-reference packets are discarded first; dropping a reference
+        // packet makes the decoder wait for the next IDR frame.
+        mutable std::mutex packetMutex;
+        std::condition_variable packetCond;
+        std::deque<std::vector<uint8_t>> packetQueue;
+        std::vector<std::vector<uint8_t>> freePackets;
+        // A dropped reference packet may have carried the only SPS/PPS before the IDR frame the
+        // decoder resyncs on, so the decoder gets the cached sets before its next packet
+        bool parameterSetsLost;
+
+        // Checks frame_num continuity of the received packets, used on the network thread only.
+        // Its parameter set cache is thread-safe and also read by the decode side.
+        H264FrameTracker frameTracker;
+
+        // Latest-wins mailbox between the decode and delivery threads
+        mutable std::mutex mailboxMutex;
+        std::condition_variable mailboxCond;
+        std::shared_ptr<const DecodedFrame> mailbox;
+
+        // Subscriptions a frame goes to, reused by the delivery thread
+        std::vector<std::shared_ptr<Subscription>> deliveryTargets;
+
+        size_t maxQueueDepth;
+        uint64_t packetsReceived;
+        uint64_t packetsDropped;
+        uint64_t frameNumGaps;
+        uint64_t framesDecoded;
+        uint64_t framesSuperseded;
+
+        // Declared last so it is destroyed first, its callback refers to the members above.
+        // It lives as long as the stream, so getStats() can use it while the stream stops.
+        std::unique_ptr<H264Decoder> decoder;
+    };
+
+    void startPipeline(const std::string& ip, int port);
+    CameraDataReceiver::DataCallback onStreamConnected(StreamId id);
+    void onStreamDisconnected(StreamId id);
+    void stopStream(Stream& stream);
+    std::shared_ptr<Stream> findStream(StreamId id) const;
+    void onPacketReceived(Stream& stream, const char* data, size_t length);
+    H264NALUParser::PacketInfo classifyQueuedPacket(const std::vector<uint8_t>& packet) const;
+    void onFrameDecoded(Stream& stream, std::shared_ptr<const DecodedFrame> frame);
+    DecodeScheduler::WorkResult decodeNextPacket(Stream& stream);
+    void decodeLoop(Stream& stream);
+    void deliveryLoop(Stream& stream);
+
+    const Transport m_transport;
     CameraDataReceiver* m_receiver;
-    H264Decoder* m_decoder;
+    RtpDataReceiver* m_rtpReceiver;
+    H264DecoderOptions m_decoderOptions;
+    DecodeScheduler* m_scheduler;
+    const unsigned m_networkThreadCount;
+    const SocketOptions m_socketOptions;
     std::thread m_networkThread;
+    const size_t m_maxQueuedPackets;
+
+    // Open streams by ID; the primary stream is the one with the lowest ID
+    mutable std::mutex m_streamsMutex;
+    std::map<StreamId, std::shared_ptr<Stream>> m_streams;
+    std::atomic<StreamId> m_primaryStream;
+
+    std::mutex m_subscriptionsMutex;
+    std::map<int, std::shared_ptr<Subscription>> m_subscriptions;
+    int m_nextSubscriptionId;
+    int m_startSubscription;    // Made by start() with a callback, removed by stop()
+
+    // Reused buffer for the packed legacy callback
+    std::mutex m_packedFrameMutex;
+    std::vector<uint8_t> m_packedFrame;
 };
 
 #endif // NETWORKVIDEOSOURCE_H
@@ -0,0 +1,196 @@
+// Pixel format converter implementation with SSE2 and NEON fast paths
+#include "PixelFormatConverter.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXEL_CONVERTER_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_CONVERTER_NEON 1
+#endif
+
+namespace {
+
+// BT.601 limited range coefficients in 6-bit fixed point
+const int kYScale = 74;   // 1.164
+const int kVToR = 102;    // 1.596
+const int kUToG = 25;     // 0.391
+const int kVToG = 52;     // 0.813
+const int kUToB = 129;    // 2.018
+
+inline uint8_t clampToByte(int value) {
+  return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Scalar conversion of one pixel, matches the 16-bit SIMD arithmetic
+inline void yuvToBGRA(int y, int u, int v, uint8_t *dst) {
+  int yy = (y - 16) * kYScale + 32;
+  u -= 128;
+  v -= 128;
+  dst[0] = clampToByte((yy + kUToB * u) >> 6);
+  dst[1] = clampToByte((yy - kUToG * u - kVToG * v) >> 6);
+  dst[2] = clampToByte((yy + kVToR * v) >> 6);
+  dst[3] = 255;
+}
+
+void interleaveUVRow(const uint8_t *u, const uint8_t *v, uint8_t *dst,
+                     int count) {
+  int i = 0;
+#if defined(PIXEL_CONVERTER_SSE2)
+  for (; i + 16 <= count; i += 16) {
+    __m128i u8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + i));
+    __m128i v8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i),
+                     _mm_unpacklo_epi8(u8, v8));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i + 16),
+                     _mm_unpackhi_epi8(u8, v8));
+  }
+#elif defined(PIXEL_CONVERTER_NEON)
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x2_t uv;
+    uv.val[0] = vld1q_u8(u + i);
+    uv.val[1] = vld1q_u8(v + i);
+    vst2q_u8(dst + 2 * i, uv);
+  }
+#endif
+  for (; i < count; i++) {
+    dst[2 * i] = u[i];
+    dst[2 * i + 1] = v[i];
+  }
+}
+
+#if defined(PIXEL_CONVERTER_SSE2)
+// Converts 8 pixels held as 16-bit lanes into 8-bit B, G and R
+inline void yuvToBGR16(__m128i y, __m128i u, __m128i v, __m128i &b, __m128i &g,
+                       __m128i &r) {
+  const __m128i yOffset = _mm_set1_epi16(16);
+  const __m128i uvOffset = _mm_set1_epi16(128);
+  const __m128i rounding = _mm_set1_epi16(32);
+
+  __m128i yy = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_sub_epi16(y, yOffset), _mm_set1_epi16(kYScale)),
+      rounding);
+  u = _mm_sub_epi16(u, uvOffset);
+  v = _mm_sub_epi16(v, uvOffset);
+
+  b = _mm_srai_epi16(
+      _mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(kUToB))), 6);
+  g = _mm_srai_epi16(
+      _mm_subs_epi16(
+          _mm_subs_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(kUToG))),
+          _mm_mullo_epi16(v, _mm_set1_epi16(kVToG))),
+      6);
+  r = _mm_srai_epi16(
+      _mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(kVToR))), 6);
+}
+#endif
+
+void convertBGRARow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                    uint8_t *dst, int width) {
+  int x = 0;
+#if defined(PIXEL_CONVERTER_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+  for (; x + 16 <= width; x += 16) {
+    __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+    __m128i u8 =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2));
+    __m128i v8 =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2));
+
+    // Each chroma sample covers two horizontal pixels
+    __m128i u16 = _mm_unpacklo_epi8(u8, zero);
+    __m128i v16 = _mm_unpacklo_epi8(v8, zero);
+    __m128i uLo = _mm_unpacklo_epi16(u16, u16);
+    __m128i uHi = _mm_unpackhi_epi16(u16, u16);
+    __m128i vLo = _mm_unpacklo_epi16(v16, v16);
+    __m128i vHi = _mm_unpackhi_epi16(v16, v16);
+
+    __m128i bLo, gLo, rLo, bHi, gHi, rHi;
+    yuvToBGR16(_mm_unpacklo_epi8(y8, zero), uLo, vLo, bLo, gLo, rLo);
+    yuvToBGR16(_mm_unpackhi_epi8(y8, zero), uHi, vHi, bHi, gHi, rHi);
+
+    __m128i b = _mm_packus_epi16(bLo, bHi);
+    __m128i g = _mm_packus_epi16(gLo, gHi);
+    __m128i r = _mm_packus_epi16(rLo, rHi);
+
+    __m128i bgLo = _mm_unpacklo_epi8(b, g);
+    __m128i bgHi = _mm_unpackhi_epi8(b, g);
+    __m128i raLo = _mm_unpacklo_epi8(r, alpha);
+    __m128i raHi = _mm_unpackhi_epi8(r, alpha);
+
+    __m128i *out = reinterpret_cast<__m128i *>(dst + 4 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(bgLo, raLo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bgLo, raLo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bgHi, raHi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bgHi, raHi));
+  }
+#elif defined(PIXEL_CONVERTER_NEON)
+  const int16x8_t yOffset = vdupq_n_s16(16);
+  const int16x8_t uvOffset = vdupq_n_s16(128);
+  const int16x8_t rounding = vdupq_n_s16(32);
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t y8 = vld1q_u8(y + x);
+    // Each chroma sample covers two horizontal pixels
+    uint8x8x2_t uDup = vzip_u8(vld1_u8(u + x / 2), vld1_u8(u + x / 2));
+    uint8x8x2_t vDup = vzip_u8(vld1_u8(v + x / 2), vld1_u8(v + x / 2));
+
+    for (int half = 0; half < 2; half++) {
+      uint8x8_t yHalf = half == 0 ? vget_low_u8(y8) : vget_high_u8(y8);
+      int16x8_t yy = vreinterpretq_s16_u16(vmovl_u8(yHalf));
+      int16x8_t uu = vreinterpretq_s16_u16(vmovl_u8(uDup.val[half]));
+      int16x8_t vv = vreinterpretq_s16_u16(vmovl_u8(vDup.val[half]));
+
+      yy = vaddq_s16(vmulq_n_s16(vsubq_s16(yy, yOffset), kYScale), rounding);
+      uu = vsubq_s16(uu, uvOffset);
+      vv = vsubq_s16(vv, uvOffset);
+
+      uint8x8x4_t bgra;
+      bgra.val[0] = vqmovun_s16(
+          vshrq_n_s16(vqaddq_s16(yy, vmulq_n_s16(uu, kUToB)), 6));
+      bgra.val[1] = vqmovun_s16(vshrq_n_s16(
+          vqsubq_s16(vqsubq_s16(yy, vmulq_n_s16(uu, kUToG)),
+                     vmulq_n_s16(vv, kVToG)),
+          6));
+      bgra.val[2] = vqmovun_s16(
+          vshrq_n_s16(vqaddq_s16(yy, vmulq_n_s16(vv, kVToR)), 6));
+      bgra.val[3] = vdup_n_u8(255);
+      vst4_u8(dst + 4 * (x + half * 8), bgra);
+    }
+  }
+#endif
+  for (; x < width; x++) {
+    yuvToBGRA(y[x], u[x / 2], v[x / 2], dst + 4 * x);
+  }
+}
+
+} // namespace
+
+void PixelFormatConverter::i420ToNV12(const uint8_t *srcY, int srcStrideY,
+                                      const uint8_t *srcU, int srcStrideU,
+                                      const uint8_t *srcV, int srcStrideV,
+                                      uint8_t *dstY, int dstStrideY,
+                                      uint8_t *dstUV, int dstStrideUV,
+                                      int width, int height) {
+  for (int row = 0; row < height; row++) {
+    memcpy(dstY + row * dstStrideY, srcY + row * srcStrideY, width);
+  }
+  for (int row = 0; row < height / 2; row++) {
+    interleaveUVRow(srcU + row * srcStrideU, srcV + row * srcStrideV,
+                    dstUV + row * dstStrideUV, width / 2);
+  }
+}
+
+void PixelFormatConverter::i420ToBGRA(const uint8_t *srcY, int srcStrideY,
+                                      const uint8_t *srcU, int srcStrideU,
+                                      const uint8_t *srcV, int srcStrideV,
+                                      uint8_t *dst, int dstStride, int width,
+                                      int height) {
+  for (int row = 0; row < height; row++) {
+    convertBGRARow(srcY + row * srcStrideY, srcU + (row / 2) * srcStrideU,
+                   srcV + (row / 2) * srcStrideV, dst + row * dstStride,
+                   width);
+  }
+}
@@ -0,0 +1,24 @@
+//Pixel format converter class for turning decoded YUV420P pictures into display formats
+#pragma once
+
+#include <cstdint>
+
+// Converts I420 (YUV420P) planes into the formats display consumers upload directly.
+// Uses SSE2 on x86 and NEON on ARM, with a scalar path for other targets and for the
+// remaining pixels of each row. All paths produce identical output.
+// Width and height must be even.
+class PixelFormatConverter {
+public:
+  // Y plane is copied, U and V are interleaved into one UV plane
+  static void i420ToNV12(const uint8_t *srcY, int srcStrideY,
+                         const uint8_t *srcU, int srcStrideU,
+                         const uint8_t *srcV, int srcStrideV, uint8_t *dstY,
+                         int dstStrideY, uint8_t *dstUV, int dstStrideUV,
+                         int width, int height);
+
+  // BT.601 limited range to 32-bit BGRA with opaque alpha
+  static void i420ToBGRA(const uint8_t *srcY, int srcStrideY,
+                         const uint8_t *srcU, int srcStrideU,
+                         const uint8_t *srcV, int srcStrideV, uint8_t *dst,
+                         int dstStride, int width, int height);
+};
@@ -0,0 +1,352 @@
+//RTP data receiver implementation for camera streaming over UDP using ASIO
+#include "RtpDataReceiver.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// How often held-back packets are checked against the reorder delay
+const std::chrono::milliseconds kTimerInterval(5);
+const std::chrono::milliseconds kReportInterval(100);
+// A request answered by an IDR that was lost as well is repeated after this long
+const std::chrono::milliseconds kKeyframeRequestInterval(100);
+
+} // namespace
+
+// One sender, identified by its SSRC
+struct RtpDataReceiver::Stream {
+    StreamId id;
+    uint32_t ssrc;
+    std::chrono::steady_clock::time_point connectedTime;
+    std::chrono::steady_clock::time_point lastPacketTime;
+    DataCallback callback;
+    std::unique_ptr<H264RtpDepacketizer> depacketizer;
+    std::unique_ptr<RtpFecDecoder> fec;
+    asio::ip::udp::endpoint endpoint;               // Where the receiver reports go
+    std::chrono::steady_clock::time_point lastReportTime;
+    uint64_t reportedExpected;
+    uint64_t reportedReceived;
+    uint64_t requestedDropped;                      // Dropped access units when the last keyframe request went out
+    std::chrono::steady_clock::time_point lastKeyframeRequestTime;
+    // Refused by the connect handler: its packets are dropped without feedback to the
+    // sender, and it ends without a disconnect call
+    bool rejected;
+
+    std::string peer;
+    // Copies for getConnectionStats(), guarded by m_streamsMutex
+    H264RtpDepacketizer::Stats rtp;
+    RtpFecDecoder::Stats fecStats;
+    uint64_t bytesReceived;
+    uint64_t keyframeRequests;
+};
+
+RtpDataReceiver::RtpDataReceiver(const std::string& ip, int port, H264StreamFormat outputFormat,
+                                 size_t reorderWindow, std::chrono::microseconds maxReorderDelay,
+                                 std::chrono::milliseconds streamTimeout)
+    : m_ip(ip), m_port(port), m_outputFormat(outputFormat), m_reorderWindow(reorderWindow),
+      m_maxReorderDelay(maxReorderDelay), m_streamTimeout(streamTimeout),
+      m_fecPayloadType(RtpFecConfig().payloadType), m_reporterSSRC(std::random_device()()),
+      m_socket(m_io_context, asio::ip::udp::endpoint(asio::ip::make_address(m_ip), m_port)),
+      m_timer(m_io_context), m_should_exit(false), m_nextStreamId(1) {
+    // Room for a few keyframes' worth of datagrams while the io thread is busy
+    asio::error_code ec;
+    m_socket.set_option(asio::socket_base::receive_buffer_size(4 * 1024 * 1024), ec);
+}
+
+void RtpDataReceiver::run(DataCallback callback) {
+    run([callback](StreamId, const std::string&) { return callback; }, nullptr);
+}
+
+void RtpDataReceiver::run(ConnectHandler onConnected, DisconnectHandler onDisconnected) {
+    m_onConnected = onConnected;
+    m_onDisconnected = onDisconnected;
+    std::cout << "RtpDataReceiver::run() listening on " << m_ip << ":" << m_port << std::endl;
+
+    receive();
+    onTimer();
+
+    // Returns once stop() has closed the socket and cancelled the timer
+    m_io_context.run();
+    std::cout << "RtpDataReceiver: io_context run completed" << std::endl;
+}
+
+void RtpDataReceiver::stop() {
+    std::cout << "RtpDataReceiver::stop() called, setting exit flag" << std::endl;
+    m_should_exit = true;
+    asio::post(m_io_context, [this]() {
+        asio::error_code ec;
+        m_socket.close(ec);
+        m_timer.cancel();
+        endAllStreams();
+    });
+}
+
+void RtpDataReceiver::receive() {
+    m_socket.async_receive_from(asio::buffer(m_datagram), m_sender, [this](const asio::error_code& error, size_t size) {
+        if (m_should_exit || error == asio::error::operation_aborted) {
+            return;
+        }
+        if (!error) {
+            onDatagram(size);
+        }
+        else {
+            // ICMP errors from earlier sends and truncated datagrams only affect one packet
+            std::cerr << "RTP receive error: " << error.message() << std::endl;
+        }
+        receive();
+    });
+}
+
+void RtpDataReceiver::onDatagram(size_t size) {
+    uint16_t sequence;
+    uint32_t timestamp, ssrc;
+    bool marker;
+    size_t offset, payloadSize;
+    if (!H264RtpDepacketizer::parseHeader(m_datagram.data(), size, sequence, timestamp, ssrc, marker, offset, payloadSize)) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<Stream> stream;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        auto it = m_streams.find(ssrc);
+        if (it != m_streams.end()) {
+            stream = it->second;
+        }
+    }
+    if (!stream) {
+        const std::string peer = m_sender.address().to_string() + ":" + std::to_string(m_sender.port());
+        stream = std::make_shared<Stream>();
+        stream->id = m_nextStreamId++;
+        stream->ssrc = ssrc;
+        stream->connectedTime = now;
+        stream->endpoint = m_sender;
+        stream->lastReportTime = now;
+        stream->reportedExpected = 0;
+        stream->reportedReceived = 0;
+        stream->requestedDropped = 0;
+        stream->lastKeyframeRequestTime = now - kKeyframeRequestInterval;
+        stream->peer = peer;
+        stream->rtp = H264RtpDepacketizer::Stats();
+        stream->fecStats = RtpFecDecoder::Stats();
+        stream->bytesReceived = 0;
+        stream->keyframeRequests = 0;
+        std::cout << "RTP stream " << stream->id << " (SSRC " << ssrc << ") started from " << peer << std::endl;
+
+        Stream* streamPtr = stream.get();
+        stream->depacketizer.reset(new H264RtpDepacketizer(
+            [this, streamPtr](const uint8_t* data, size_t length) {
+                {
+                    std::lock_guard<std::mutex> lock(m_streamsMutex);
+                    streamPtr->bytesReceived += length;
+                }
+                try {
+                    if (streamPtr->callback) {
+                        streamPtr->callback(reinterpret_cast<const char*>(data), length);
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Exception in data callback: " << e.what() << std::endl;
+                }
+            },
+            m_outputFormat, m_reorderWindow, m_maxReorderDelay));
+        stream->fec.reset(new RtpFecDecoder([streamPtr](const uint8_t* packet, size_t length) {
+            streamPtr->depacketizer->push(packet, length);
+        }));
+        // A rejected stream, empty callback or exception, has nothing to close: it stays in
+        // the map so its packets are recognized and dropped until the sender goes silent
+        try {
+            stream->callback = m_onConnected ? m_onConnected(stream->id, peer) : DataCallback();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Exception in connect handler for stream " << stream->id << ": " << e.what() << std::endl;
+        }
+        stream->rejected = !stream->callback;
+        if (stream->rejected) {
+            std::cout << "RTP stream " << stream->id << " (SSRC " << ssrc << ") rejected" << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        m_streams[ssrc] = stream;
+    }
+
+    stream->lastPacketTime = now;
+    if (stream->rejected) {
+        return;
+    }
+    if ((m_datagram[1] & 0x7F) == m_fecPayloadType) {
+        stream->fec->pushFec(m_datagram.data(), size);
+    }
+    else {
+        stream->depacketizer->push(m_datagram.data(), size, now);
+        stream->fec->pushMedia(m_datagram.data(), size);
+    }
+    requestKeyframe(*stream, now);
+
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    stream->rtp = stream->depacketizer->getStats();
+    stream->fecStats = stream->fec->getStats();
+}
+
+void RtpDataReceiver::onTimer() {
+    if (m_should_exit) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Stream>> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (const auto& entry : m_streams) {
+            streams.push_back(entry.second);
+        }
+    }
+    for (const std::shared_ptr<Stream>& stream : streams) {
+        if (now - stream->lastPacketTime > m_streamTimeout) {
+            std::cout << "RTP stream " << stream->id << " timed out" << std::endl;
+            endStream(stream);
+            continue;
+        }
+        if (stream->rejected) {
+            continue;
+        }
+        stream->depacketizer->expire(now);
+        requestKeyframe(*stream, now);
+        if (now - stream->lastReportTime >= kReportInterval) {
+            stream->lastReportTime = now;
+            sendReport(*stream);
+        }
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        stream->rtp = stream->depacketizer->getStats();
+    }
+
+    m_timer.expires_after(kTimerInterval);
+    m_timer.async_wait([this](const asio::error_code& error) {
+        if (!error) {
+            onTimer();
+        }
+    });
+}
+
+void RtpDataReceiver::sendReport(Stream& stream) {
+    // Loss before recovery, so the sender sees what its FEC has to cover
+    const RtpFecDecoder::Stats stats = stream.fec->getStats();
+    const uint64_t expected = stats.mediaPacketsExpected - stream.reportedExpected;
+    const uint64_t received = stats.mediaPacketsReceived - stream.reportedReceived;
+    if (expected == 0) {
+        return;
+    }
+    stream.reportedExpected = stats.mediaPacketsExpected;
+    stream.reportedReceived = stats.mediaPacketsReceived;
+
+    const uint64_t lost = expected > received ? expected - received : 0;
+    RtpReceiverReport report;
+    report.reporterSSRC = m_reporterSSRC;
+    report.sourceSSRC = stream.ssrc;
+    report.fractionLost = static_cast<uint8_t>(std::min<uint64_t>(lost * 256 / expected, 255));
+    report.cumulativeLost = static_cast<uint32_t>(std::min<uint64_t>(
+        stats.mediaPacketsExpected > stats.mediaPacketsReceived ? stats.mediaPacketsExpected - stats.mediaPacketsReceived : 0,
+        0xFFFFFF));
+    report.highestSequence = stats.highestSequence;
+    report.jitter = 0;
+
+    uint8_t packet[RtpReceiverReport::kSize];
+    report.write(packet);
+    asio::error_code ec;
+    m_socket.send_to(asio::buffer(packet, sizeof(packet)), stream.endpoint, 0, ec);
+}
+
+void RtpDataReceiver::requestKeyframe(Stream& stream, std::chrono::steady_clock::time_point now) {
+    // Every access unit after a dropped one waits for an IDR frame in the decoder
+    const uint64_t dropped = stream.depacketizer->getStats().accessUnitsDropped;
+    if (dropped == stream.requestedDropped || now - stream.lastKeyframeRequestTime < kKeyframeRequestInterval) {
+        return;
+    }
+    stream.requestedDropped = dropped;
+    stream.lastKeyframeRequestTime = now;
+
+    RtpPictureLossIndication pli;
+    pli.senderSSRC = m_reporterSSRC;
+    pli.mediaSSRC = stream.ssrc;
+    uint8_t packet[RtpPictureLossIndication::kSize];
+    pli.write(packet);
+    asio::error_code ec;
+    m_socket.send_to(asio::buffer(packet, sizeof(packet)), stream.endpoint, 0, ec);
+
+    std::lock_guard<std::mutex> lock(m_streamsMutex);
+    stream.keyframeRequests++;
+}
+
+void RtpDataReceiver::endStream(const std::shared_ptr<Stream>& stream) {
+    if (stream->rejected) {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        m_streams.erase(stream->ssrc);
+        return;
+    }
+
+    // Deliver what is complete before the stream's last callback
+    stream->depacketizer->flush();
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        m_streams.erase(stream->ssrc);
+    }
+    if (m_onDisconnected) {
+        m_onDisconnected(stream->id);
+    }
+    std::cout << "RTP stream " << stream->id << " ended" << std::endl;
+}
+
+void RtpDataReceiver::endAllStreams() {
+    std::vector<std::shared_ptr<Stream>> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (const auto& entry : m_streams) {
+            streams.push_back(entry.second);
+        }
+    }
+    for (const std::shared_ptr<Stream>& stream : streams) {
+        endStream(stream);
+    }
+}
+
+std::vector<CameraDataReceiver::ConnectionStats> RtpDataReceiver::getConnectionStats() const {
+    std::vector<CameraDataReceiver::ConnectionStats> stats;
+    for (const StreamStats& stream : getStreamStats()) {
+        CameraDataReceiver::ConnectionStats connection;
+        connection.id = stream.id;
+        connection.peer = stream.peer;
+        connection.packetsReceived = stream.rtp.accessUnits;
+        connection.bytesReceived = stream.bytesReceived;
+        connection.connectedSeconds = stream.connectedSeconds;
+        stats.push_back(connection);
+    }
+    return stats;
+}
+
+std::vector<RtpDataReceiver::StreamStats> RtpDataReceiver::getStreamStats() const {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<StreamStats> stats;
+    {
+        std::lock_guard<std::mutex> lock(m_streamsMutex);
+        for (const auto& entry : m_streams) {
+            const Stream& stream = *entry.second;
+            if (stream.rejected) {
+                continue;
+            }
+            StreamStats streamStats;
+            streamStats.id = stream.id;
+            streamStats.peer = stream.peer;
+            streamStats.ssrc = stream.ssrc;
+            streamStats.rtp = stream.rtp;
+            streamStats.fec = stream.fecStats;
+            streamStats.bytesReceived = stream.bytesReceived;
+            streamStats.keyframeRequests = stream.keyframeRequests;
+            streamStats.connectedSeconds = std::chrono::duration<double>(now - stream.connectedTime).count();
+            stats.push_back(streamStats);
+        }
+    }
+    std::sort(stats.begin(), stats.end(), [](const StreamStats& a, const StreamStats& b) { return a.id < b.id; });
+    return stats;
+}
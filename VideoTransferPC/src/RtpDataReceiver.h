@@ -0,0 +1,99 @@
+//RTP data receiver class for receiving H264 video over UDP
+#ifndef RTPDATARECEIVER_H
+#define RTPDATARECEIVER_H
+
+#include "CameraDataReceiver.h"
+#include "H264RtpPacketizer.h"
+#include "RtpFec.h"
+#include <asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Receives RTP packets (RFC 6184) on a UDP port and passes complete access units to the
+// same callbacks as CameraDataReceiver. Every SSRC is a stream with its own depacketizer,
+// which reorders packets and drops access units that lost one. Packets with the FEC
+// payload type go to the stream's RtpFecDecoder, which rebuilds lost media packets ahead
+// of the depacketizer. Every stream gets an RTCP receiver report with its loss before
+// recovery every 100 ms, and a picture loss indication as soon as an access unit had to
+// be dropped, at most one per 100 ms. A stream ends when its sender has been silent for
+// streamTimeout.
+// The io_context runs on the thread that calls run(); a timer releases packets held back
+// by a gap once the reorder delay has passed, even if no further packets arrive.
+class RtpDataReceiver {
+public:
+    using DataCallback = CameraDataReceiver::DataCallback;
+    using StreamId = CameraDataReceiver::StreamId;
+    using ConnectHandler = CameraDataReceiver::ConnectHandler;
+    using DisconnectHandler = CameraDataReceiver::DisconnectHandler;
+
+    struct StreamStats {
+        StreamId id;
+        std::string peer;                  // Address:port of the stream's first packet
+        uint32_t ssrc;
+        H264RtpDepacketizer::Stats rtp;
+        RtpFecDecoder::Stats fec;
+        uint64_t bytesReceived;            // Bytes of the delivered access units
+        uint64_t keyframeRequests;         // Picture loss indications sent
+        double connectedSeconds;
+    };
+
+    // outputFormat is the format of the delivered access units, see H264RtpDepacketizer
+    RtpDataReceiver(const std::string& ip, int port,
+                    H264StreamFormat outputFormat = H264StreamFormat::AnnexB,
+                    size_t reorderWindow = 64,
+                    std::chrono::microseconds maxReorderDelay = std::chrono::milliseconds(20),
+                    std::chrono::milliseconds streamTimeout = std::chrono::milliseconds(2000));
+
+    // Access units of all streams go to the same callback
+    void run(DataCallback callback);
+    void run(ConnectHandler onConnected, DisconnectHandler onDisconnected);
+    // Close the socket, end all streams and make run() return. Safe to call from any thread.
+    void stop();
+
+    // Open streams, oldest first. packetsReceived counts delivered access units.
+    std::vector<CameraDataReceiver::ConnectionStats> getConnectionStats() const;
+    std::vector<StreamStats> getStreamStats() const;
+
+private:
+    struct Stream;
+
+    void receive();
+    void onDatagram(size_t size);
+    void onTimer();
+    void sendReport(Stream& stream);
+    void requestKeyframe(Stream& stream, std::chrono::steady_clock::time_point now);
+    void endStream(const std::shared_ptr<Stream>& stream);
+    void endAllStreams();
+
+    std::string m_ip;
+    int m_port;
+    const H264StreamFormat m_outputFormat;
+    const size_t m_reorderWindow;
+    const std::chrono::microseconds m_maxReorderDelay;
+    const std::chrono::milliseconds m_streamTimeout;
+    const uint8_t m_fecPayloadType;
+    const uint32_t m_reporterSSRC;
+
+    asio::io_context m_io_context;
+    asio::ip::udp::socket m_socket;
+    asio::steady_timer m_timer;
+    asio::ip::udp::endpoint m_sender;
+    std::array<uint8_t, 65536> m_datagram;
+    std::atomic_bool m_should_exit;
+    ConnectHandler m_onConnected;
+    DisconnectHandler m_onDisconnected;
+    StreamId m_nextStreamId;
+
+    // Streams by SSRC. Only the io thread changes the map or feeds the depacketizers;
+    // the mutex lets getConnectionStats() read them from other threads.
+    mutable std::mutex m_streamsMutex;
+    std::map<uint32_t, std::shared_ptr<Stream>> m_streams;
+};
+
+#endif // RTPDATARECEIVER_H
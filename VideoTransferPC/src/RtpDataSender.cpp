@@ -0,0 +1,211 @@
+//RTP data sender implementation for camera streaming over UDP using ASIO
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "RtpDataSender.h"
+#include "H264NALUParser.h"
+#include <array>
+
+namespace {
+
+// Receiver reports and keyframe requests come at most every 100 ms each, a frame rarely sees more than two
+const int kMaxReportsPerFrame = 16;
+
+size_t mediaPacketSize(size_t mtu, const RtpFecConfig& fec) {
+    if (fec.scheme == RtpFecScheme::None || mtu <= RtpFecEncoder::kPacketOverhead) {
+        return mtu;
+    }
+    return mtu - RtpFecEncoder::kPacketOverhead;
+}
+
+} // namespace
+
+RtpDataSender::RtpDataSender(const std::string& host, int port, const std::string& bindIP,
+                             size_t mtu, H264StreamFormat format, const RtpFecConfig& fec)
+    : m_host(host), m_port(port), m_bindIP(bindIP), m_format(format), m_socket(m_ioContext),
+      m_packetizer([this](const uint8_t* packet, size_t size) { onMediaPacket(packet, size); },
+                   mediaPacketSize(mtu, fec)),
+      m_fecEncoder(fec, m_packetizer.getSSRC()), m_framePacketCount(0),
+      m_lossRate(0.0), m_reorderRate(0.0), m_random(1), m_holding(false), m_keyframeRequested(false),
+      m_stats() {
+}
+
+RtpDataSender::~RtpDataSender() {
+    disconnect();
+}
+
+void RtpDataSender::connect() {
+    std::cout << "Sending RTP to " << m_host << ":" << m_port << std::endl;
+
+    asio::error_code error;
+    m_endpoint = asio::ip::udp::endpoint(asio::ip::address::from_string(m_host, error), m_port);
+    if (error) {
+        throw SendDataException("Invalid address " + m_host + ": " + error.message());
+    }
+    m_socket.open(asio::ip::udp::v4(), error);
+    if (error) {
+        throw SendDataException("Failed to open socket: " + error.message());
+    }
+
+    // If binding IP is specified, perform binding operation, otherwise use default network interface
+    if (!m_bindIP.empty()) {
+        asio::ip::udp::endpoint local_endpoint(asio::ip::address::from_string(m_bindIP, error), 0);
+        if (!error) {
+            m_socket.bind(local_endpoint, error);
+        }
+        if (error) {
+            throw SendDataException("Socket bind error: " + error.message());
+        }
+        std::cout << "Socket bound to " << local_endpoint.address().to_string() << std::endl;
+    }
+
+    // A keyframe is sent as a burst of datagrams, give it room in the send buffer
+    m_socket.set_option(asio::socket_base::send_buffer_size(4 * 1024 * 1024), error);
+    m_socket.non_blocking(true, error);
+    m_startTime = std::chrono::steady_clock::now();
+}
+
+void RtpDataSender::setNetworkSimulation(double lossRate, double reorderRate, unsigned seed) {
+    m_lossRate = lossRate;
+    m_reorderRate = reorderRate;
+    m_random.seed(seed);
+}
+
+void RtpDataSender::sendFrame(const uint8_t* data, size_t size) {
+    if (!m_socket.is_open()) {
+        throw SendDataException("Socket is not open. Cannot send data.");
+    }
+
+    // All packets of a frame carry its send time on the 90 kHz RTP clock
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_startTime);
+    const uint32_t timestamp = static_cast<uint32_t>(elapsed.count() * H264RtpPacketizer::kClockRate / 1000000);
+    pollReports();
+    if (m_keyframeRequested) {
+        const H264NALUParser::PacketInfo info = (m_format == H264StreamFormat::AVCC)
+                                                    ? H264NALUParser::classifyAVCCPacket(data, size)
+                                                    : H264NALUParser::classifyPacket(data, size);
+        if (info.hasIDR) {
+            m_keyframeRequested = false;
+        }
+    }
+    m_packetizer.packetize(data, size, timestamp, m_format);
+    if (m_framePacketCount > 0) {
+        m_fecEncoder.encode(m_framePackets.data(), m_framePacketCount,
+                            [this](const uint8_t* packet, size_t size) { onPacket(packet, size); });
+        m_framePacketCount = 0;
+    }
+    if (m_holding) {
+        // Reordering stays within the frame, so the receiver sees it well inside its reorder delay
+        m_holding = false;
+        writeDatagram(m_heldPacket.data(), m_heldPacket.size());
+    }
+
+    const H264RtpPacketizer::Stats packetizerStats = m_packetizer.getStats();
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.framesSent++;
+    m_stats.singleNALPackets = packetizerStats.singleNALPackets;
+    m_stats.stapAPackets = packetizerStats.stapAPackets;
+    m_stats.fuAPackets = packetizerStats.fuAPackets;
+    const RtpFecEncoder::Stats fecStats = m_fecEncoder.getStats();
+    m_stats.fecPackets = fecStats.fecPackets;
+    m_stats.fecBytes = fecStats.fecBytes;
+    m_stats.reportedLoss = fecStats.lossEstimate;
+    m_stats.fecOverhead = fecStats.mediaBytes > 0 ? static_cast<double>(fecStats.fecBytes) / fecStats.mediaBytes : 0.0;
+}
+
+void RtpDataSender::sendFrame(const AVPacket* packet) {
+    sendFrame(packet->data, static_cast<size_t>(packet->size));
+}
+
+void RtpDataSender::onMediaPacket(const uint8_t* packet, size_t size) {
+    if (m_fecEncoder.getConfig().scheme == RtpFecScheme::None) {
+        onPacket(packet, size);
+        return;
+    }
+    // The packetizer reuses its buffer, keep a copy until the frame's groups are known
+    if (m_framePacketCount == m_framePackets.size()) {
+        m_framePackets.emplace_back();
+    }
+    m_framePackets[m_framePacketCount++].assign(packet, packet + size);
+}
+
+void RtpDataSender::pollReports() {
+    std::array<uint8_t, 256> buffer;
+    asio::ip::udp::endpoint from;
+    for (int i = 0; i < kMaxReportsPerFrame; i++) {
+        asio::error_code error;
+        const size_t size = m_socket.receive_from(asio::buffer(buffer), from, 0, error);
+        if (error == asio::error::would_block) {
+            break;
+        }
+        // ICMP errors from a receiver that is not up yet also end up here
+        if (error) {
+            continue;
+        }
+        RtpReceiverReport report;
+        RtpPictureLossIndication pli;
+        if (RtpReceiverReport::parse(buffer.data(), size, report) && report.sourceSSRC == m_packetizer.getSSRC()) {
+            m_fecEncoder.reportLoss(report.fractionLost / 256.0);
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stats.reportsReceived++;
+        }
+        else if (RtpPictureLossIndication::parse(buffer.data(), size, pli) && pli.mediaSSRC == m_packetizer.getSSRC()) {
+            m_keyframeRequested = true;
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stats.keyframeRequests++;
+        }
+    }
+}
+
+void RtpDataSender::onPacket(const uint8_t* packet, size_t size) {
+    if (m_lossRate > 0.0 || m_reorderRate > 0.0) {
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        if (chance(m_random) < m_lossRate) {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stats.packetsSimulatedLost++;
+            return;
+        }
+        if (!m_holding && chance(m_random) < m_reorderRate) {
+            m_heldPacket.assign(packet, packet + size);
+            m_holding = true;
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stats.packetsSimulatedReordered++;
+            return;
+        }
+    }
+
+    writeDatagram(packet, size);
+    if (m_holding) {
+        m_holding = false;
+        writeDatagram(m_heldPacket.data(), m_heldPacket.size());
+    }
+}
+
+void RtpDataSender::writeDatagram(const uint8_t* packet, size_t size) {
+    asio::error_code error;
+    m_socket.send_to(asio::buffer(packet, size), m_endpoint, 0, error);
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    if (error) {
+        // Usually would_block with a full send buffer. UDP has no connection to lose,
+        // so any error only costs this datagram.
+        m_stats.packetsDropped++;
+    }
+    else {
+        m_stats.packetsSent++;
+        m_stats.bytesSent += size;
+    }
+}
+
+RtpDataSender::Stats RtpDataSender::getStats() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+void RtpDataSender::disconnect() {
+    if (m_socket.is_open()) {
+        asio::error_code error;
+        m_socket.close(error);
+        std::cout << "RTP sender closed" << std::endl;
+    }
+}
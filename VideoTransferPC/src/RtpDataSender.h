@@ -0,0 +1,98 @@
+//RTP data sender class for transmitting H264 video over UDP
+#ifndef RTPDATASENDER_H
+#define RTPDATASENDER_H
+
+#include "CameraDataSender.h"
+#include "H264RtpPacketizer.h"
+#include "RtpFec.h"
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+// Sends each frame as RTP packets (RFC 6184) over UDP. A lost datagram is never
+// retransmitted, so Wi-Fi loss costs the frames up to the receiver's next IDR instead of
+// stalling every later frame behind a TCP retransmission.
+// Packets go out on the calling thread. The socket is non-blocking; datagrams the send
+// buffer cannot take are dropped and counted, a late frame is of no use anyway.
+// With FEC the packets of each frame are collected first so parity can follow every
+// group; receiver reports arriving on the same socket set the adaptive FEC overhead.
+// A picture loss indication from the receiver makes needsKeyframe() true until the next
+// IDR frame has been sent.
+class RtpDataSender {
+public:
+    struct Stats {
+        uint64_t framesSent;
+        uint64_t packetsSent;
+        uint64_t bytesSent;                  // RTP packet bytes
+        uint64_t singleNALPackets;
+        uint64_t stapAPackets;
+        uint64_t fuAPackets;
+        uint64_t packetsDropped;             // Send buffer full
+        uint64_t packetsSimulatedLost;
+        uint64_t packetsSimulatedReordered;
+        uint64_t fecPackets;
+        uint64_t fecBytes;
+        uint64_t reportsReceived;
+        uint64_t keyframeRequests;           // Picture loss indications received
+        double reportedLoss;                 // Smoothed loss before recovery from the receiver reports
+        double fecOverhead;                  // FEC bytes per media byte so far
+    };
+
+    // mtu is the largest RTP packet, keep it below the path MTU minus the IP and UDP headers.
+    // format tells how to split the frames passed to sendFrame into NAL units.
+    // With FEC the media packets are made smaller so parity packets stay within mtu.
+    RtpDataSender(const std::string& host, int port, const std::string& bindIP = "",
+                  size_t mtu = 1200, H264StreamFormat format = H264StreamFormat::AnnexB,
+                  const RtpFecConfig& fec = RtpFecConfig());
+    ~RtpDataSender();
+
+    // Open the socket. Throws SendDataException on failure.
+    void connect();
+    // Packetize and send one access unit. Throws SendDataException when not connected.
+    void sendFrame(const uint8_t* data, size_t size);
+    // Same for an encoder packet; the packetizer copies the payload into the RTP packets anyway
+    void sendFrame(const AVPacket* packet);
+    // Drop lossRate of the datagrams and swap reorderRate of them with the next one of the
+    // same frame, for testing the receiver over localhost. Call before sending.
+    void setNetworkSimulation(double lossRate, double reorderRate, unsigned seed = 1);
+    // True from a picture loss indication until the next IDR frame, the encoder should be asked for one
+    bool needsKeyframe() const { return m_keyframeRequested; }
+    Stats getStats() const;
+    void disconnect();
+
+private:
+    void onMediaPacket(const uint8_t* packet, size_t size);
+    void onPacket(const uint8_t* packet, size_t size);
+    void pollReports();
+    void writeDatagram(const uint8_t* packet, size_t size);
+
+    std::string m_host;
+    int m_port;
+    std::string m_bindIP;
+    const H264StreamFormat m_format;
+
+    asio::io_context m_ioContext;
+    asio::ip::udp::socket m_socket;
+    asio::ip::udp::endpoint m_endpoint;
+    H264RtpPacketizer m_packetizer;
+    RtpFecEncoder m_fecEncoder;
+    std::vector<std::vector<uint8_t>> m_framePackets;  // Media packets of the frame being protected
+    size_t m_framePacketCount;
+    std::chrono::steady_clock::time_point m_startTime; // RTP timestamp zero
+
+    double m_lossRate;
+    double m_reorderRate;
+    std::mt19937 m_random;
+    std::vector<uint8_t> m_heldPacket;                 // Reordered packet waiting for the next one
+    bool m_holding;
+    std::atomic_bool m_keyframeRequested;
+
+    mutable std::mutex m_statsMutex;
+    Stats m_stats;
+};
+
+#endif // RTPDATASENDER_H
@@ -0,0 +1,701 @@
+// RTP forward error correction implementation with SSSE3/AVX2 and NEON GF(2^8) fast paths
+#include "RtpFec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GF_AVX2 1
+#define GF_SSSE3 1
+#elif defined(__SSSE3__) || defined(__AVX__)
+// x64 only guarantees SSE2, so MSVC builds need /arch:AVX or higher for this path
+// and use mulAddScalar otherwise
+#include <tmmintrin.h>
+#define GF_SSSE3 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GF_NEON 1
+#endif
+
+namespace {
+
+const uint8_t kSchemeXOR = 1;
+const uint8_t kSchemeReedSolomon = 2;
+// Media packets kept for recovery, a power of two
+const size_t kHistorySize = 1024;
+// Groups this far behind the newest media packet are given up on
+const int64_t kGroupLifetime = 512;
+const size_t kMaxGroups = 64;
+
+struct Tables {
+  uint8_t exp[512];
+  uint8_t log[256];
+
+  Tables() {
+    unsigned x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = static_cast<uint8_t>(x);
+      log[x] = static_cast<uint8_t>(i);
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= 0x11D;
+      }
+    }
+    // Doubled so log[a] + log[b] needs no reduction
+    for (int i = 255; i < 512; i++) {
+      exp[i] = exp[i - 255];
+    }
+    log[0] = 0;
+  }
+};
+
+const Tables &tables() {
+  static const Tables instance;
+  return instance;
+}
+
+// Row j of the Cauchy matrix 1 / (x_j + y_i) with x_j = 128 + j and y_i = i.
+// The two sets are disjoint for groups of up to 128 packets with up to 128
+// parity packets, which makes every square submatrix invertible.
+uint8_t cauchy(size_t parityIndex, size_t mediaIndex) {
+  return GF256::inv(static_cast<uint8_t>((128 + parityIndex) ^ mediaIndex));
+}
+
+void writeBE16(uint8_t *out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value >> 8);
+  out[1] = static_cast<uint8_t>(value);
+}
+
+void writeBE32(uint8_t *out, uint32_t value) {
+  out[0] = static_cast<uint8_t>(value >> 24);
+  out[1] = static_cast<uint8_t>(value >> 16);
+  out[2] = static_cast<uint8_t>(value >> 8);
+  out[3] = static_cast<uint8_t>(value);
+}
+
+uint16_t readBE16(const uint8_t *in) {
+  return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+uint32_t readBE32(const uint8_t *in) {
+  return (static_cast<uint32_t>(in[0]) << 24) |
+         (static_cast<uint32_t>(in[1]) << 16) |
+         (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// P(X <= count) for X ~ Binomial(n, p)
+double binomialAtMost(size_t n, double p, size_t count) {
+  double term = std::pow(1.0 - p, static_cast<double>(n));
+  double sum = term;
+  for (size_t i = 1; i <= count && i <= n; i++) {
+    term *= (static_cast<double>(n - i + 1) / i) * (p / (1.0 - p));
+    sum += term;
+  }
+  return std::min(sum, 1.0);
+}
+
+// Chance that a group of k media and m parity packets loses a media packet it
+// cannot rebuild, with independent losses at rate p
+double failureProbability(RtpFecScheme scheme, size_t k, size_t m, double p) {
+  if (m == 0) {
+    return 1.0 - std::pow(1.0 - p, static_cast<double>(k));
+  }
+  if (scheme == RtpFecScheme::ReedSolomon) {
+    return 1.0 - binomialAtMost(k + m, p, m);
+  }
+  // XOR: each interleaved subset and its parity packet survive one loss
+  double intact = 1.0;
+  for (size_t j = 0; j < m; j++) {
+    const size_t subset = (k - j + m - 1) / m + 1;
+    intact *= binomialAtMost(subset, p, 1);
+  }
+  return 1.0 - intact;
+}
+
+} // namespace
+
+const size_t RtpFecEncoder::kHeaderSize;
+const size_t RtpFecEncoder::kPacketOverhead;
+const size_t RtpFecEncoder::kMaxGroupSize;
+
+uint8_t GF256::mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  const Tables &t = tables();
+  return t.exp[t.log[a] + t.log[b]];
+}
+
+uint8_t GF256::inv(uint8_t a) {
+  const Tables &t = tables();
+  return t.exp[255 - t.log[a]];
+}
+
+void GF256::mulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+  if (c == 0) {
+    return;
+  }
+  if (c == 1) {
+    addTo(dst, src, size);
+    return;
+  }
+  size_t i = 0;
+#if defined(GF_SSSE3) || defined(GF_NEON)
+  // c * x = c * (x & 0x0F) + c * (x & 0xF0), both halves from 16-entry tables
+  uint8_t low[16], high[16];
+  for (int x = 0; x < 16; x++) {
+    low[x] = mul(c, static_cast<uint8_t>(x));
+    high[x] = mul(c, static_cast<uint8_t>(x << 4));
+  }
+#endif
+#if defined(GF_AVX2)
+  {
+    const __m256i low_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(low)));
+    const __m256i high_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(high)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    for (; size - i >= 32; i += 32) {
+      __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      __m256i product = _mm256_xor_si256(
+          _mm256_shuffle_epi8(low_table, _mm256_and_si256(value, mask)),
+          _mm256_shuffle_epi8(high_table,
+                              _mm256_and_si256(_mm256_srli_epi64(value, 4), mask)));
+      __m256i *out = reinterpret_cast<__m256i *>(dst + i);
+      _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(out), product));
+    }
+  }
+#endif
+#if defined(GF_SSSE3)
+  {
+    const __m128i low_table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(low));
+    const __m128i high_table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(high));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for (; size - i >= 16; i += 16) {
+      __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      __m128i product = _mm_xor_si128(
+          _mm_shuffle_epi8(low_table, _mm_and_si128(value, mask)),
+          _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi64(value, 4), mask)));
+      __m128i *out = reinterpret_cast<__m128i *>(dst + i);
+      _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(out), product));
+    }
+  }
+#elif defined(GF_NEON)
+  {
+    const uint8x16_t low_table = vld1q_u8(low);
+    const uint8x16_t high_table = vld1q_u8(high);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    for (; size - i >= 16; i += 16) {
+      uint8x16_t value = vld1q_u8(src + i);
+      uint8x16_t product = veorq_u8(vqtbl1q_u8(low_table, vandq_u8(value, mask)),
+                                    vqtbl1q_u8(high_table, vshrq_n_u8(value, 4)));
+      vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), product));
+    }
+  }
+#endif
+  if (i < size) {
+    mulAddScalar(dst + i, src + i, c, size - i);
+  }
+}
+
+void GF256::addTo(uint8_t *dst, const uint8_t *src, size_t size) {
+  size_t i = 0;
+  for (; size - i >= 8; i += 8) {
+    uint64_t a, b;
+    memcpy(&a, dst + i, 8);
+    memcpy(&b, src + i, 8);
+    a ^= b;
+    memcpy(dst + i, &a, 8);
+  }
+  for (; i < size; i++) {
+    dst[i] ^= src[i];
+  }
+}
+
+void GF256::mulAddScalar(uint8_t *dst, const uint8_t *src, uint8_t c,
+                         size_t size) {
+  if (c == 0) {
+    return;
+  }
+  const Tables &t = tables();
+  const unsigned log_c = t.log[c];
+  for (size_t i = 0; i < size; i++) {
+    if (src[i] != 0) {
+      dst[i] ^= t.exp[log_c + t.log[src[i]]];
+    }
+  }
+}
+
+RtpFecEncoder::RtpFecEncoder(const RtpFecConfig &config, uint32_t ssrc)
+    : m_config(config), m_ssrc(ssrc), m_lossEstimate(0.0), m_stats() {
+  m_config.maxGroupSize =
+      std::max<size_t>(1, std::min(m_config.maxGroupSize, kMaxGroupSize));
+  m_sequence = static_cast<uint16_t>(std::random_device()());
+}
+
+void RtpFecEncoder::reportLoss(double lossRate) {
+  lossRate = std::max(0.0, std::min(lossRate, 0.9));
+  // Follow rising loss quickly and let the overhead fall back slowly, Wi-Fi
+  // loss comes in episodes
+  const double weight = lossRate > m_lossEstimate ? 0.5 : 0.1;
+  m_lossEstimate += weight * (lossRate - m_lossEstimate);
+  m_stats.lossEstimate = m_lossEstimate;
+}
+
+size_t RtpFecEncoder::parityCount(size_t mediaCount) const {
+  if (m_config.scheme == RtpFecScheme::None || mediaCount == 0) {
+    return 0;
+  }
+  // XOR subsets need at least one media packet each
+  const size_t limit = m_config.scheme == RtpFecScheme::XOR
+                           ? mediaCount
+                           : kMaxGroupSize;
+  const double k = static_cast<double>(mediaCount);
+  size_t count = static_cast<size_t>(std::ceil(k * m_config.overhead - 1e-9));
+  if (!m_config.adaptive || m_lossEstimate <= 0.0) {
+    return std::min(count, limit);
+  }
+  const size_t most = std::min(
+      std::max<size_t>(static_cast<size_t>(std::ceil(k * m_config.maxOverhead - 1e-9)), 1),
+      limit);
+  while (count < most &&
+         failureProbability(m_config.scheme, mediaCount, count, m_lossEstimate) >
+             m_config.targetFailureRate) {
+    count++;
+  }
+  return std::min(count, limit);
+}
+
+void RtpFecEncoder::encode(const std::vector<uint8_t> *packets, size_t count,
+                           const PacketCallback &send) {
+  if (m_config.scheme == RtpFecScheme::None) {
+    for (size_t i = 0; i < count; i++) {
+      m_stats.mediaPackets++;
+      m_stats.mediaBytes += packets[i].size();
+      send(packets[i].data(), packets[i].size());
+    }
+    return;
+  }
+  // Split the access unit into groups of equal size
+  const size_t groups = (count + m_config.maxGroupSize - 1) / m_config.maxGroupSize;
+  for (size_t g = 0; g < groups; g++) {
+    const size_t begin = g * count / groups;
+    const size_t end = (g + 1) * count / groups;
+    encodeGroup(packets + begin, end - begin, send);
+  }
+}
+
+void RtpFecEncoder::encodeGroup(const std::vector<uint8_t> *packets,
+                                size_t count, const PacketCallback &send) {
+  // Media first, the parity computation never delays them
+  size_t longest = 0;
+  for (size_t i = 0; i < count; i++) {
+    m_stats.mediaPackets++;
+    m_stats.mediaBytes += packets[i].size();
+    longest = std::max(longest, packets[i].size());
+    send(packets[i].data(), packets[i].size());
+  }
+  m_stats.groups++;
+  const size_t parity_count = parityCount(count);
+  if (parity_count == 0 || longest < H264RtpPacketizer::kHeaderSize) {
+    return;
+  }
+
+  const size_t symbol_size = 2 + longest;
+  const size_t prefix = H264RtpPacketizer::kHeaderSize + kHeaderSize;
+  const bool xor_scheme = m_config.scheme == RtpFecScheme::XOR;
+  if (m_parity.size() < parity_count) {
+    m_parity.resize(parity_count);
+  }
+  for (size_t j = 0; j < parity_count; j++) {
+    m_parity[j].assign(prefix + symbol_size, 0);
+  }
+  for (size_t i = 0; i < count; i++) {
+    const std::vector<uint8_t> &packet = packets[i];
+    const uint8_t length[2] = {static_cast<uint8_t>(packet.size() >> 8),
+                               static_cast<uint8_t>(packet.size())};
+    for (size_t j = 0; j < parity_count; j++) {
+      const uint8_t c = xor_scheme ? (i % parity_count == j ? 1 : 0) : cauchy(j, i);
+      if (c == 0) {
+        continue;
+      }
+      uint8_t *symbol = m_parity[j].data() + prefix;
+      symbol[0] ^= GF256::mul(c, length[0]);
+      symbol[1] ^= GF256::mul(c, length[1]);
+      GF256::mulAdd(symbol + 2, packet.data(), c, packet.size());
+    }
+  }
+
+  for (size_t j = 0; j < parity_count; j++) {
+    uint8_t *header = m_parity[j].data();
+    header[0] = 0x80;
+    header[1] = m_config.payloadType & 0x7F;
+    writeBE16(header + 2, m_sequence++);
+    memcpy(header + 4, packets[0].data() + 4, 4); // Media timestamp
+    writeBE32(header + 8, m_ssrc);
+    uint8_t *fec = header + H264RtpPacketizer::kHeaderSize;
+    memcpy(fec, packets[0].data() + 2, 2); // Base sequence number
+    fec[2] = static_cast<uint8_t>(count);
+    fec[3] = static_cast<uint8_t>(parity_count);
+    fec[4] = static_cast<uint8_t>(j);
+    fec[5] = xor_scheme ? kSchemeXOR : kSchemeReedSolomon;
+    writeBE16(fec + 6, static_cast<uint16_t>(symbol_size));
+    m_stats.fecPackets++;
+    m_stats.fecBytes += m_parity[j].size();
+    send(m_parity[j].data(), m_parity[j].size());
+  }
+}
+
+RtpFecDecoder::RtpFecDecoder(PacketCallback recovered)
+    : m_callback(std::move(recovered)), m_history(kHistorySize),
+      m_highestSequence(-1), m_firstSequence(-1), m_stats() {
+  for (StoredPacket &slot : m_history) {
+    slot.sequence = -1;
+  }
+}
+
+int64_t RtpFecDecoder::extend(uint16_t sequence) const {
+  const int16_t delta = static_cast<int16_t>(
+      sequence - static_cast<uint16_t>(m_highestSequence));
+  return m_highestSequence + delta;
+}
+
+bool RtpFecDecoder::hasMedia(int64_t sequence) const {
+  return m_history[sequence & (kHistorySize - 1)].sequence == sequence;
+}
+
+const std::vector<uint8_t> &RtpFecDecoder::media(int64_t sequence) const {
+  return m_history[sequence & (kHistorySize - 1)].data;
+}
+
+bool RtpFecDecoder::store(const uint8_t *packet, size_t size, int64_t sequence) {
+  StoredPacket &slot = m_history[sequence & (kHistorySize - 1)];
+  if (slot.sequence == sequence) {
+    return false;
+  }
+  slot.sequence = sequence;
+  slot.data.assign(packet, packet + size);
+  return true;
+}
+
+void RtpFecDecoder::pushMedia(const uint8_t *packet, size_t size) {
+  if (size < H264RtpPacketizer::kHeaderSize || (packet[0] >> 6) != 2) {
+    return;
+  }
+  const uint16_t sequence16 = readBE16(packet + 2);
+  int64_t sequence;
+  if (m_highestSequence < 0) {
+    sequence = (int64_t(1) << 32) + sequence16;
+    m_highestSequence = sequence;
+    m_firstSequence = sequence;
+  } else {
+    sequence = extend(sequence16);
+    m_highestSequence = std::max(m_highestSequence, sequence);
+  }
+  if (sequence < m_firstSequence || !store(packet, size, sequence)) {
+    return;
+  }
+  m_stats.mediaPacketsReceived++;
+  m_stats.mediaPacketsExpected = static_cast<uint64_t>(m_highestSequence - m_firstSequence + 1);
+  m_stats.highestSequence = static_cast<uint32_t>(m_highestSequence);
+
+  for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+    if (sequence >= it->base && sequence < it->base + it->mediaCount) {
+      if (tryRecover(*it)) {
+        m_groups.erase(it);
+      }
+      break;
+    }
+  }
+  expireGroups();
+}
+
+void RtpFecDecoder::pushFec(const uint8_t *packet, size_t size) {
+  m_stats.fecPacketsReceived++;
+  const size_t prefix = H264RtpPacketizer::kHeaderSize + RtpFecEncoder::kHeaderSize;
+  if (m_highestSequence < 0) {
+    // Nothing to rebuild against yet
+    return;
+  }
+  if (size < prefix + 2 + H264RtpPacketizer::kHeaderSize || (packet[0] >> 6) != 2 ||
+      (packet[0] & 0x3F) != 0) {
+    m_stats.fecPacketsInvalid++;
+    return;
+  }
+  const uint8_t *fec = packet + H264RtpPacketizer::kHeaderSize;
+  const int64_t base = extend(readBE16(fec));
+  const uint8_t media_count = fec[2];
+  const uint8_t parity_count = fec[3];
+  const uint8_t index = fec[4];
+  const uint8_t scheme = fec[5];
+  const uint16_t symbol_size = readBE16(fec + 6);
+  const bool valid =
+      media_count > 0 && media_count <= RtpFecEncoder::kMaxGroupSize &&
+      index < parity_count && symbol_size == size - prefix &&
+      ((scheme == kSchemeXOR && parity_count <= media_count) ||
+       (scheme == kSchemeReedSolomon && parity_count <= RtpFecEncoder::kMaxGroupSize));
+  if (!valid) {
+    m_stats.fecPacketsInvalid++;
+    return;
+  }
+  if (base + media_count + kGroupLifetime < m_highestSequence) {
+    return;
+  }
+
+  auto it = std::find_if(m_groups.begin(), m_groups.end(),
+                         [&](const Group &group) { return group.base == base; });
+  if (it == m_groups.end()) {
+    Group group;
+    group.base = base;
+    group.mediaCount = media_count;
+    group.parityCount = parity_count;
+    group.scheme = scheme;
+    group.symbolSize = symbol_size;
+    group.recovered = false;
+    m_groups.push_back(std::move(group));
+    it = m_groups.end() - 1;
+  } else if (it->mediaCount != media_count || it->parityCount != parity_count ||
+             it->scheme != scheme || it->symbolSize != symbol_size) {
+    m_stats.fecPacketsInvalid++;
+    return;
+  }
+  for (const Parity &parity : it->parity) {
+    if (parity.index == index) {
+      return; // Duplicate
+    }
+  }
+  Parity parity;
+  parity.index = index;
+  parity.symbol.assign(packet + prefix, packet + size);
+  it->parity.push_back(std::move(parity));
+
+  if (tryRecover(*it)) {
+    m_groups.erase(it);
+  }
+  expireGroups();
+}
+
+bool RtpFecDecoder::tryRecover(Group &group) {
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < group.mediaCount; i++) {
+    if (!hasMedia(group.base + static_cast<int64_t>(i))) {
+      missing.push_back(i);
+    }
+  }
+  if (!missing.empty() && !group.parity.empty()) {
+    const bool done = group.scheme == kSchemeXOR ? recoverXOR(group, missing)
+                                                 : recoverReedSolomon(group, missing);
+    if (!done) {
+      return false;
+    }
+  } else if (!missing.empty()) {
+    return false;
+  }
+  if (group.recovered) {
+    m_stats.groupsRecovered++;
+  }
+  return true;
+}
+
+void RtpFecDecoder::addSymbol(uint8_t *dst, const std::vector<uint8_t> &packet,
+                              uint8_t c) {
+  dst[0] ^= GF256::mul(c, static_cast<uint8_t>(packet.size() >> 8));
+  dst[1] ^= GF256::mul(c, static_cast<uint8_t>(packet.size()));
+  GF256::mulAdd(dst + 2, packet.data(), c, packet.size());
+}
+
+bool RtpFecDecoder::recoverXOR(Group &group, const std::vector<size_t> &missing) {
+  size_t recovered = 0;
+  for (const Parity &parity : group.parity) {
+    // Parity j covers the media packets i with i % m == j
+    size_t lost = 0;
+    size_t lost_index = 0;
+    for (size_t i : missing) {
+      if (i % group.parityCount == parity.index) {
+        lost++;
+        lost_index = i;
+      }
+    }
+    if (lost != 1) {
+      continue;
+    }
+    m_symbol = parity.symbol;
+    bool consistent = true;
+    for (size_t i = parity.index; i < group.mediaCount; i += group.parityCount) {
+      if (i == lost_index) {
+        continue;
+      }
+      const std::vector<uint8_t> &packet = media(group.base + static_cast<int64_t>(i));
+      if (packet.size() + 2 > group.symbolSize) {
+        consistent = false;
+        break;
+      }
+      addSymbol(m_symbol.data(), packet, 1);
+    }
+    if (consistent) {
+      emit(group, lost_index, m_symbol.data());
+      recovered++;
+    }
+  }
+  return recovered == missing.size();
+}
+
+bool RtpFecDecoder::recoverReedSolomon(Group &group,
+                                       const std::vector<size_t> &missing) {
+  const size_t count = missing.size();
+  if (count > group.parity.size()) {
+    return false;
+  }
+  // Subtract the received media packets from the first count parity symbols,
+  // leaving count equations in the missing packets
+  if (m_work.size() < count) {
+    m_work.resize(count);
+  }
+  size_t next_missing = 0;
+  for (size_t r = 0; r < count; r++) {
+    m_work[r] = group.parity[r].symbol;
+  }
+  for (size_t i = 0; i < group.mediaCount; i++) {
+    if (next_missing < count && missing[next_missing] == i) {
+      next_missing++;
+      continue;
+    }
+    const std::vector<uint8_t> &packet = media(group.base + static_cast<int64_t>(i));
+    if (packet.size() + 2 > group.symbolSize) {
+      return false;
+    }
+    for (size_t r = 0; r < count; r++) {
+      addSymbol(m_work[r].data(), packet, cauchy(group.parity[r].index, i));
+    }
+  }
+
+  // Invert the count x count Cauchy submatrix by Gauss-Jordan elimination
+  std::vector<uint8_t> matrix(count * count);
+  std::vector<uint8_t> inverse(count * count, 0);
+  for (size_t r = 0; r < count; r++) {
+    for (size_t c = 0; c < count; c++) {
+      matrix[r * count + c] = cauchy(group.parity[r].index, missing[c]);
+    }
+    inverse[r * count + r] = 1;
+  }
+  for (size_t c = 0; c < count; c++) {
+    size_t pivot = c;
+    while (pivot < count && matrix[pivot * count + c] == 0) {
+      pivot++;
+    }
+    if (pivot == count) {
+      return false;
+    }
+    if (pivot != c) {
+      std::swap_ranges(matrix.begin() + pivot * count, matrix.begin() + (pivot + 1) * count,
+                       matrix.begin() + c * count);
+      std::swap_ranges(inverse.begin() + pivot * count, inverse.begin() + (pivot + 1) * count,
+                       inverse.begin() + c * count);
+    }
+    const uint8_t scale = GF256::inv(matrix[c * count + c]);
+    for (size_t k = 0; k < count; k++) {
+      matrix[c * count + k] = GF256::mul(matrix[c * count + k], scale);
+      inverse[c * count + k] = GF256::mul(inverse[c * count + k], scale);
+    }
+    for (size_t r = 0; r < count; r++) {
+      const uint8_t factor = matrix[r * count + c];
+      if (r == c || factor == 0) {
+        continue;
+      }
+      GF256::mulAdd(&matrix[r * count], &matrix[c * count], factor, count);
+      GF256::mulAdd(&inverse[r * count], &inverse[c * count], factor, count);
+    }
+  }
+
+  for (size_t c = 0; c < count; c++) {
+    m_symbol.assign(group.symbolSize, 0);
+    for (size_t r = 0; r < count; r++) {
+      GF256::mulAdd(m_symbol.data(), m_work[r].data(), inverse[c * count + r],
+                    group.symbolSize);
+    }
+    emit(group, missing[c], m_symbol.data());
+  }
+  return true;
+}
+
+void RtpFecDecoder::emit(Group &group, size_t index, const uint8_t *symbol) {
+  const size_t length = readBE16(symbol);
+  const int64_t sequence = group.base + static_cast<int64_t>(index);
+  // A wrong length or sequence number means the parity did not match the media
+  if (length < H264RtpPacketizer::kHeaderSize || length + 2 > group.symbolSize ||
+      readBE16(symbol + 4) != static_cast<uint16_t>(sequence)) {
+    m_stats.fecPacketsInvalid++;
+    return;
+  }
+  store(symbol + 2, length, sequence);
+  group.recovered = true;
+  m_stats.packetsRecovered++;
+  m_callback(symbol + 2, length);
+}
+
+void RtpFecDecoder::expireGroups() {
+  while (!m_groups.empty() &&
+         (m_groups.size() > kMaxGroups ||
+          m_groups.front().base + m_groups.front().mediaCount + kGroupLifetime <
+              m_highestSequence)) {
+    const Group &group = m_groups.front();
+    for (size_t i = 0; i < group.mediaCount; i++) {
+      if (!hasMedia(group.base + static_cast<int64_t>(i))) {
+        m_stats.groupsUnrecoverable++;
+        break;
+      }
+    }
+    m_groups.pop_front();
+  }
+}
+
+void RtpReceiverReport::write(uint8_t *out) const {
+  out[0] = 0x81; // Version 2, one report block
+  out[1] = kPacketType;
+  writeBE16(out + 2, static_cast<uint16_t>(kSize / 4 - 1));
+  writeBE32(out + 4, reporterSSRC);
+  writeBE32(out + 8, sourceSSRC);
+  writeBE32(out + 12, (static_cast<uint32_t>(fractionLost) << 24) |
+                          (cumulativeLost & 0xFFFFFF));
+  writeBE32(out + 16, highestSequence);
+  writeBE32(out + 20, jitter);
+  writeBE32(out + 24, 0); // No sender reports to refer to
+  writeBE32(out + 28, 0);
+}
+
+bool RtpReceiverReport::parse(const uint8_t *packet, size_t size,
+                              RtpReceiverReport &report) {
+  if (size < kSize || (packet[0] >> 6) != 2 || (packet[0] & 0x1F) < 1 ||
+      packet[1] != kPacketType) {
+    return false;
+  }
+  report.reporterSSRC = readBE32(packet + 4);
+  report.sourceSSRC = readBE32(packet + 8);
+  const uint32_t loss = readBE32(packet + 12);
+  report.fractionLost = static_cast<uint8_t>(loss >> 24);
+  report.cumulativeLost = loss & 0xFFFFFF;
+  report.highestSequence = readBE32(packet + 16);
+  report.jitter = readBE32(packet + 20);
+  return true;
+}
+
+void RtpPictureLossIndication::write(uint8_t *out) const {
+  out[0] = 0x80 | kFormat; // Version 2
+  out[1] = kPacketType;
+  writeBE16(out + 2, static_cast<uint16_t>(kSize / 4 - 1));
+  writeBE32(out + 4, senderSSRC);
+  writeBE32(out + 8, mediaSSRC);
+}
+
+bool RtpPictureLossIndication::parse(const uint8_t *packet, size_t size,
+                                     RtpPictureLossIndication &pli) {
+  if (size < kSize || (packet[0] >> 6) != 2 || (packet[0] & 0x1F) != kFormat ||
+      packet[1] != kPacketType) {
+    return false;
+  }
+  pli.senderSSRC = readBE32(packet + 4);
+  pli.mediaSSRC = readBE32(packet + 8);
+  return true;
+}
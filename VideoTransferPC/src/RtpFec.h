@@ -0,0 +1,225 @@
+// Forward error correction for the RTP transport: XOR parity and Reed-Solomon over GF(2^8)
+#pragma once
+
+#include "H264RtpPacketizer.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Arithmetic in GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D).
+// mulAdd() multiplies 16 or 32 bytes at a time by splitting each byte into
+// nibbles and looking both up in 16-entry product tables with SSSE3/AVX2
+// shuffles or NEON table lookups.
+class GF256 {
+public:
+  static uint8_t mul(uint8_t a, uint8_t b);
+  // Multiplicative inverse, a must not be 0
+  static uint8_t inv(uint8_t a);
+
+  // dst[i] ^= c * src[i]
+  static void mulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size);
+  // dst[i] ^= src[i]
+  static void addTo(uint8_t *dst, const uint8_t *src, size_t size);
+
+  // Byte-at-a-time reference implementation
+  static void mulAddScalar(uint8_t *dst, const uint8_t *src, uint8_t c,
+                           size_t size);
+};
+
+enum class RtpFecScheme {
+  None,
+  // One parity packet per interleaved subset of the group, recovers one
+  // loss per subset
+  XOR,
+  // Systematic Cauchy Reed-Solomon code, any m losses in a group with m
+  // parity packets are recovered
+  ReedSolomon
+};
+
+struct RtpFecConfig {
+  RtpFecScheme scheme = RtpFecScheme::None;
+  // Parity packets share the media SSRC and are told apart by payload type
+  uint8_t payloadType = 97;
+  // Media packets per group. Groups never span access units, a larger
+  // access unit is split into groups of equal size.
+  size_t maxGroupSize = 24;
+  // Parity packets per media packet; the minimum when adaptive
+  double overhead = 0.1;
+  double maxOverhead = 0.6;
+  // Follow the loss rate in the receiver reports
+  bool adaptive = true;
+  // Share of groups the adaptive overhead allows to be unrecoverable
+  double targetFailureRate = 0.001;
+};
+
+// Adds parity packets to the RTP packets of each access unit. Parity covers
+// whole media packets (header included) behind a 16-bit length, padded to the
+// longest packet of the group, so parity packets are kPacketOverhead bytes
+// longer than the media packets they protect. Each group's parity is sent
+// right after its media packets, a loss is repaired one group later at most.
+//
+// FEC packet payload, after a 12-byte RTP header with the FEC payload type and
+// its own sequence numbers:
+//   0  base sequence number (16 bits)   first media packet of the group
+//   2  media packet count k
+//   3  parity packet count m
+//   4  parity index
+//   5  scheme (1 XOR, 2 Reed-Solomon)
+//   6  symbol size (16 bits)            2 + longest media packet
+//   8  parity symbol
+class RtpFecEncoder {
+public:
+  using PacketCallback = H264RtpPacketizer::PacketCallback;
+
+  static const size_t kHeaderSize = 8;
+  static const size_t kPacketOverhead =
+      H264RtpPacketizer::kHeaderSize + kHeaderSize + 2;
+  // Limits of the Cauchy matrix layout, see RtpFec.cpp
+  static const size_t kMaxGroupSize = 128;
+
+  struct Stats {
+    uint64_t groups;
+    uint64_t mediaPackets;
+    uint64_t mediaBytes;
+    uint64_t fecPackets;
+    uint64_t fecBytes;
+    double lossEstimate; // Smoothed loss rate from the receiver reports
+  };
+
+  RtpFecEncoder(const RtpFecConfig &config, uint32_t ssrc);
+
+  // Protect the media packets of one access unit. send receives every media
+  // packet in order, each group followed by its parity packets.
+  void encode(const std::vector<uint8_t> *packets, size_t count,
+              const PacketCallback &send);
+
+  // Loss rate measured by the receiver, before recovery
+  void reportLoss(double lossRate);
+  // Parity packets for a group of mediaCount packets at the current loss
+  // estimate
+  size_t parityCount(size_t mediaCount) const;
+
+  const RtpFecConfig &getConfig() const { return m_config; }
+  Stats getStats() const { return m_stats; }
+
+private:
+  void encodeGroup(const std::vector<uint8_t> *packets, size_t count,
+                   const PacketCallback &send);
+
+  RtpFecConfig m_config;
+  const uint32_t m_ssrc;
+  uint16_t m_sequence;
+  double m_lossEstimate;
+  std::vector<std::vector<uint8_t>> m_parity;
+  Stats m_stats;
+};
+
+// Rebuilds lost media packets from the parity packets of RtpFecEncoder. Media
+// packets are kept for a while after they arrive; once a group is missing no
+// more packets than its parity can rebuild, the missing ones are passed to the
+// callback so they can join the other packets ahead of access unit assembly.
+// Also counts the media packets lost before recovery for the receiver reports.
+class RtpFecDecoder {
+public:
+  // Recovered RTP media packet, only valid during the call
+  using PacketCallback = H264RtpPacketizer::PacketCallback;
+
+  struct Stats {
+    uint64_t mediaPacketsExpected; // Sequence number span seen so far
+    uint64_t mediaPacketsReceived;
+    uint32_t highestSequence;      // Extended as in RTCP reports
+    uint64_t fecPacketsReceived;
+    uint64_t fecPacketsInvalid;
+    uint64_t packetsRecovered;
+    uint64_t groupsRecovered;     // Groups that lost packets and got them back
+    uint64_t groupsUnrecoverable; // Given up on with packets still missing
+  };
+
+  explicit RtpFecDecoder(PacketCallback recovered);
+
+  void pushMedia(const uint8_t *packet, size_t size);
+  void pushFec(const uint8_t *packet, size_t size);
+
+  Stats getStats() const { return m_stats; }
+
+private:
+  struct StoredPacket {
+    int64_t sequence; // Extended, -1 if the slot is empty
+    std::vector<uint8_t> data;
+  };
+
+  struct Parity {
+    uint8_t index;
+    std::vector<uint8_t> symbol;
+  };
+
+  struct Group {
+    int64_t base; // Extended sequence number of the first media packet
+    uint8_t mediaCount;
+    uint8_t parityCount;
+    uint8_t scheme;
+    uint16_t symbolSize;
+    std::vector<Parity> parity;
+    bool recovered; // A media packet of the group was rebuilt
+  };
+
+  int64_t extend(uint16_t sequence) const;
+  bool hasMedia(int64_t sequence) const;
+  const std::vector<uint8_t> &media(int64_t sequence) const;
+  // Returns false for a sequence number that was already stored
+  bool store(const uint8_t *packet, size_t size, int64_t sequence);
+  // Returns true once the group is complete
+  bool tryRecover(Group &group);
+  bool recoverXOR(Group &group, const std::vector<size_t> &missing);
+  bool recoverReedSolomon(Group &group, const std::vector<size_t> &missing);
+  void addSymbol(uint8_t *dst, const std::vector<uint8_t> &packet, uint8_t c);
+  void emit(Group &group, size_t index, const uint8_t *symbol);
+  void expireGroups();
+
+  PacketCallback m_callback;
+  // Recently received media packets by sequence number modulo the size
+  std::vector<StoredPacket> m_history;
+  std::deque<Group> m_groups;
+  int64_t m_highestSequence; // Extended, -1 before the first media packet
+  int64_t m_firstSequence;
+  std::vector<uint8_t> m_symbol;
+  std::vector<std::vector<uint8_t>> m_work;
+  Stats m_stats;
+};
+
+// RTCP receiver report (RFC 3550 6.4.2) with one report block. The receiver
+// sends one for each stream every so often; the sender uses the fraction lost
+// to set the FEC overhead.
+struct RtpReceiverReport {
+  static const size_t kSize = 32;
+  static const uint8_t kPacketType = 201;
+
+  uint32_t reporterSSRC;
+  uint32_t sourceSSRC;
+  uint8_t fractionLost; // Since the previous report, in 1/256
+  uint32_t cumulativeLost;
+  uint32_t highestSequence; // Extended
+  uint32_t jitter;
+
+  void write(uint8_t *out) const;
+  static bool parse(const uint8_t *packet, size_t size,
+                    RtpReceiverReport &report);
+};
+
+// RTCP picture loss indication (RFC 4585 6.3.1). The receiver sends one when an
+// access unit had to be dropped, so the sender's encoder produces an IDR frame
+// instead of the stream waiting for the next periodic one.
+struct RtpPictureLossIndication {
+  static const size_t kSize = 12;
+  static const uint8_t kPacketType = 206; // Payload-specific feedback
+  static const uint8_t kFormat = 1;
+
+  uint32_t senderSSRC;
+  uint32_t mediaSSRC; // Stream that needs the keyframe
+
+  void write(uint8_t *out) const;
+  static bool parse(const uint8_t *packet, size_t size,
+                    RtpPictureLossIndication &pli);
+};
@@ -0,0 +1,124 @@
+//Socket options implementation for the TCP connections of the camera stream
+#include "SocketOptions.h"
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+template <typename Socket, typename Option>
+void setOption(Socket& socket, const Option& option, const char* name, int value) {
+    asio::error_code ec;
+    socket.set_option(option, ec);
+    if (ec) {
+        std::cerr << "Failed to set " << name << "=" << value << ": " << ec.message() << std::endl;
+    }
+}
+
+void unsupported(const char* name) {
+    std::cerr << name << " is not supported on this platform, ignored" << std::endl;
+}
+
+template <typename Socket>
+void applyOptions(Socket& socket, const SocketOptions& options) {
+    if (options.noDelay) {
+        setOption(socket, asio::ip::tcp::no_delay(true), "TCP_NODELAY", 1);
+    }
+    if (options.sendBufferSize > 0) {
+        setOption(socket, asio::socket_base::send_buffer_size(options.sendBufferSize), "SO_SNDBUF", options.sendBufferSize);
+    }
+    if (options.receiveBufferSize > 0) {
+        setOption(socket, asio::socket_base::receive_buffer_size(options.receiveBufferSize), "SO_RCVBUF", options.receiveBufferSize);
+    }
+
+    if (options.notSentLowat > 0) {
+#ifdef TCP_NOTSENT_LOWAT
+        setOption(socket, asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(options.notSentLowat),
+                  "TCP_NOTSENT_LOWAT", options.notSentLowat);
+#else
+        unsupported("TCP_NOTSENT_LOWAT");
+#endif
+    }
+
+    if (options.priority >= 0) {
+#ifdef SO_PRIORITY
+        setOption(socket, asio::detail::socket_option::integer<SOL_SOCKET, SO_PRIORITY>(options.priority),
+                  "SO_PRIORITY", options.priority);
+#else
+        unsupported("SO_PRIORITY");
+#endif
+    }
+
+    if (options.dscp >= 0) {
+#if defined(IP_TOS) && !defined(_WIN32)
+        // The two low bits of the traffic class byte are ECN, which the kernel manages
+        const int tos = (options.dscp & 0x3F) << 2;
+        setOption(socket, asio::detail::socket_option::integer<IPPROTO_IP, IP_TOS>(tos), "IP_TOS", tos);
+#else
+        // Windows ignores IP_TOS, DSCP marking needs a QoS policy there
+        unsupported("IP_TOS");
+#endif
+    }
+
+    if (options.busyPollMicroseconds > 0) {
+#ifdef SO_BUSY_POLL
+        setOption(socket, asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>(options.busyPollMicroseconds),
+                  "SO_BUSY_POLL", options.busyPollMicroseconds);
+#else
+        unsupported("SO_BUSY_POLL");
+#endif
+    }
+}
+
+} // namespace
+
+SocketOptions SocketOptions::systemDefaults() {
+    SocketOptions options;
+    options.noDelay = false;
+    options.sendBufferSize = 0;
+    options.receiveBufferSize = 0;
+    options.notSentLowat = 0;
+    options.priority = -1;
+    options.dscp = -1;
+    options.busyPollMicroseconds = 0;
+    return options;
+}
+
+void SocketOptions::apply(asio::ip::tcp::socket& socket) const {
+    applyOptions(socket, *this);
+}
+
+void SocketOptions::apply(asio::ip::tcp::acceptor& acceptor) const {
+    applyOptions(acceptor, *this);
+}
+
+std::string SocketOptions::toString() const {
+    std::ostringstream out;
+    out << (noDelay ? "nodelay" : "nagle");
+    out << " sndbuf=";
+    if (sendBufferSize > 0) {
+        out << sendBufferSize;
+    }
+    else {
+        out << "default";
+    }
+    out << " rcvbuf=";
+    if (receiveBufferSize > 0) {
+        out << receiveBufferSize;
+    }
+    else {
+        out << "default";
+    }
+    if (notSentLowat > 0) {
+        out << " notsent-lowat=" << notSentLowat;
+    }
+    if (priority >= 0) {
+        out << " priority=" << priority;
+    }
+    if (dscp >= 0) {
+        out << " dscp=" << dscp;
+    }
+    if (busyPollMicroseconds > 0) {
+        out << " busy-poll=" << busyPollMicroseconds << "us";
+    }
+    return out.str();
+}
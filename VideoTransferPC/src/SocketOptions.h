@@ -0,0 +1,56 @@
+//Socket options for the TCP connections of CameraDataSender and CameraDataReceiver
+#ifndef SOCKETOPTIONS_H
+#define SOCKETOPTIONS_H
+
+#include <asio.hpp>
+#include <string>
+
+// Options set on a TCP socket before it connects, or on the listening socket and every
+// accepted socket of a receiver. Only TCP_NODELAY is on by default: it takes a few
+// milliseconds off every frame whose last segment would otherwise wait for an ACK, and
+// costs nothing on any link. Everything else is left to the operating system unless set.
+// In the localhost benchmark (RobotVisionConsole --bench-socket), a bounded receive buffer
+// together with TCP_NOTSENT_LOWAT keeps an overload backlog in the sender's queue, where
+// frames can be dropped, instead of in the kernel buffers. A fixed receive buffer also
+// turns off the kernel's automatic tuning and caps the TCP window, so measure on the real
+// link before using them.
+//
+// Options the platform does not have are skipped with a message. A failing option is
+// reported on std::cerr and does not fail the connection.
+struct SocketOptions {
+    // TCP_NODELAY, send small segments right away instead of waiting for outstanding ACKs
+    bool noDelay = true;
+    // SO_SNDBUF and SO_RCVBUF in bytes, 0 for the system default. Linux doubles the value
+    // and turns off its automatic tuning for the socket. The receive buffer bounds the TCP
+    // window: 128 KB carries about 50 Mbit/s at a 20 ms round trip, less than an IDR burst
+    // may need on a slower link.
+    int sendBufferSize = 0;
+    int receiveBufferSize = 0;
+    // TCP_NOTSENT_LOWAT (Linux, macOS): unsent bytes the kernel accepts beyond what is in
+    // flight, 0 for no limit. Frames wait in the sender's queue instead, where they can be dropped.
+    int notSentLowat = 0;
+    // SO_PRIORITY (Linux) for the queueing disciplines of the interface, -1 for unset.
+    // 0 to 6 need no privileges.
+    int priority = -1;
+    // Differentiated services code point, 0 to 63, written to IP_TOS; -1 for unset.
+    // 46 (EF) is the usual one for interactive video.
+    int dscp = -1;
+    // SO_BUSY_POLL (Linux) in microseconds, 0 for off. Blocking reads poll the device queue
+    // instead of waiting for the interrupt; values above the net.core.busy_read default may
+    // need CAP_NET_ADMIN.
+    int busyPollMicroseconds = 0;
+
+    // Every option left to the operating system, Nagle's algorithm included
+    static SocketOptions systemDefaults();
+
+    // Apply to an open socket, before connect() for the buffer sizes to shape the handshake
+    void apply(asio::ip::tcp::socket& socket) const;
+    // Apply to an open listening socket before bind(); Linux copies the options into every
+    // accepted socket, so the receive window is scaled for receiveBufferSize from the start
+    void apply(asio::ip::tcp::acceptor& acceptor) const;
+
+    // One line for logs, e.g. "nodelay sndbuf=default rcvbuf=131072 notsent-lowat=16384"
+    std::string toString() const;
+};
+
+#endif // SOCKETOPTIONS_H
@@ -45,6 +45,21 @@ void VideoFrameProvider::writeVideoFramePlane(uint8_t *dst, int dstlinesize, con
     }
 }
 
+void VideoFrameProvider::writeVideoFramePlane(uint8_t *dst, int dstlinesize, const uint8_t *src, int srclinesize, int xsize, int ysize)
+{
+    if(dstlinesize != srclinesize)
+    {
+        for(int i = 0; i<ysize; ++i)
+        {
+            memcpy(dst + i*dstlinesize, src + i*srclinesize, xsize);
+        }
+    }
+    else
+    {
+        memcpy(dst, src, srclinesize*ysize);
+    }
+}
+
 void VideoFrameProvider::presentFrame(const QByteArray &frameData, int width, int height, QVideoFrameFormat::PixelFormat pixFormat)
 {
     if((width == m_width
@@ -86,6 +101,61 @@ void VideoFrameProvider::presentFrame(const QByteArray &frameData, int width, in
     }
 }
 
+void VideoFrameProvider::presentFrame(const DecodedFrame &decodedFrame)
+{
+    const int width = decodedFrame.width;
+    const int height = decodedFrame.height;
+    QVideoFrameFormat::PixelFormat pixFormat = QVideoFrameFormat::Format_YUV420P;
+    if (decodedFrame.format == DecodedPixelFormat::NV12)
+        pixFormat = QVideoFrameFormat::Format_NV12;
+    else if (decodedFrame.format == DecodedPixelFormat::BGRA)
+        pixFormat = QVideoFrameFormat::Format_BGRA8888;
+
+    if((width == m_width
+        && height == m_height
+        && pixFormat == m_pixFormat) == false)
+    {
+        std::cout << "reset format to" << width << height << pixFormat << std::endl;
+        setFormat(width, height, pixFormat);
+    }
+
+    QVideoFrame frame(QVideoFrameFormat(QSize(width, height), pixFormat));
+    if (frame.map(QVideoFrame::WriteOnly))
+    {
+        switch(pixFormat)
+        {
+        case QVideoFrameFormat::Format_YUV420P:
+        {
+            writeVideoFramePlane(frame.bits(0), frame.bytesPerLine(0), decodedFrame.data[0], decodedFrame.linesize[0], width, height);
+            writeVideoFramePlane(frame.bits(1), frame.bytesPerLine(1), decodedFrame.data[1], decodedFrame.linesize[1], width/2, height/2);
+            writeVideoFramePlane(frame.bits(2), frame.bytesPerLine(2), decodedFrame.data[2], decodedFrame.linesize[2], width/2, height/2);
+        }
+        break;
+        case QVideoFrameFormat::Format_NV12:
+        {
+            writeVideoFramePlane(frame.bits(0), frame.bytesPerLine(0), decodedFrame.data[0], decodedFrame.linesize[0], width, height);
+            writeVideoFramePlane(frame.bits(1), frame.bytesPerLine(1), decodedFrame.data[1], decodedFrame.linesize[1], width, height/2);
+        }
+        break;
+        case QVideoFrameFormat::Format_BGRA8888:
+        {
+            writeVideoFramePlane(frame.bits(0), frame.bytesPerLine(0), decodedFrame.data[0], decodedFrame.linesize[0], width*4, height);
+        }
+        break;
+        default:
+        break;
+        }
+
+        frame.unmap();
+
+        if (m_surface)
+        {
+            m_surface->setVideoFrame(frame);
+            OutputDebugStringA("presentFrame done");
+        }
+    }
+}
+
 void VideoFrameProvider::setFormat(int width, int height, QVideoFrameFormat::PixelFormat pixFormat)
 {
     m_width = width;
@@ -6,6 +6,8 @@
 #include <QDebug>
 #include <QVideoSink>
 #include <QVideoFrame>
+#include "H264Decoder.h"
+
 class VideoFrameProvider: public QObject
 {
     Q_OBJECT
@@ -20,12 +22,15 @@ public:
     void setVideoSurface(QVideoSink *surface);
 
     void presentFrame(const QByteArray &frameData, int width, int height, QVideoFrameFormat::PixelFormat pixFormat);
+    // Upload a decoder frame view straight into the video frame, honoring the decoder strides
+    void presentFrame(const DecodedFrame &decodedFrame);
 
 signals:
     void videoSurfaceChanged();
 
 private:
     static void writeVideoFramePlane(uint8_t *dst, int dstlinesize, const uint8_t *src, int xsize, int ysize);
+    static void writeVideoFramePlane(uint8_t *dst, int dstlinesize, const uint8_t *src, int srclinesize, int xsize, int ysize);
     void setFormat(int width, int height, QVideoFrameFormat::PixelFormat pixFormat);
 
 private: